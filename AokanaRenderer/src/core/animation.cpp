@@ -0,0 +1,73 @@
+#include "animation.h"
+#include "scene.h"
+
+namespace Aokana {
+
+    namespace {
+
+        Transform InterpolateTransform(const std::vector<TransformKeyframe>& keyframes, double time, double& scale) {
+            size_t i0, i1;
+            double t;
+            FindKeyframes(keyframes, time, i0, i1, t);
+            const TransformKeyframe& k0 = keyframes[i0];
+            const TransformKeyframe& k1 = keyframes[i1];
+            Vector3 translation = (1 - t) * k0.translation + t * k1.translation;
+            Vector3 rotation = (1 - t) * k0.rotation + t * k1.rotation;
+            scale = Lerp(t, k0.scale, k1.scale);
+            return Transform::Translate(translation) *
+                Transform::RotateZ(rotation.z) * Transform::RotateY(rotation.y) * Transform::RotateX(rotation.x) *
+                Transform::Scale(Vector3(scale, scale, scale));
+        }
+    }
+
+    AnimatedPrimitive::AnimatedPrimitive(const std::shared_ptr<Primitive>& primitive, std::vector<TransformKeyframe> keyframes) :
+        primitive(primitive), keyframes(std::move(keyframes)) {
+        if (this->keyframes.empty()) this->keyframes.push_back(TransformKeyframe());
+        SetTime(this->keyframes.front().time);
+    }
+
+    void AnimatedPrimitive::SetTime(double time) {
+        render_from_object = InterpolateTransform(keyframes, time, scale);
+        world_bound = render_from_object.Apply(primitive->WorldBound());
+    }
+
+    Ray AnimatedPrimitive::ToObject(const Ray& ray) const {
+        Transform object_from_render = render_from_object.Inverse();
+        return Ray(object_from_render.Apply(ray.origin), object_from_render.Apply(ray.direction), ray.time);
+    }
+
+    bool AnimatedPrimitive::Intersect(const Ray& ray, double t_min, double t_max) const {
+        // 光线的方向是归一化的, 物体空间中的距离是世界空间中的 1 / scale 倍
+        return primitive->Intersect(ToObject(ray), t_min / scale, t_max / scale);
+    }
+
+    bool AnimatedPrimitive::IntersectP(const Ray& ray, SurfaceInteraction& isect, double t_min, double t_max) const {
+        if (!primitive->IntersectP(ToObject(ray), isect, t_min / scale, t_max / scale)) return false;
+        isect.time *= scale;
+        isect.p = render_from_object.Apply(isect.p);
+        isect.normal = Normalize(render_from_object.Apply(isect.normal));
+        return true;
+    }
+
+    Bounds3 AnimatedPrimitive::WorldBound(double, double) const {
+        return world_bound;
+    }
+
+    void SceneAnimation::SetTime(Scene& scene, double time) const {
+        if (!camera_keyframes.empty()) {
+            size_t i0, i1;
+            double t;
+            FindKeyframes(camera_keyframes, time, i0, i1, t);
+            const CameraKeyframe& k0 = camera_keyframes[i0];
+            const CameraKeyframe& k1 = camera_keyframes[i1];
+            Camera& camera = scene.camera;
+            camera.SetParameters(
+                Lerp(t, k0.look_from, k1.look_from), Lerp(t, k0.look_at, k1.look_at), camera_up,
+                Lerp(t, k0.vfov, k1.vfov), aspect_ratio,
+                Lerp(t, k0.aperture, k1.aperture), Lerp(t, k0.focus_distance, k1.focus_distance),
+                camera.ShutterOpen(), camera.ShutterClose());
+        }
+        for (const std::shared_ptr<AnimatedPrimitive>& primitive : primitives) primitive->SetTime(time);
+        scene.Refit();
+    }
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "camera.h"
+#include "primitive.h"
+#include "transform.h"
+
+namespace Aokana {
+
+    class Scene;
+
+    // 关键帧动画
+    // 关键帧按场景时间 (秒) 排序, 关键帧之间线性插值, 第一个关键帧之前与最后一个关键帧之后保持不变.
+    // 每一帧开始前把场景设置到该帧的时刻: 更新相机与动画图元的变换, 再重新拟合 BVH, 已加载的几何与纹理不会重建
+
+    // 刚体变换的关键帧: 先均匀缩放, 再依次绕 x, y, z 轴旋转 rotation 度, 最后平移
+    struct TransformKeyframe {
+        double time = 0;
+        Vector3 translation;
+        Vector3 rotation;
+        double scale = 1;
+    };
+
+    struct CameraKeyframe {
+        double time = 0;
+        Point3 look_from;
+        Point3 look_at;
+        double vfov = 40;
+        double aperture = 0;
+        double focus_distance = 10;
+    };
+
+    // 在按时间排序的关键帧中找到 time 所在的区间 [i0, i1] 与区间内的插值参数 t
+    template <typename Keyframe>
+    void FindKeyframes(const std::vector<Keyframe>& keyframes, double time, size_t& i0, size_t& i1, double& t) {
+        i0 = i1 = 0;
+        t = 0;
+        if (keyframes.empty() || time <= keyframes.front().time) return;
+        i0 = i1 = keyframes.size() - 1;
+        if (time >= keyframes.back().time) return;
+        i1 = 1;
+        while (keyframes[i1].time < time) ++i1;
+        i0 = i1 - 1;
+        t = (time - keyframes[i0].time) / (keyframes[i1].time - keyframes[i0].time);
+    }
+
+    // 随时间做刚体运动的图元, 光线变换到物体空间后与原图元求交
+    // 变换只在每帧开始时由 SetTime 更新, 一帧之内图元保持不动
+    class AnimatedPrimitive : public Primitive {
+    public:
+        AnimatedPrimitive(const std::shared_ptr<Primitive>& primitive, std::vector<TransformKeyframe> keyframes);
+
+        // 设置当前时刻的变换, 之后需要重新拟合包含该图元的 BVH
+        void SetTime(double time);
+
+        virtual bool Intersect(const Ray& ray, double t_min = 0.0001, double t_max = 1.0) const override;
+        virtual bool IntersectP(const Ray& ray, SurfaceInteraction& isect, double t_min = 0.0001, double t_max = 1.0) const override;
+        virtual Bounds3 WorldBound(double time0 = 0.0001, double time1 = 1.0) const override;
+        virtual const Material* GetMaterial() const override { return primitive->GetMaterial(); }
+
+    private:
+        Ray ToObject(const Ray& ray) const;
+
+        std::shared_ptr<Primitive> primitive;
+        std::vector<TransformKeyframe> keyframes;
+        Transform render_from_object;
+        double scale = 1;
+        Bounds3 world_bound;
+    };
+
+    class SceneAnimation {
+    public:
+        double frames_per_second = 24;
+        int frame_count = 48;
+
+        // 为空时相机不动; camera_up 与 aspect_ratio 不随时间变化
+        std::vector<CameraKeyframe> camera_keyframes;
+        Vector3 camera_up = Vector3(0, 1, 0);
+        double aspect_ratio = 16.0 / 9.0;
+
+        std::vector<std::shared_ptr<AnimatedPrimitive>> primitives;
+
+        double FrameTime(int frame) const { return frame / frames_per_second; }
+        // 把场景设置到时刻 time
+        void SetTime(Scene& scene, double time) const;
+    };
+}
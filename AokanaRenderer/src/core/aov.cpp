@@ -0,0 +1,176 @@
+#include "aov.h"
+#include "film.h"
+#include "image_io.h"
+
+#include <algorithm>
+#include <iostream>
+#include <istream>
+#include <limits>
+#include <ostream>
+#include <sstream>
+
+namespace Aokana {
+
+    AOVBuffers::AOVBuffers(int width, int height, uint32_t flags) : width(width), height(height), flags(flags) {
+        const size_t count = static_cast<size_t>(width) * height;
+        if (flags & (AOV_DEPTH | AOV_NORMAL | AOV_ALBEDO | AOV_TIME)) sample_count.resize(count);
+        if (flags & AOV_DEPTH) {
+            hit_count.resize(count);
+            depth_sum.resize(count);
+        }
+        if (flags & AOV_NORMAL) normal_sum.resize(count * 3);
+        if (flags & AOV_ALBEDO) albedo_sum.resize(count * 3);
+        if (flags & AOV_MATERIAL_ID) material_id.resize(count);
+        if (flags & AOV_PRIMITIVE_ID) primitive_id.resize(count);
+        if (flags & AOV_TIME) time_sum.resize(count);
+    }
+
+    void AOVBuffers::AddSample(int u, int v, const AOVSample& sample) {
+        const size_t index = Index(u, v);
+        if (!sample_count.empty()) ++sample_count[index];
+        if (sample.hit && !hit_count.empty()) {
+            ++hit_count[index];
+            depth_sum[index] += static_cast<float>(sample.depth);
+        }
+        if (!normal_sum.empty() && sample.hit) {
+            normal_sum[index * 3 + 0] += static_cast<float>(sample.normal.x);
+            normal_sum[index * 3 + 1] += static_cast<float>(sample.normal.y);
+            normal_sum[index * 3 + 2] += static_cast<float>(sample.normal.z);
+        }
+        if (!albedo_sum.empty()) {
+            albedo_sum[index * 3 + 0] += static_cast<float>(sample.albedo.x);
+            albedo_sum[index * 3 + 1] += static_cast<float>(sample.albedo.y);
+            albedo_sum[index * 3 + 2] += static_cast<float>(sample.albedo.z);
+        }
+        if (!material_id.empty() && material_id[index] == 0) material_id[index] = sample.material_id;
+        if (!primitive_id.empty() && primitive_id[index] == 0) primitive_id[index] = sample.primitive_id;
+        if (!time_sum.empty()) time_sum[index] += static_cast<float>(sample.time);
+    }
+
+    std::vector<float> AOVBuffers::GetImage(uint32_t flag, const Film& film) const {
+        const int channels = (flag == AOV_NORMAL || flag == AOV_ALBEDO) ? 3 : 1;
+        std::vector<float> image(static_cast<size_t>(width) * height * channels);
+        for (int v = 0; v < height; ++v) {
+            for (int u = 0; u < width; ++u) {
+                const size_t index = Index(u, v);
+                float* dst = image.data() + (static_cast<size_t>(height - 1 - v) * width + u) * channels;
+                const float inv_count = sample_count.empty() || sample_count[index] == 0 ? 0.0f : 1.0f / sample_count[index];
+                switch (flag) {
+                case AOV_DEPTH:
+                    dst[0] = hit_count[index] > 0 ? depth_sum[index] / hit_count[index] : std::numeric_limits<float>::infinity();
+                    break;
+                case AOV_NORMAL: {
+                    // 平均后重新归一化, 物体边缘处的法线取各样本的平均方向
+                    Vector3 n(normal_sum[index * 3], normal_sum[index * 3 + 1], normal_sum[index * 3 + 2]);
+                    double length = n.Length();
+                    for (int c = 0; c < 3; ++c) dst[c] = length > 0 ? static_cast<float>(n[c] / length) : 0.0f;
+                    break;
+                }
+                case AOV_ALBEDO:
+                    for (int c = 0; c < 3; ++c) dst[c] = albedo_sum[index * 3 + c] * inv_count;
+                    break;
+                case AOV_MATERIAL_ID:
+                    dst[0] = static_cast<float>(material_id[index]);
+                    break;
+                case AOV_PRIMITIVE_ID:
+                    dst[0] = static_cast<float>(primitive_id[index]);
+                    break;
+                case AOV_SAMPLE_COUNT:
+                    dst[0] = static_cast<float>(film.GetPixel(u, v).sample_count);
+                    break;
+                case AOV_TIME:
+                    dst[0] = time_sum[index] * inv_count;
+                    break;
+                default:
+                    break;
+                }
+            }
+        }
+        return image;
+    }
+
+    void AOVBuffers::Save(const std::string& prefix, const Film& film) const {
+        for (uint32_t flag = 1; flag & AOV_ALL; flag <<= 1) {
+            if (!Enabled(flag)) continue;
+            const int channels = (flag == AOV_NORMAL || flag == AOV_ALBEDO) ? 3 : 1;
+            std::string path = prefix + "." + AOVName(flag) + ".pfm";
+            if (WritePFM(path, width, height, GetImage(flag, film).data(), channels)) {
+                std::cout << "[INFO] AOV " << AOVName(flag) << " was successfully written to \"" << path << "\"." << std::endl;
+            }
+        }
+    }
+
+    template <typename Self, typename F>
+    void AOVBuffers::ForEachBuffer(Self& self, F&& f) {
+        f(self.sample_count);
+        f(self.hit_count);
+        f(self.depth_sum);
+        f(self.normal_sum);
+        f(self.albedo_sum);
+        f(self.material_id);
+        f(self.primitive_id);
+        f(self.time_sum);
+    }
+
+    void AOVBuffers::CopyRect(const AOVBuffers& other, int u_min, int v_min, int u_max, int v_max) {
+        auto copy = [&](auto& buffer, const auto& source, int channels) {
+            if (buffer.empty()) return;
+            for (int v = v_min; v <= v_max; ++v) {
+                const size_t begin = Index(u_min, v) * channels, end = (Index(u_max, v) + 1) * channels;
+                std::copy(source.begin() + begin, source.begin() + end, buffer.begin() + begin);
+            }
+        };
+        copy(sample_count, other.sample_count, 1);
+        copy(hit_count, other.hit_count, 1);
+        copy(depth_sum, other.depth_sum, 1);
+        copy(normal_sum, other.normal_sum, 3);
+        copy(albedo_sum, other.albedo_sum, 3);
+        copy(material_id, other.material_id, 1);
+        copy(primitive_id, other.primitive_id, 1);
+        copy(time_sum, other.time_sum, 1);
+    }
+
+    void AOVBuffers::Write(std::ostream& out) const {
+        ForEachBuffer(*this, [&](const auto& buffer) {
+            out.write(reinterpret_cast<const char*>(buffer.data()), buffer.size() * sizeof(buffer[0]));
+        });
+    }
+
+    bool AOVBuffers::Read(std::istream& in) {
+        ForEachBuffer(*this, [&](auto& buffer) {
+            in.read(reinterpret_cast<char*>(buffer.data()), buffer.size() * sizeof(buffer[0]));
+        });
+        return static_cast<bool>(in);
+    }
+
+    const char* AOVName(uint32_t flag) {
+        switch (flag) {
+        case AOV_DEPTH: return "depth";
+        case AOV_NORMAL: return "normal";
+        case AOV_ALBEDO: return "albedo";
+        case AOV_MATERIAL_ID: return "material_id";
+        case AOV_PRIMITIVE_ID: return "primitive_id";
+        case AOV_SAMPLE_COUNT: return "sample_count";
+        case AOV_TIME: return "time";
+        default: return "unknown";
+        }
+    }
+
+    uint32_t ParseAOVFlags(const std::string& names) {
+        uint32_t flags = AOV_NONE;
+        std::stringstream stream(names);
+        std::string name;
+        while (std::getline(stream, name, ',')) {
+            if (name.empty() || name == "none") continue;
+            if (name == "all") {
+                flags |= AOV_ALL;
+                continue;
+            }
+            uint32_t flag = 1;
+            while ((flag & AOV_ALL) && name != AOVName(flag)) flag <<= 1;
+            if (flag & AOV_ALL) flags |= flag;
+            else std::cerr << "[ERROR] Unknown AOV \"" << name << "\"." << std::endl;
+        }
+        return flags;
+    }
+}
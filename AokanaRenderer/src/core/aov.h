@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#include "vec.h"
+
+namespace Aokana {
+
+    class Film;
+
+    // 任意输出变量 (arbitrary output variables), 用于降噪与质量检查
+    // 在每个样本的第一个交点处记录, 按样本所在的像素取平均 (不经过重建滤波器); 编号类的 AOV 取像素第一个击中物体的样本
+    enum AOVFlags : uint32_t {
+        AOV_NONE = 0,
+        AOV_DEPTH = 1u << 0,          // 相机到第一个交点的距离, 没有击中物体的像素为无穷大
+        AOV_NORMAL = 1u << 1,         // 朝向相机一侧的世界空间着色法线
+        AOV_ALBEDO = 1u << 2,         // 第一个交点处的反照率 (材质的衰减), 未击中时为背景颜色
+        AOV_MATERIAL_ID = 1u << 3,    // Material::id, 未击中时为 0
+        AOV_PRIMITIVE_ID = 1u << 4,   // Primitive::id, 未击中时为 0
+        AOV_SAMPLE_COUNT = 1u << 5,   // 像素的样本数
+        AOV_TIME = 1u << 6,           // 样本在快门区间内的平均时刻
+        AOV_ALL = (1u << 7) - 1
+    };
+
+    // 一个样本的 AOV, 由 SamplerIntegrator::Li 在第一个交点处填写
+    struct AOVSample {
+        bool hit = false;
+        double depth = 0;
+        Normal3 normal;
+        Color albedo;
+        uint32_t material_id = 0;
+        uint32_t primitive_id = 0;
+        double time = 0;
+    };
+
+    // 只为启用的 AOV 分配内存; 每个像素只由渲染它的线程写入, 不需要加锁
+    // 缓冲使用胶片坐标 (v 轴向上), 输出时翻转为图像坐标
+    class AOVBuffers {
+    public:
+        AOVBuffers(int width, int height, uint32_t flags);
+
+        bool Enabled(uint32_t flag) const { return (flags & flag) != 0; }
+        void AddSample(int u, int v, const AOVSample& sample);
+
+        // 返回某个 AOV 的图像, 逐行存储, 第 0 行在最上面; 法线与反照率为 3 通道, 其余为单通道
+        std::vector<float> GetImage(uint32_t flag, const Film& film) const;
+        // 把启用的 AOV 保存为 <prefix>.<name>.pfm
+        void Save(const std::string& prefix, const Film& film) const;
+
+        // 检查点使用: 复制 other (大小与启用的 AOV 相同) 中 [u_min, u_max] x [v_min, v_max] 范围的累积量
+        void CopyRect(const AOVBuffers& other, int u_min, int v_min, int u_max, int v_max);
+        // 以原始字节读写所有累积量; Read 读取不完整时返回 false
+        void Write(std::ostream& out) const;
+        bool Read(std::istream& in);
+
+        const int width, height;
+        const uint32_t flags;
+
+    private:
+        size_t Index(int u, int v) const { return static_cast<size_t>(v) * width + u; }
+        // 按固定顺序对每个累积缓冲调用 f, Write 与 Read 共用
+        template <typename Self, typename F> static void ForEachBuffer(Self& self, F&& f);
+
+        std::vector<uint32_t> sample_count;     // 计入 AOV 的样本数
+        std::vector<uint32_t> hit_count;
+        std::vector<float> depth_sum;
+        std::vector<float> normal_sum;
+        std::vector<float> albedo_sum;
+        std::vector<uint32_t> material_id;
+        std::vector<uint32_t> primitive_id;
+        std::vector<float> time_sum;
+    };
+
+    // 解析以逗号分隔的 AOV 名字 ("depth,normal,albedo,material_id,primitive_id,sample_count,time", "all", "none")
+    uint32_t ParseAOVFlags(const std::string& names);
+    const char* AOVName(uint32_t flag);
+}
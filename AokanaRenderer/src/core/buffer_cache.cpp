@@ -0,0 +1,53 @@
+#include "buffer_cache.h"
+
+#include <iomanip>
+#include <iostream>
+
+namespace Aokana {
+
+	namespace {
+		BufferCache<int> int_buffer_cache;
+		BufferCache<Point3> point3_buffer_cache;
+		BufferCache<Normal3> normal3_buffer_cache;
+		BufferCache<Vector3> vector3_buffer_cache;
+		BufferCache<Point2> point2_buffer_cache;
+		BufferCache<SphericalGeometry::OctahedralVector> octahedral_vector_buffer_cache;
+		BufferCache<QuantizedPoint2> quantized_point2_buffer_cache;
+		BufferCache<QuantizedPoint3> quantized_point3_buffer_cache;
+
+		template <typename T>
+		void Accumulate(const BufferCache<T>& cache, size_t& count, size_t& stored, size_t& external, size_t& shared) {
+			count += cache.BufferCount();
+			stored += cache.BytesStored();
+			external += cache.BytesExternal();
+			shared += cache.BytesShared();
+		}
+	}
+
+	BufferCache<int>* g_int_buffer_cache = &int_buffer_cache;
+	BufferCache<Point3>* g_point3_buffer_cache = &point3_buffer_cache;
+	BufferCache<Normal3>* g_normal3_buffer_cache = &normal3_buffer_cache;
+	BufferCache<Vector3>* g_vector3_buffer_cache = &vector3_buffer_cache;
+	BufferCache<Point2>* g_point2_buffer_cache = &point2_buffer_cache;
+	BufferCache<SphericalGeometry::OctahedralVector>* g_octahedral_vector_buffer_cache = &octahedral_vector_buffer_cache;
+	BufferCache<QuantizedPoint2>* g_quantized_point2_buffer_cache = &quantized_point2_buffer_cache;
+	BufferCache<QuantizedPoint3>* g_quantized_point3_buffer_cache = &quantized_point3_buffer_cache;
+
+	void PrintBufferCacheStatistics() {
+		size_t count = 0, stored = 0, external = 0, shared = 0;
+		Accumulate(*g_int_buffer_cache, count, stored, external, shared);
+		Accumulate(*g_point3_buffer_cache, count, stored, external, shared);
+		Accumulate(*g_normal3_buffer_cache, count, stored, external, shared);
+		Accumulate(*g_vector3_buffer_cache, count, stored, external, shared);
+		Accumulate(*g_point2_buffer_cache, count, stored, external, shared);
+		Accumulate(*g_octahedral_vector_buffer_cache, count, stored, external, shared);
+		Accumulate(*g_quantized_point2_buffer_cache, count, stored, external, shared);
+		Accumulate(*g_quantized_point3_buffer_cache, count, stored, external, shared);
+		if (count == 0) return;
+
+		constexpr double MB = 1024.0 * 1024.0;
+		std::cout << "[INFO] Mesh buffers: " << count << " unique, " << std::fixed << std::setprecision(1)
+			<< stored / MB << " MB stored, " << external / MB << " MB mapped, "
+			<< shared / MB << " MB shared by duplicates." << std::defaultfloat << std::endl;
+	}
+}
@@ -1,66 +1,137 @@
 #pragma once
 #include "hash.h"
+#include "quantized.h"
+#include "spherical_geometry.h"
 #include "vec.h"
-#include <vector>
+#include <atomic>
+#include <cstring>
+#include <memory>
 #include <span>
-#include <mutex>
-#include <shared_mutex>
-#include <unordered_set>
+#include <vector>
 
 namespace Aokana {
-	
+
+	// 按内容去重的只读缓冲区缓存, 用于在多个网格之间共享完全相同的顶点与索引数据.
+	// 每个桶是一个只增不减的无锁链表: 查找只需要 acquire 读取, 插入以 CAS 把新条目放到链表头部,
+	// CAS 失败说明其他线程同时插入了条目, 只需检查新加入的那部分是否已经包含相同的数据.
+	// 条目在缓存的生命周期内从不删除, 因此不存在 ABA 或内存回收的问题
 	template<typename T>
 	class BufferCache {
 	public:
-		struct Buffer {
-			Buffer(const T* ptr, size_t size) : ptr(ptr), size(size) {
-				hash = HashBuffer(ptr, size);
-			}
+		BufferCache() = default;
+		BufferCache(const BufferCache&) = delete;
+		BufferCache& operator=(const BufferCache&) = delete;
 
-			bool operator==(const Buffer& b) const {
-				return size == b.size && hash == b.hash && std::memcmp(ptr, b.ptr, size * sizeof(T)) == 0;
+		~BufferCache() {
+			for (auto& bucket : buckets) {
+				Entry* entry = bucket.load(std::memory_order_acquire);
+				while (entry != nullptr) {
+					Entry* next = entry->next;
+					delete entry;
+					entry = next;
+				}
 			}
+		}
 
-			const T* ptr{ nullptr };
-			size_t size{ 0 };
-			size_t hash;
-		};
-		
-		struct BufferHasher {
-			size_t operator()(const Buffer& b) const {
-				return b.hash;
+		static uint64_t Hash(std::span<const T> buf) {
+			return HashBuffer(buf.data(), buf.size_bytes());
+		}
+
+		// 如果 cache 中已经存在和 buf 中相同的数据, 就直接返回指向数据的指针, 否则拷贝一份加入 cache
+		const T* LookupOrAdd(std::span<const T> buf) {
+			return Insert(buf, Hash(buf), [&] {
+				auto copy = std::make_shared<std::vector<T>>(buf.begin(), buf.end());
+				return std::pair<const T*, std::shared_ptr<const void>>(copy->data(), std::move(copy));
+			});
+		}
+
+		// 同上, 但数据不存在时直接接管 buf 而不拷贝
+		const T* LookupOrAdd(std::vector<T>&& buf) {
+			std::span<const T> view(buf);
+			return Insert(view, Hash(view), [&] {
+				auto owned = std::make_shared<std::vector<T>>(std::move(buf));
+				return std::pair<const T*, std::shared_ptr<const void>>(owned->data(), std::move(owned));
+			});
+		}
+
+		// 同上, 但数据不存在时直接引用 buf 本身, owner 保证 buf 一直有效 (例如内存映射的文件);
+		// hash 必须等于 Hash(buf). 预先算好的哈希值使得未命中时不必读取 buf 的内容; 哈希值相同时仍会逐字节比较整个 buf
+		const T* LookupOrAdd(std::span<const T> buf, uint64_t hash, std::shared_ptr<const void> owner) {
+			return Insert(buf, hash, [&] {
+				return std::pair<const T*, std::shared_ptr<const void>>(buf.data(), std::move(owner));
+			}, true);
+		}
+
+		size_t BufferCount() const { return buffer_count.load(std::memory_order_relaxed); }
+		size_t BytesStored() const { return bytes_stored.load(std::memory_order_relaxed); }		// 缓存自己保存的数据
+		size_t BytesExternal() const { return bytes_external.load(std::memory_order_relaxed); }	// 引用的外部数据
+		size_t BytesShared() const { return bytes_shared.load(std::memory_order_relaxed); }		// 因为去重而没有重复保存的数据
+
+	private:
+		struct Entry {
+			const T* ptr;
+			size_t size;
+			uint64_t hash;
+			std::shared_ptr<const void> owner;
+			Entry* next;
+
+			bool Matches(std::span<const T> buf, uint64_t h) const {
+				return hash == h && size == buf.size() && std::memcmp(ptr, buf.data(), buf.size_bytes()) == 0;
 			}
 		};
 
-		const T* LookupOrAdd(std::span<const T> buf) {
-			//  cache Ѿں buf ͬ, ֱӷָݵָ
-			Buffer lookup_buffer(buf.data, buf.size());
-			int shard_index = uint32_t(lookup_buffer.hash) >> (32 - log_shards);
-			mutex[shard_index].lock_shared();
-			if (auto iter = cache[shard_index].find(lookup_buffer); iter != cache[shard_index].end()) {
-				const T* ptr = iter->ptr;
-				mutex[shard_index].unlock_shared();
-				return ptr;
+		// 在 [first, last) 中查找与 buf 相同的条目
+		static const Entry* Find(const Entry* first, const Entry* last, std::span<const T> buf, uint64_t hash) {
+			for (const Entry* entry = first; entry != last; entry = entry->next) {
+				if (entry->Matches(buf, hash)) return entry;
 			}
-			//  buf ݼ cache, Ȼ󷵻 cache еָ
-			mutex[shard_index].unlock_shared();
-			T* ptr = new T[buf.size()];
-			std::copy(buf.begin(), buf.end(), ptr);
-			mutex[shard_index].lock();
-			cache[shard_index].insert(Buffer(ptr, buf.size()));
-			mutex[shard_index].unlock();
-			return ptr;
+			return nullptr;
 		}
 
+		template <typename F>
+		const T* Insert(std::span<const T> buf, uint64_t hash, F&& make_storage, bool external = false) {
+			if (buf.empty()) return nullptr;
+			std::atomic<Entry*>& bucket = buckets[hash & (n_buckets - 1)];
+			Entry* head = bucket.load(std::memory_order_acquire);
+			if (const Entry* found = Find(head, nullptr, buf, hash)) {
+				bytes_shared.fetch_add(buf.size_bytes(), std::memory_order_relaxed);
+				return found->ptr;
+			}
 
-	private:
-		static constexpr int log_shards = 6;
-		static constexpr int n_shards = 1 << log_shards;	// cache Ϊ 2^6 = 64  shard
-		std::shared_mutex mutex[n_shards];					// ÿ shard Լ mutex, ߳̿Բ
-		std::unordered_set<Buffer, BufferHasher> cache[n_shards];
+			auto [ptr, owner] = make_storage();
+			Entry* entry = new Entry{ ptr, buf.size(), hash, std::move(owner), head };
+			// release: 其他线程通过链表看到条目时, 条目与其中的数据都已经写好
+			while (!bucket.compare_exchange_weak(entry->next, entry, std::memory_order_release, std::memory_order_acquire)) {
+				if (const Entry* found = Find(entry->next, head, buf, hash)) {
+					delete entry;
+					bytes_shared.fetch_add(buf.size_bytes(), std::memory_order_relaxed);
+					return found->ptr;
+				}
+				head = entry->next;
+			}
+			buffer_count.fetch_add(1, std::memory_order_relaxed);
+			(external ? bytes_external : bytes_stored).fetch_add(buf.size_bytes(), std::memory_order_relaxed);
+			return entry->ptr;
+		}
+
+		static constexpr size_t n_buckets = 1 << 12;
+		std::atomic<Entry*> buckets[n_buckets] = {};
+		std::atomic<size_t> buffer_count{ 0 };
+		std::atomic<size_t> bytes_stored{ 0 };
+		std::atomic<size_t> bytes_external{ 0 };
+		std::atomic<size_t> bytes_shared{ 0 };
 	};
 
 
 	extern BufferCache<int>* g_int_buffer_cache;
 	extern BufferCache<Point3>* g_point3_buffer_cache;
-}
\ No newline at end of file
+	extern BufferCache<Normal3>* g_normal3_buffer_cache;
+	extern BufferCache<Vector3>* g_vector3_buffer_cache;
+	extern BufferCache<Point2>* g_point2_buffer_cache;
+	extern BufferCache<SphericalGeometry::OctahedralVector>* g_octahedral_vector_buffer_cache;
+	extern BufferCache<QuantizedPoint2>* g_quantized_point2_buffer_cache;
+	extern BufferCache<QuantizedPoint3>* g_quantized_point3_buffer_cache;
+
+	// 输出所有缓存的内存统计, 缓存为空时不输出
+	void PrintBufferCacheStatistics();
+}
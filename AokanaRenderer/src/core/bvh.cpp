@@ -49,6 +49,14 @@ namespace Aokana {
         throw std::runtime_error("Can not invoke \"GetMaterial()\" from \"BVHNode\" object.");
     }
 
+    void BVHNode::Refit(double time0, double time1) {
+        if (auto* node = dynamic_cast<BVHNode*>(left.get())) node->Refit(time0, time1);
+        if (right != left) {
+            if (auto* node = dynamic_cast<BVHNode*>(right.get())) node->Refit(time0, time1);
+        }
+        box = Bounds3::Merge(left->WorldBound(time0, time1), right->WorldBound(time0, time1));
+    }
+
     BVHNode::BVHNode(const std::vector<std::shared_ptr<Primitive>>& src_objects,
         size_t start, size_t end, double time0, double time1) {
 
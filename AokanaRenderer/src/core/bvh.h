@@ -20,6 +20,8 @@ namespace Aokana {
         // virtual bool bounding_box(double time0, double time1, Bounds3& output_box) const override;
         virtual Bounds3 WorldBound(double time0 = 0, double time1 = 0) const override;
         virtual const Material* GetMaterial() const override;
+        // 图元移动后自底向上重新计算所有节点的包围盒, 树的结构不变; 代价与节点数成正比, 远低于重新构建
+        void Refit(double time0, double time1);
 
 
     public:
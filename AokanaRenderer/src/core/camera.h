@@ -8,9 +8,18 @@
 #include "utils.h"
 #include "film.h"
 #include "sampler.h"
+#include "sampling.h"
 
 namespace Aokana {
 
+    struct CameraSample {
+        Point2 film_point; // 光线所对应的胶片上的点 (归一化到 [0, 1]^2 的 uv 坐标)
+        Point2 pixel_point; // 同一个点的连续像素坐标, 像素 (x, y) 覆盖 [x, x + 1) x [y, y + 1), 用于重建滤波
+        Point2 lens_point; // 光线所对应的镜头上的点 ([0, 1)^2 上的样本, 由相机映射到光圈上)
+        double time{ 0 };  // 采样的时刻 ([0, 1) 上的样本, 由相机映射到快门区间上)
+        double filter_weight{ 1 };
+    };
+
     class Camera {
     public:
         std::shared_ptr<Film> film;
@@ -57,7 +66,8 @@ namespace Aokana {
             time0 = _time0;
             time1 = _time1;
 
-            film = std::make_shared<Film>(800, 800.0 / aspect_ratio);
+            // 动画中每帧更新相机参数时沿用已有的胶片及其设置
+            if (film == nullptr) film = std::make_shared<Film>(800, 800.0 / aspect_ratio);
         }
 
 
@@ -65,16 +75,18 @@ namespace Aokana {
             film->SaveImage(path);
         }
 
-        Ray GetRay(const Sample& sample) const {
-            Vector3 rd = lens_radius * Vector3::RandomInUnitDisk();
+        Ray GetRay(const CameraSample& sample) const {
+            Point2 rd = lens_radius * SampleUniformDiskConcentric(sample.lens_point);
             Vector3 offset = u * rd.x + v * rd.y;
             return Ray(
                 origin + offset,
-                lower_left_corner + sample.u * horizontal + sample.v * vertical - Vector3(origin) - offset,
-                RandomDoubleInRange(time0, time1));
+                lower_left_corner + sample.film_point.u() * horizontal + sample.film_point.v() * vertical - Vector3(origin) - offset,
+                Lerp(sample.time, time0, time1));
         }
 
         Point3 Position() const { return origin; }
+        double ShutterOpen() const { return time0; }
+        double ShutterClose() const { return time1; }
     private:
         Point3 origin;
         Vector3 horizontal;
@@ -88,6 +100,19 @@ namespace Aokana {
     Camera CreateDefaultCamera();
     Camera CreateCoffeeMakerSceneCamera();
 
+    // 从采样器中取出生成相机光线所需的全部维度: 像素内偏移, 快门时刻, 镜头位置
+    inline CameraSample GetCameraSample(Sampler& sampler, int x, int y, const Film& film) {
+        CameraSample camera_sample;
+        Point2 pixel_offset = sampler.GetPixel2D();
+        camera_sample.pixel_point = Point2(x + pixel_offset.x, y + pixel_offset.y);
+        camera_sample.film_point = Point2(
+            (film.crop_u + x + pixel_offset.x) / static_cast<double>(film.full_width - 1),
+            (film.crop_v + y + pixel_offset.y) / static_cast<double>(film.full_height - 1));
+        camera_sample.time = sampler.Get1D();
+        camera_sample.lens_point = sampler.Get2D();
+        return camera_sample;
+    }
+
 
     class CameraRay {
     public:
@@ -96,13 +121,6 @@ namespace Aokana {
         // TODO
     };
 
-    struct CameraSample {
-        Point2 film_point; // 光线所对应的胶片上的点
-        Point2 lens_point; // 光线所对应的镜头上的点
-        double time{ 0 };  // 采样的时刻
-        double filter_weight{ 1 };
-    };
-
     class CameraV2 {
     public:
         std::optional<CameraRay> GenerateRay(CameraSample sample, SampledSpectrum& lambda) const;
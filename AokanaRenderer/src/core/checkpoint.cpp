@@ -0,0 +1,206 @@
+#include "checkpoint.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <type_traits>
+
+namespace Aokana {
+
+    namespace {
+
+        constexpr char CHECKPOINT_MAGIC[4] = { 'A', 'O', 'K', 'C' };
+        constexpr uint32_t CHECKPOINT_VERSION = 2;
+
+        struct CheckpointHeader {
+            char magic[4];
+            uint32_t version;
+            int32_t image_width, image_height;
+            int32_t samples_per_pixel;
+            int32_t rendered_spp;
+            int32_t pass_spp;
+            uint32_t tile_count;
+            uint32_t pixel_size;
+            char sampler[16];
+            uint64_t sampler_seed;
+            int32_t adaptive_sampling;
+            int32_t adaptive_min_spp, adaptive_max_spp;
+            double adaptive_threshold;
+            uint32_t aov_flags;
+        };
+
+        static_assert(std::is_trivially_copyable_v<FilmPixel>, "FilmPixel is written to the checkpoint as raw bytes.");
+    }
+
+    RenderCheckpoint::RenderCheckpoint(const Film& film, CheckpointSettings settings, std::string path, double interval_seconds) :
+        path(std::move(path)),
+        interval_seconds(interval_seconds),
+        image_width(film.image_width),
+        image_height(film.image_height),
+        settings(std::move(settings)),
+        aov_flags(film.aovs ? film.aovs->flags : AOV_NONE),
+        tile_count(film.tiles.size()),
+        tile_granular(film.filter_padding == 0),
+        completed(std::make_unique<std::atomic<uint8_t>[]>(film.tiles.size())),
+        synced(film.tiles.size()),
+        last_save(std::chrono::steady_clock::now()) {
+        for (size_t i = 0; i < tile_count; ++i) completed[i].store(0);
+    }
+
+    bool RenderCheckpoint::Resume(Film& film) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file) return false;
+
+        CheckpointHeader header = {};
+        file.read(reinterpret_cast<char*>(&header), sizeof(header));
+        if (!file || std::memcmp(header.magic, CHECKPOINT_MAGIC, 4) != 0 || header.version != CHECKPOINT_VERSION) {
+            std::cerr << "[ERROR] \"" << path << "\" is not a valid checkpoint." << std::endl;
+            return false;
+        }
+        if (header.image_width != image_width || header.image_height != image_height ||
+            header.samples_per_pixel != settings.samples_per_pixel || header.tile_count != tile_count ||
+            header.pixel_size != sizeof(FilmPixel)) {
+            std::cerr << "[ERROR] Checkpoint \"" << path << "\" does not match the current render settings." << std::endl;
+            return false;
+        }
+        header.sampler[sizeof(header.sampler) - 1] = '\0';
+        if (settings.sampler != header.sampler || settings.sampler_seed != header.sampler_seed) {
+            std::cerr << "[ERROR] Checkpoint \"" << path << "\" was rendered with sampler \"" << header.sampler << "\" (seed "
+                << header.sampler_seed << "), but the current sampler is \"" << settings.sampler << "\" (seed " << settings.sampler_seed << ")." << std::endl;
+            return false;
+        }
+        if ((header.adaptive_sampling != 0) != settings.adaptive_sampling || (settings.adaptive_sampling &&
+            (header.adaptive_threshold != settings.adaptive_threshold || header.adaptive_min_spp != settings.adaptive_min_spp ||
+             header.adaptive_max_spp != settings.adaptive_max_spp))) {
+            std::cerr << "[ERROR] Checkpoint \"" << path << "\" was rendered with different adaptive sampling settings." << std::endl;
+            return false;
+        }
+        if (header.aov_flags != aov_flags) {
+            std::cerr << "[ERROR] Checkpoint \"" << path << "\" was rendered with different AOVs." << std::endl;
+            return false;
+        }
+
+        std::vector<uint8_t> tile_flags(tile_count);
+        std::vector<FilmPixel> pixels(static_cast<size_t>(image_width) * image_height);
+        file.read(reinterpret_cast<char*>(tile_flags.data()), tile_flags.size());
+        file.read(reinterpret_cast<char*>(pixels.data()), pixels.size() * sizeof(FilmPixel));
+        std::unique_ptr<AOVBuffers> aovs;
+        if (aov_flags != AOV_NONE) {
+            aovs = std::make_unique<AOVBuffers>(image_width, image_height, aov_flags);
+            aovs->Read(file);
+        }
+        if (!file) {
+            std::cerr << "[ERROR] Checkpoint \"" << path << "\" is truncated." << std::endl;
+            return false;
+        }
+
+        rendered_spp = header.rendered_spp;
+        pass_spp = header.pass_spp;
+        for (size_t i = 0; i < tile_count; ++i) completed[i].store(tile_flags[i]);
+        synced = tile_flags;
+        film.pixels = pixels;
+        snapshot = std::move(pixels);
+        if (aovs) {
+            film.aovs->CopyRect(*aovs, 0, 0, image_width - 1, image_height - 1);
+            aov_snapshot = std::move(aovs);
+        }
+        for (int v = 0; v < film.image_height; ++v) {
+            for (int u = 0; u < film.image_width; ++u) film.ResolvePixel(u, v);
+        }
+
+        size_t completed_count = std::count(tile_flags.begin(), tile_flags.end(), 1);
+        std::cout << "[INFO] Resumed from checkpoint \"" << path << "\": " << rendered_spp << " spp finished, "
+            << completed_count << "/" << tile_count << " tiles of the current pass finished." << std::endl;
+        return true;
+    }
+
+    void RenderCheckpoint::BeginPass(const Film& film, int pass_spp) {
+        this->pass_spp = pass_spp;
+        for (size_t i = 0; i < tile_count; ++i) completed[i].store(0);
+        std::fill(synced.begin(), synced.end(), 0);
+        // 此时没有正在渲染的 tile, 整个胶片都是自洽的
+        if (path.empty()) return;
+        snapshot = film.pixels;
+        if (film.aovs) aov_snapshot = std::make_unique<AOVBuffers>(*film.aovs);
+    }
+
+    void RenderCheckpoint::EndPass() {
+        rendered_spp += pass_spp;
+        pass_spp = 0;
+    }
+
+    void RenderCheckpoint::Update(const Film& film, bool force) {
+        if (path.empty()) return;
+        auto now = std::chrono::steady_clock::now();
+        if (!force && std::chrono::duration<double>(now - last_save).count() < interval_seconds) return;
+
+        // 只复制已完成且尚未复制的 tile, 它们不会再被渲染线程修改
+        for (size_t i = 0; i < tile_count && tile_granular; ++i) {
+            if (synced[i] || !IsTileCompleted(static_cast<int>(i))) continue;
+            const FilmTile& tile = film.tiles[i];
+            for (int v = static_cast<int>(tile.v_min); v <= tile.v_max; ++v) {
+                for (int u = static_cast<int>(tile.u_min); u <= tile.u_max; ++u) {
+                    snapshot[v * image_width + u] = film.GetPixel(u, v);
+                }
+            }
+            if (aov_snapshot) aov_snapshot->CopyRect(*film.aovs, static_cast<int>(tile.u_min), static_cast<int>(tile.v_min),
+                static_cast<int>(tile.u_max), static_cast<int>(tile.v_max));
+            synced[i] = 1;
+        }
+
+        Write();
+        last_save = now;
+    }
+
+    void RenderCheckpoint::Write() const {
+        // 先写入临时文件再重命名, 写入过程中被中断也不会破坏上一个检查点
+        std::string temp_path = path + ".tmp";
+        {
+            std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+            if (!file) {
+                std::cerr << "[ERROR] Failed to write checkpoint \"" << temp_path << "\"." << std::endl;
+                return;
+            }
+
+            CheckpointHeader header = {};
+            std::memcpy(header.magic, CHECKPOINT_MAGIC, 4);
+            header.version = CHECKPOINT_VERSION;
+            header.image_width = image_width;
+            header.image_height = image_height;
+            header.samples_per_pixel = settings.samples_per_pixel;
+            header.rendered_spp = rendered_spp;
+            header.pass_spp = pass_spp;
+            header.tile_count = static_cast<uint32_t>(tile_count);
+            header.pixel_size = sizeof(FilmPixel);
+            std::strncpy(header.sampler, settings.sampler.c_str(), sizeof(header.sampler) - 1);
+            header.sampler_seed = settings.sampler_seed;
+            header.adaptive_sampling = settings.adaptive_sampling;
+            header.adaptive_threshold = settings.adaptive_threshold;
+            header.adaptive_min_spp = settings.adaptive_min_spp;
+            header.adaptive_max_spp = settings.adaptive_max_spp;
+            header.aov_flags = aov_flags;
+
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            file.write(reinterpret_cast<const char*>(synced.data()), synced.size());
+            file.write(reinterpret_cast<const char*>(snapshot.data()), snapshot.size() * sizeof(FilmPixel));
+            if (aov_snapshot) aov_snapshot->Write(file);
+        }
+
+        std::error_code error;
+        std::filesystem::rename(temp_path, path, error);
+        if (error) {
+            std::cerr << "[ERROR] Failed to write checkpoint \"" << path << "\": " << error.message() << std::endl;
+            return;
+        }
+        std::cout << "[INFO] Checkpoint saved to \"" << path << "\"." << std::endl;
+    }
+
+    void RenderCheckpoint::Remove() const {
+        if (path.empty()) return;
+        std::error_code error;
+        std::filesystem::remove(path, error);
+    }
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "film.h"
+
+namespace Aokana {
+
+    // 影响像素累积量的渲染设置, 写入检查点; 恢复时任何一项不同都会拒绝恢复
+    struct CheckpointSettings {
+        int samples_per_pixel = 0;
+        std::string sampler;            // Sampler::Name()
+        uint64_t sampler_seed = 0;
+        bool adaptive_sampling = false;
+        double adaptive_threshold = 0;
+        int adaptive_min_spp = 0, adaptive_max_spp = 0;
+    };
+
+    // 渲染检查点
+    // 渲染按遍进行, 检查点记录已完成的遍的累计样本数, 当前遍的样本数, 当前遍中已完成的 tile 以及每个像素的累积量.
+    // 检查点中的像素数据总是自洽的: 当前遍已完成的 tile 保存结束时的状态, 其余 tile 保存这一遍开始时的状态,
+    // 因此恢复后只需重新渲染未完成的 tile. 采样器的位置由像素中的样本数决定, 恢复后的结果与不中断的渲染完全一致
+    // 启用 AOV 时 AOV 的累积量与像素一起保存
+    // 重建滤波器跨越像素时 tile 的样本会累加到相邻 tile 的像素中, 这时检查点只保存每一遍开始时的状态, 恢复后重新渲染整遍
+    class RenderCheckpoint {
+    public:
+        // path 为空时不写文件, 只记录 tile 的完成情况
+        RenderCheckpoint(const Film& film, CheckpointSettings settings, std::string path, double interval_seconds);
+
+        // 从文件恢复渲染状态, 成功时 film 中的像素与 AOV 被替换为检查点中的数据
+        bool Resume(Film& film);
+
+        // 开始新的一遍, 清除 tile 的完成标记
+        void BeginPass(const Film& film, int pass_spp);
+        // 当前遍结束, 把样本数计入 rendered_spp
+        void EndPass();
+        // 由渲染线程在 tile 完成后调用
+        void MarkTileCompleted(int tile_index) { completed[tile_index].store(1, std::memory_order_release); }
+        bool IsTileCompleted(int tile_index) const { return completed[tile_index].load(std::memory_order_acquire) != 0; }
+
+        // 距离上次保存超过 interval_seconds 时写入检查点; force 为 true 时总是写入
+        void Update(const Film& film, bool force = false);
+        // 渲染完成后删除检查点文件
+        void Remove() const;
+
+        int rendered_spp = 0;   // 已完成的遍的累计样本数
+        int pass_spp = 0;       // 当前遍每个像素的样本数
+
+    private:
+        void Write() const;
+
+        std::string path;
+        double interval_seconds;
+        int image_width, image_height;
+        CheckpointSettings settings;
+        uint32_t aov_flags;
+        size_t tile_count;
+        bool tile_granular;     // 是否可以按 tile 保存当前遍的进度
+
+        std::unique_ptr<std::atomic<uint8_t>[]> completed;
+        std::vector<uint8_t> synced;        // 已复制到 snapshot 中的 tile
+        std::vector<FilmPixel> snapshot;    // 将要写入文件的像素数据
+        std::unique_ptr<AOVBuffers> aov_snapshot;   // 将要写入文件的 AOV, 没有启用 AOV 时为空
+        std::chrono::steady_clock::time_point last_save;
+    };
+}
@@ -0,0 +1,472 @@
+#include "compressed_bvh.h"
+#include "bvh.h"
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <numeric>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define AOKANA_COMPRESSED_BVH_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace Aokana {
+
+    namespace {
+
+        static_assert(sizeof(CompressedBVHNode) == 80, "CompressedBVHNode must not contain padding.");
+
+        constexpr int WIDTH = 8;
+        constexpr uint32_t MAX_LEAF_PRIMITIVES = 3;     // 8 个叶子最多 24 个图元, meta 的低 5 位足以表示偏移
+        constexpr int SAH_BINS = 16;
+        constexpr double SAH_TRAVERSAL_COST = 0.125;    // 相对于一次图元求交的代价
+        constexpr int MAX_SAH_DEPTH = 48;               // 更深的节点按数量对半划分, 树的深度不超过 48 + 32
+        constexpr int STACK_SIZE = 1024;                // 每层最多压入 7 个节点, 足够容纳上述深度
+        // 量化前包围盒各轴向外扩展节点尺寸的 2^-16, 覆盖遍历时以单精度计算平面位置的舍入误差
+        constexpr double QUANTIZE_PADDING = 1.0 / 65536;
+        // 单精度计算的离开距离再放大这一比例, 覆盖光线原点较远时的相对误差
+        constexpr float T_FAR_SCALE = 1 + 8 * std::numeric_limits<float>::epsilon();
+
+        // 2^exponent, exponent 在 [-126, 127] 内时是规格化的单精度数
+        float ExponentScale(int8_t exponent) {
+            const uint32_t bits = static_cast<uint32_t>(exponent + 127) << 23;
+            float scale;
+            std::memcpy(&scale, &bits, sizeof(scale));
+            return scale;
+        }
+
+        // 量化 count 个子节点的包围盒, 其余子节点标记为空, 返回所有子节点的包围盒
+        Bounds3 QuantizeChildren(CompressedBVHNode& node, const Bounds3* child_boxes, int count) {
+            Bounds3 box;
+            for (int i = 0; i < count; ++i) box = Bounds3::Merge(box, child_boxes[i]);
+
+            for (int a = 0; a < 3; ++a) {
+                const double padding = (box.p_max[a] - box.p_min[a]) * QUANTIZE_PADDING;
+                const double lower = box.p_min[a] - padding;
+                float origin = static_cast<float>(lower);
+                if (origin > lower) origin = std::nextafter(origin, -std::numeric_limits<float>::infinity());
+                // 取最小的 2 的幂使得 255 个格子覆盖整个节点
+                const double extent = box.p_max[a] + padding - origin;
+                int exponent = extent > 0 ? std::ilogb(extent / 255) : -126;
+                while (std::ldexp(255.0, exponent) < extent) ++exponent;
+                exponent = std::clamp(exponent, -126, 127);
+                const double scale = std::ldexp(1.0, exponent);
+
+                node.origin[a] = origin;
+                node.exponent[a] = static_cast<int8_t>(exponent);
+                for (int i = 0; i < WIDTH; ++i) {
+                    if (i < count) {
+                        const double lo = std::floor((child_boxes[i].p_min[a] - padding - origin) / scale);
+                        const double hi = std::ceil((child_boxes[i].p_max[a] + padding - origin) / scale);
+                        node.q_min[a][i] = static_cast<uint8_t>(std::clamp(lo, 0.0, 255.0));
+                        node.q_max[a][i] = static_cast<uint8_t>(std::clamp(hi, 0.0, 255.0));
+                    }
+                    else {
+                        node.q_min[a][i] = 255;
+                        node.q_max[a][i] = 0;
+                    }
+                }
+            }
+            return box;
+        }
+
+        // 用分桶 SAH 构建的二叉树, 只在构建期间使用
+        class BinaryBVHBuilder {
+        public:
+            struct Node {
+                Bounds3 box;
+                int children[2] = { -1, -1 };
+                uint32_t first = 0, count = 0;      // 叶子的图元在 order 中的范围
+                bool IsLeaf() const { return children[0] < 0; }
+            };
+
+            explicit BinaryBVHBuilder(const std::vector<Bounds3>& bounds) : bounds(bounds) {
+                centroids.reserve(bounds.size());
+                for (const Bounds3& b : bounds) {
+                    centroids.push_back(Point3((b.p_min.x + b.p_max.x) / 2, (b.p_min.y + b.p_max.y) / 2, (b.p_min.z + b.p_max.z) / 2));
+                }
+                order.resize(bounds.size());
+                std::iota(order.begin(), order.end(), 0u);
+                nodes.reserve(bounds.size() * 2);
+                Build(0, static_cast<uint32_t>(bounds.size()), 0);
+            }
+
+            std::vector<Node> nodes;        // 根节点为第 0 个
+            std::vector<uint32_t> order;
+
+        private:
+            int Build(uint32_t first, uint32_t count, int depth) {
+                Bounds3 box, centroid_box;
+                for (uint32_t i = first; i < first + count; ++i) {
+                    box = Bounds3::Merge(box, bounds[order[i]]);
+                    centroid_box = Bounds3::Merge(centroid_box, centroids[order[i]]);
+                }
+                const int index = static_cast<int>(nodes.size());
+                nodes.emplace_back();
+                nodes[index].box = box;
+                nodes[index].first = first;
+                nodes[index].count = count;
+                if (count == 1) return index;
+
+                const int axis = centroid_box.MaximumExtent();
+                const double c_min = centroid_box.p_min[axis];
+                const double c_extent = centroid_box.p_max[axis] - c_min;
+                uint32_t* begin = order.data() + first;
+                uint32_t* end = begin + count;
+                uint32_t* mid = begin + count / 2;
+
+                if (c_extent > 0 && depth < MAX_SAH_DEPTH) {
+                    auto bin_of = [&](uint32_t primitive) {
+                        return std::min(SAH_BINS - 1, static_cast<int>(SAH_BINS * ((centroids[primitive][axis] - c_min) / c_extent)));
+                    };
+                    uint32_t bin_count[SAH_BINS] = {};
+                    Bounds3 bin_box[SAH_BINS];
+                    for (uint32_t* p = begin; p != end; ++p) {
+                        const int b = bin_of(*p);
+                        ++bin_count[b];
+                        bin_box[b] = Bounds3::Merge(bin_box[b], bounds[*p]);
+                    }
+                    // 从右向左累积, right_cost[b] 为桶 [b, SAH_BINS) 的面积乘以图元数
+                    double right_cost[SAH_BINS] = {};
+                    Bounds3 right_box;
+                    uint32_t right_count = 0;
+                    for (int b = SAH_BINS - 1; b > 0; --b) {
+                        right_box = Bounds3::Merge(right_box, bin_box[b]);
+                        right_count += bin_count[b];
+                        right_cost[b] = right_count > 0 ? right_box.SurfaceArea() * right_count : 0;
+                    }
+                    int best_split = 1;
+                    double best_cost = std::numeric_limits<double>::max();
+                    Bounds3 left_box;
+                    uint32_t left_count = 0;
+                    for (int b = 1; b < SAH_BINS; ++b) {
+                        left_box = Bounds3::Merge(left_box, bin_box[b - 1]);
+                        left_count += bin_count[b - 1];
+                        const double cost = (left_count > 0 ? left_box.SurfaceArea() * left_count : 0) + right_cost[b];
+                        if (cost < best_cost) {
+                            best_cost = cost;
+                            best_split = b;
+                        }
+                    }
+                    const double area = box.SurfaceArea();
+                    best_cost = SAH_TRAVERSAL_COST + (area > 0 ? best_cost / area : count);
+                    if (count <= MAX_LEAF_PRIMITIVES && best_cost >= count) return index;
+                    // 质心最小与最大的图元落在第一个与最后一个桶, 两侧都不为空
+                    mid = std::partition(begin, end, [&](uint32_t primitive) { return bin_of(primitive) < best_split; });
+                }
+                else {
+                    if (count <= MAX_LEAF_PRIMITIVES) return index;
+                    std::nth_element(begin, mid, end, [&](uint32_t a, uint32_t b) { return centroids[a][axis] < centroids[b][axis]; });
+                }
+
+                const uint32_t left_count = static_cast<uint32_t>(mid - begin);
+                const int left = Build(first, left_count, depth + 1);
+                const int right = Build(first + left_count, count - left_count, depth + 1);
+                nodes[index].children[0] = left;
+                nodes[index].children[1] = right;
+                return index;
+            }
+
+            const std::vector<Bounds3>& bounds;
+            std::vector<Point3> centroids;
+        };
+
+        // 把二叉树折叠成 8 叉树: 反复展开面积最大的内部子节点, 直到子节点数达到 8 或者全部是叶子
+        class WideBVHBuilder {
+        public:
+            WideBVHBuilder(const BinaryBVHBuilder& tree, const std::vector<std::shared_ptr<Primitive>>& input,
+                std::vector<CompressedBVHNode>& nodes, std::vector<std::shared_ptr<Primitive>>& ordered) :
+                tree(tree), input(input), nodes(nodes), ordered(ordered) {}
+
+            void Build() {
+                nodes.emplace_back();
+                Emit(0, 0);
+            }
+
+        private:
+            void Emit(uint32_t wide_index, int binary_index) {
+                const auto& binary = tree.nodes;
+                int children[WIDTH];
+                int count = 0;
+                if (binary[binary_index].IsLeaf()) children[count++] = binary_index;
+                else {
+                    children[count++] = binary[binary_index].children[0];
+                    children[count++] = binary[binary_index].children[1];
+                }
+                while (count < WIDTH) {
+                    int largest = -1;
+                    double largest_area = -1;
+                    for (int i = 0; i < count; ++i) {
+                        const auto& child = binary[children[i]];
+                        if (!child.IsLeaf() && child.box.SurfaceArea() > largest_area) {
+                            largest = i;
+                            largest_area = child.box.SurfaceArea();
+                        }
+                    }
+                    if (largest < 0) break;
+                    const int expanded = children[largest];
+                    children[largest] = binary[expanded].children[0];
+                    children[count++] = binary[expanded].children[1];
+                }
+
+                CompressedBVHNode node = {};
+                node.child_base = static_cast<uint32_t>(nodes.size());
+                node.primitive_base = static_cast<uint32_t>(ordered.size());
+                Bounds3 child_boxes[WIDTH];
+                uint8_t internal_count = 0;
+                for (int i = 0; i < count; ++i) {
+                    const auto& child = binary[children[i]];
+                    child_boxes[i] = child.box;
+                    if (!child.IsLeaf()) {
+                        node.internal_mask |= 1 << i;
+                        node.meta[i] = internal_count++;
+                        continue;
+                    }
+                    node.meta[i] = static_cast<uint8_t>(child.count << 5 | (ordered.size() - node.primitive_base));
+                    for (uint32_t k = child.first; k < child.first + child.count; ++k) {
+                        ordered.push_back(input[tree.order[k]]);
+                    }
+                }
+                QuantizeChildren(node, child_boxes, count);
+                nodes[wide_index] = node;
+
+                // 内部子节点连续分配, 之后再逐个展开
+                nodes.resize(nodes.size() + internal_count);
+                for (int i = 0; i < count; ++i) {
+                    if (node.internal_mask >> i & 1) Emit(node.child_base + node.meta[i], children[i]);
+                }
+            }
+
+            const BinaryBVHBuilder& tree;
+            const std::vector<std::shared_ptr<Primitive>>& input;
+            std::vector<CompressedBVHNode>& nodes;
+            std::vector<std::shared_ptr<Primitive>>& ordered;
+        };
+
+        // 超出 float 范围的有限 double 转换为 float 是未定义行为 (例如 t_max 为 INF = DBL_MAX), 先限制到 float 的范围;
+        // 无穷大与 NaN 可以直接转换, 保持不变
+        float ToFloat(double x) {
+            constexpr double limit = std::numeric_limits<float>::max();
+            return static_cast<float>(std::isinf(x) ? x : std::clamp(x, -limit, limit));
+        }
+
+        struct TraversalRay {
+            explicit TraversalRay(const Ray& ray) {
+                for (int a = 0; a < 3; ++a) {
+                    origin[a] = ray.origin[a];
+                    inv_direction[a] = ToFloat(1.0 / ray.direction[a]);
+                    negative[a] = std::signbit(ray.direction[a]);
+                }
+            }
+
+            double origin[3];
+            float inv_direction[3];
+            bool negative[3];       // 方向为负的轴上先进入上界平面
+        };
+
+        // 解码节点的全部子节点包围盒并与光线求交, 返回被击中的子节点掩码, t_near 为各子节点的进入距离.
+        // 平面位置相对于光线原点计算, 以免较远的原点使单精度的结果失去精度.
+        // 方向分量为 0 时平面距离可能是 0 * inf = NaN, 取最大最小值时忽略 NaN, 这一轴上的判断只会偏保守
+#if defined(AOKANA_COMPRESSED_BVH_SSE2)
+        inline __m128 LoadUnorm8x4(const uint8_t* q) {
+            int32_t bits;
+            std::memcpy(&bits, q, sizeof(bits));
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i bytes = _mm_cvtsi32_si128(bits);
+            return _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(bytes, zero), zero));
+        }
+
+        uint32_t IntersectChildren(const CompressedBVHNode& node, const TraversalRay& ray, float t_min, float t_max, float t_near[WIDTH]) {
+            __m128 near[2] = { _mm_set1_ps(t_min), _mm_set1_ps(t_min) };
+            __m128 far[2] = { _mm_set1_ps(t_max), _mm_set1_ps(t_max) };
+            for (int a = 0; a < 3; ++a) {
+                const __m128 origin = _mm_set1_ps(static_cast<float>(node.origin[a] - ray.origin[a]));
+                const __m128 scale = _mm_set1_ps(ExponentScale(node.exponent[a]));
+                const __m128 inv_direction = _mm_set1_ps(ray.inv_direction[a]);
+                const uint8_t* q_near = ray.negative[a] ? node.q_max[a] : node.q_min[a];
+                const uint8_t* q_far = ray.negative[a] ? node.q_min[a] : node.q_max[a];
+                for (int h = 0; h < 2; ++h) {
+                    const __m128 t0 = _mm_mul_ps(_mm_add_ps(origin, _mm_mul_ps(LoadUnorm8x4(q_near + 4 * h), scale)), inv_direction);
+                    const __m128 t1 = _mm_mul_ps(_mm_add_ps(origin, _mm_mul_ps(LoadUnorm8x4(q_far + 4 * h), scale)), inv_direction);
+                    // 任一操作数为 NaN 时 max / min 返回第二个操作数
+                    near[h] = _mm_max_ps(t0, near[h]);
+                    far[h] = _mm_min_ps(t1, far[h]);
+                }
+            }
+            const __m128 far_scale = _mm_set1_ps(T_FAR_SCALE);
+            uint32_t mask = 0;
+            for (int h = 0; h < 2; ++h) {
+                _mm_storeu_ps(t_near + 4 * h, near[h]);
+                mask |= static_cast<uint32_t>(_mm_movemask_ps(_mm_cmple_ps(near[h], _mm_mul_ps(far[h], far_scale)))) << 4 * h;
+            }
+            return mask;
+        }
+#else
+        uint32_t IntersectChildren(const CompressedBVHNode& node, const TraversalRay& ray, float t_min, float t_max, float t_near[WIDTH]) {
+            float t_far[WIDTH];
+            std::fill(t_near, t_near + WIDTH, t_min);
+            std::fill(t_far, t_far + WIDTH, t_max);
+            for (int a = 0; a < 3; ++a) {
+                const float origin = static_cast<float>(node.origin[a] - ray.origin[a]);
+                const float scale = ExponentScale(node.exponent[a]);
+                const uint8_t* q_near = ray.negative[a] ? node.q_max[a] : node.q_min[a];
+                const uint8_t* q_far = ray.negative[a] ? node.q_min[a] : node.q_max[a];
+                for (int i = 0; i < WIDTH; ++i) {
+                    const float t0 = (origin + q_near[i] * scale) * ray.inv_direction[a];
+                    const float t1 = (origin + q_far[i] * scale) * ray.inv_direction[a];
+                    t_near[i] = t0 > t_near[i] ? t0 : t_near[i];
+                    t_far[i] = t1 < t_far[i] ? t1 : t_far[i];
+                }
+            }
+            uint32_t mask = 0;
+            for (int i = 0; i < WIDTH; ++i) {
+                if (t_near[i] <= t_far[i] * T_FAR_SCALE) mask |= 1u << i;
+            }
+            return mask;
+        }
+#endif
+    }
+
+    CompressedBVH::CompressedBVH(const std::vector<std::shared_ptr<Primitive>>& src_primitives, double time0, double time1) {
+        const auto start_time = std::chrono::steady_clock::now();
+
+        // 展开 BVHNode, 只保留其中的图元
+        std::vector<std::shared_ptr<Primitive>> input;
+        input.reserve(src_primitives.size());
+        std::vector<std::shared_ptr<Primitive>> pending(src_primitives.rbegin(), src_primitives.rend());
+        while (!pending.empty()) {
+            std::shared_ptr<Primitive> primitive = std::move(pending.back());
+            pending.pop_back();
+            if (auto* node = dynamic_cast<BVHNode*>(primitive.get())) {
+                if (node->right != node->left) pending.push_back(node->right);
+                pending.push_back(node->left);
+            }
+            else input.push_back(std::move(primitive));
+        }
+        if (input.empty()) return;
+
+        std::vector<Bounds3> bounds;
+        bounds.reserve(input.size());
+        for (const auto& primitive : input) bounds.push_back(primitive->WorldBound(time0, time1));
+
+        BinaryBVHBuilder tree(bounds);
+        primitives.reserve(input.size());
+        WideBVHBuilder(tree, input, nodes, primitives).Build();
+        box = tree.nodes[0].box;
+        leaf_primitives.reserve(primitives.size());
+        for (const auto& primitive : primitives) leaf_primitives.push_back(primitive.get());
+
+        std::cout << "[INFO] Built compressed BVH over " << primitives.size() << " primitives: " << nodes.size() << " nodes, "
+            << BytesUsed() / 1024 << " KB in "
+            << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count() << " ms." << std::endl;
+    }
+
+    bool CompressedBVH::Intersect(const Ray& ray, double t_min, double t_max) const {
+        if (nodes.empty()) return false;
+        const TraversalRay traversal_ray(ray);
+        const float near_limit = ToFloat(t_min), far_limit = ToFloat(t_max);
+        uint32_t stack[STACK_SIZE];
+        int stack_size = 0;
+        stack[stack_size++] = 0;
+        while (stack_size > 0) {
+            const CompressedBVHNode& node = nodes[stack[--stack_size]];
+            float t_near[WIDTH];
+            const uint32_t mask = IntersectChildren(node, traversal_ray, near_limit, far_limit, t_near);
+            for (uint32_t bits = mask; bits != 0; bits &= bits - 1) {
+                const int i = std::countr_zero(bits);
+                if (node.internal_mask >> i & 1) {
+                    stack[stack_size++] = node.child_base + node.meta[i];
+                    continue;
+                }
+                const Primitive* const* leaf = leaf_primitives.data() + node.primitive_base + (node.meta[i] & 31);
+                for (int k = 0; k < node.meta[i] >> 5; ++k) {
+                    if (leaf[k]->Intersect(ray, t_min, t_max)) return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    bool CompressedBVH::IntersectP(const Ray& ray, SurfaceInteraction& isect, double t_min, double t_max) const {
+        if (nodes.empty()) return false;
+        struct StackEntry {
+            uint32_t node;
+            float t_near;
+        };
+        const TraversalRay traversal_ray(ray);
+        const float near_limit = ToFloat(t_min);
+        StackEntry stack[STACK_SIZE];
+        int stack_size = 0;
+        stack[stack_size++] = { 0, near_limit };
+        bool hit = false;
+        while (stack_size > 0) {
+            const StackEntry entry = stack[--stack_size];
+            if (entry.t_near > t_max) continue;
+            const CompressedBVHNode& node = nodes[entry.node];
+            float t_near[WIDTH];
+            const uint32_t mask = IntersectChildren(node, traversal_ray, near_limit, ToFloat(t_max), t_near);
+
+            // 先测试叶子, 缩短 t_max 后再决定访问哪些内部子节点
+            for (uint32_t leaves = mask & ~node.internal_mask; leaves != 0; leaves &= leaves - 1) {
+                const int i = std::countr_zero(leaves);
+                const Primitive* const* leaf = leaf_primitives.data() + node.primitive_base + (node.meta[i] & 31);
+                for (int k = 0; k < node.meta[i] >> 5; ++k) {
+                    if (leaf[k]->IntersectP(ray, isect, t_min, t_max)) {
+                        hit = true;
+                        t_max = isect.time;
+                    }
+                }
+            }
+            // 内部子节点按进入距离从远到近压栈, 最近的最先出栈
+            const int first_entry = stack_size;
+            for (uint32_t internal = mask & node.internal_mask; internal != 0; internal &= internal - 1) {
+                const int i = std::countr_zero(internal);
+                if (t_near[i] > t_max) continue;
+                const StackEntry child = { node.child_base + node.meta[i], t_near[i] };
+                int j = stack_size++;
+                while (j > first_entry && stack[j - 1].t_near < child.t_near) {
+                    stack[j] = stack[j - 1];
+                    --j;
+                }
+                stack[j] = child;
+            }
+        }
+        return hit;
+    }
+
+    Bounds3 CompressedBVH::WorldBound(double, double) const {
+        return box;
+    }
+
+    const Material* CompressedBVH::GetMaterial() const {
+        throw std::runtime_error("Can not invoke \"GetMaterial()\" from \"CompressedBVH\" object.");
+    }
+
+    void CompressedBVH::Refit(double time0, double time1) {
+        if (!nodes.empty()) box = RefitNode(0, time0, time1);
+    }
+
+    Bounds3 CompressedBVH::RefitNode(uint32_t index, double time0, double time1) {
+        CompressedBVHNode& node = nodes[index];
+        Bounds3 child_boxes[WIDTH];
+        int count = 0;
+        // 子节点总是从第 0 个开始连续存放
+        for (; count < WIDTH; ++count) {
+            if (node.internal_mask >> count & 1) {
+                child_boxes[count] = RefitNode(node.child_base + node.meta[count], time0, time1);
+                continue;
+            }
+            if (node.meta[count] == 0) break;
+            const Primitive* const* leaf = leaf_primitives.data() + node.primitive_base + (node.meta[count] & 31);
+            for (int k = 0; k < node.meta[count] >> 5; ++k) {
+                child_boxes[count] = Bounds3::Merge(child_boxes[count], leaf[k]->WorldBound(time0, time1));
+            }
+        }
+        return QuantizeChildren(node, child_boxes, count);
+    }
+}
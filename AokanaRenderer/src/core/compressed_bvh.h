@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "bounds.h"
+#include "primitive.h"
+
+namespace Aokana {
+
+    // 压缩的 8 叉 BVH 节点, 一个节点 80 字节保存全部 8 个子节点的包围盒 (BVHNode 的一个 Bounds3 就要 48 字节).
+    // 子节点的包围盒相对于节点局部的网格量化为 8 位整数: 网格从 origin 开始, 第 a 轴的格子大小为 2^exponent[a],
+    // 下界向下取整, 上界向上取整并额外留出一点余量, 解码得到的包围盒总是包含原来的包围盒.
+    // 内部子节点在节点数组中连续存放, 第 i 个子节点的编号为 child_base + meta[i];
+    // 叶子子节点的图元在图元数组中连续存放, 从 primitive_base + (meta[i] & 31) 开始共 meta[i] >> 5 个.
+    // 空的子节点不是内部节点且 meta 为 0, 量化的下界大于上界
+    struct CompressedBVHNode {
+        float origin[3];
+        int8_t exponent[3];
+        uint8_t internal_mask;      // 第 i 位为 1 表示第 i 个子节点是内部节点
+        uint32_t child_base;
+        uint32_t primitive_base;
+        uint8_t meta[8];
+        uint8_t q_min[3][8];        // [轴][子节点]
+        uint8_t q_max[3][8];
+    };
+
+    // 以 CompressedBVHNode 组织的 8 叉 BVH. 先用分桶 SAH 构建二叉树, 再把它折叠成 8 叉树并量化子节点包围盒.
+    // 遍历时每个节点用 SIMD 一次解码全部子节点包围盒并与光线求交, 比 BVHNode 少得多的内存使整个加速结构更容易留在缓存中.
+    // 传入的 BVHNode 图元会被展开, 其中的图元直接加入这棵树; 网格文件的 MeshFileBVH 作为一个整体的图元加入
+    class CompressedBVH : public Primitive {
+    public:
+        CompressedBVH() = delete;
+        CompressedBVH(const std::shared_ptr<Aggregate>& aggregate, double time0, double time1) :
+            CompressedBVH(aggregate->primitives, time0, time1) {}
+        CompressedBVH(const std::vector<std::shared_ptr<Primitive>>& primitives, double time0, double time1);
+
+        virtual bool Intersect(const Ray& ray, double t_min = 0.0001, double t_max = INF) const override;
+        virtual bool IntersectP(const Ray& ray, SurfaceInteraction& isect, double t_min = 0.0001, double t_max = INF) const override;
+        virtual Bounds3 WorldBound(double time0 = 0, double time1 = 0) const override;
+        virtual const Material* GetMaterial() const override;
+        // 图元移动后自底向上重新计算并量化所有子节点的包围盒, 树的结构不变
+        void Refit(double time0, double time1);
+
+        size_t NodeCount() const { return nodes.size(); }
+        size_t BytesUsed() const { return nodes.size() * sizeof(CompressedBVHNode) + leaf_primitives.size() * sizeof(const Primitive*); }
+
+    private:
+        Bounds3 RefitNode(uint32_t index, double time0, double time1);
+
+        std::vector<CompressedBVHNode> nodes;                   // 根节点为第 0 个
+        std::vector<const Primitive*> leaf_primitives;          // 按叶子顺序排列, 遍历时使用
+        std::vector<std::shared_ptr<Primitive>> primitives;     // 保持图元有效
+        Bounds3 box;
+    };
+}
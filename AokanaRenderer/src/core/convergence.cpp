@@ -0,0 +1,93 @@
+#include "convergence.h"
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+
+namespace Aokana {
+
+    namespace {
+
+        // 在线性辐射度上计算, 色调映射的截断与 8 位量化会掩盖采样器之间的差别
+        double MeanSquareError(const Film& film, const Film& reference) {
+            const std::vector<float> radiance = film.GetRadianceBuffer();
+            const std::vector<float> reference_radiance = reference.GetRadianceBuffer();
+            double sum = 0;
+            for (size_t i = 0; i < radiance.size(); ++i) {
+                double diff = static_cast<double>(radiance[i]) - reference_radiance[i];
+                sum += diff * diff;
+            }
+            return sum / static_cast<double>(radiance.size());
+        }
+
+        // 使用给定的采样器渲染一帧, 返回渲染得到的胶片与耗时
+        std::shared_ptr<Film> RenderWithSampler(SamplerIntegrator& integrator, const std::shared_ptr<Sampler>& sampler, double& milliseconds) {
+            Camera& camera = integrator.scene->camera;
+            std::shared_ptr<const Filter> filter = camera.film->filter;
+            camera.film = std::make_shared<Film>(camera.film->image_width, camera.film->image_height);
+            camera.film->SetFilter(filter);
+            integrator.sampler = sampler;
+
+            auto start_time = std::chrono::steady_clock::now();
+            integrator.RenderWithMultithreading(false);
+            auto end_time = std::chrono::steady_clock::now();
+            milliseconds = std::chrono::duration<double, std::milli>(end_time - start_time).count();
+            return camera.film;
+        }
+    }
+
+    std::vector<ConvergenceResult> CompareSamplerConvergence(
+        SamplerIntegrator& integrator,
+        const std::vector<std::string>& sampler_names,
+        const std::vector<int>& spp_list,
+        int reference_spp) {
+
+        std::shared_ptr<Sampler> original_sampler = integrator.sampler;
+        std::shared_ptr<Film> original_film = integrator.scene->camera.film;
+
+        std::cout << "[INFO] Rendering reference image with " << reference_spp << " spp." << std::endl;
+        double reference_milliseconds = 0;
+        std::shared_ptr<Film> reference = RenderWithSampler(
+            integrator, CreateSampler("independent", reference_spp, 0x5eed), reference_milliseconds);
+        reference->SaveImage("./output/convergence_reference.png");
+
+        std::vector<ConvergenceResult> results;
+        for (const auto& name : sampler_names) {
+            for (int spp : spp_list) {
+                std::shared_ptr<Sampler> sampler = CreateSampler(name, spp);
+                if (sampler == nullptr) {
+                    std::cerr << "[ERROR] Unknown sampler \"" << name << "\"." << std::endl;
+                    break;
+                }
+                ConvergenceResult result{ name, spp, 0, 0 };
+                std::shared_ptr<Film> film = RenderWithSampler(integrator, sampler, result.milliseconds);
+                result.mse = MeanSquareError(*film, *reference);
+                film->SaveImage("./output/convergence_" + name + "_" + std::to_string(spp) + ".png");
+                results.push_back(result);
+            }
+        }
+
+        integrator.sampler = original_sampler;
+        integrator.scene->camera.film = original_film;
+        return results;
+    }
+
+    void PrintConvergenceReport(const std::vector<ConvergenceResult>& results) {
+        // 以相同采样数下独立采样器的效率为基准
+        auto baseline_efficiency = [&](int spp) {
+            for (const auto& r : results) {
+                if (r.sampler_name == "independent" && r.samples_per_pixel == spp) return 1.0 / (r.mse * r.milliseconds);
+            }
+            return 0.0;
+        };
+
+        std::printf("%-12s %6s %12s %14s %14s\n", "sampler", "spp", "time(ms)", "MSE", "rel.efficiency");
+        for (const auto& r : results) {
+            double efficiency = 1.0 / (r.mse * r.milliseconds);
+            double baseline = baseline_efficiency(r.samples_per_pixel);
+            std::printf("%-12s %6d %12.1f %14.6e %14.3f\n",
+                r.sampler_name.c_str(), r.samples_per_pixel, r.milliseconds, r.mse,
+                baseline > 0 ? efficiency / baseline : 0.0);
+        }
+    }
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "integrator.h"
+
+namespace Aokana {
+
+    struct ConvergenceResult {
+        std::string sampler_name;
+        int samples_per_pixel;
+        double milliseconds;    // 渲染耗时
+        double mse;             // 与参考图像之间线性辐射度的均方误差
+    };
+
+    // 在当前场景上比较不同采样器的收敛速度
+    // 先用独立采样器渲染 reference_spp 的参考图像, 再以每个采样器渲染 spp_list 中的每个采样数, 记录耗时与均方误差;
+    // 等时间比较使用效率 1 / (MSE * time), 其值越大, 在相同时间内得到的误差越小
+    std::vector<ConvergenceResult> CompareSamplerConvergence(
+        SamplerIntegrator& integrator,
+        const std::vector<std::string>& sampler_names,
+        const std::vector<int>& spp_list,
+        int reference_spp);
+
+    void PrintConvergenceReport(const std::vector<ConvergenceResult>& results);
+}
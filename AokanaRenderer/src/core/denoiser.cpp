@@ -0,0 +1,197 @@
+#include "denoiser.h"
+#include "thread_pool.h"
+#include "worker_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cmath>
+#include <iostream>
+#include <limits>
+
+namespace Aokana {
+
+    namespace {
+
+        constexpr double ALBEDO_EPSILON = 0.01;
+
+        double Luminance(double r, double g, double b) {
+            return 0.2126 * r + 0.7152 * g + 0.0722 * b;
+        }
+
+        // 降噪的输入, 均为图像坐标 (第 0 行在最上面), 逐行存储
+        struct DenoiserInput {
+            int width = 0, height = 0;
+            std::vector<float> color;       // 3 通道, 启用反照率时为除以反照率后的光照
+            std::vector<float> variance;    // 像素均值的亮度方差, 与 color 使用同样的尺度
+            std::vector<float> albedo;
+            std::vector<float> normal;
+            std::vector<float> depth;
+        };
+
+        DenoiserInput GatherInput(const Film& film, const DenoiserSettings& settings) {
+            DenoiserInput input;
+            input.width = film.image_width;
+            input.height = film.image_height;
+            const size_t count = static_cast<size_t>(input.width) * input.height;
+
+            if (film.aovs) {
+                if (film.aovs->Enabled(AOV_ALBEDO)) input.albedo = film.aovs->GetImage(AOV_ALBEDO, film);
+                if (film.aovs->Enabled(AOV_NORMAL)) input.normal = film.aovs->GetImage(AOV_NORMAL, film);
+                if (film.aovs->Enabled(AOV_DEPTH)) input.depth = film.aovs->GetImage(AOV_DEPTH, film);
+            }
+
+            input.color.resize(count * 3);
+            std::vector<float> raw_variance(count);
+            std::vector<uint8_t> has_variance(count);
+            for (int y = 0; y < input.height; ++y) {
+                for (int x = 0; x < input.width; ++x) {
+                    const int v = input.height - 1 - y;
+                    const size_t index = static_cast<size_t>(y) * input.width + x;
+                    const FilmPixel& pixel = film.GetPixel(x, v);
+                    Color color = film.GetPixelColor(x, v);
+                    double variance = pixel.sample_count > 1
+                        ? pixel.luminance_m2 / (pixel.sample_count - 1) / pixel.sample_count : 0.0;
+
+                    double rgb[3] = { color.x, color.y, color.z };
+                    if (!input.albedo.empty()) {
+                        const float* a = &input.albedo[index * 3];
+                        for (int c = 0; c < 3; ++c) rgb[c] /= std::max(static_cast<double>(a[c]), ALBEDO_EPSILON);
+                        double albedo_luminance = std::max(Luminance(a[0], a[1], a[2]), ALBEDO_EPSILON);
+                        variance /= albedo_luminance * albedo_luminance;
+                    }
+                    for (int c = 0; c < 3; ++c) input.color[index * 3 + c] = static_cast<float>(rgb[c]);
+                    raw_variance[index] = static_cast<float>(variance);
+                    has_variance[index] = pixel.sample_count > 1;
+                }
+            }
+
+            // 方差的预滤波: 窗口内有方差估计的像素取平均, 否则用窗口内亮度的方差
+            const int r = std::max(0, settings.variance_filter_radius);
+            input.variance.resize(count);
+            for (int y = 0; y < input.height; ++y) {
+                for (int x = 0; x < input.width; ++x) {
+                    double variance_sum = 0, luminance_sum = 0, luminance_sum2 = 0;
+                    int known = 0, pixels = 0;
+                    for (int qy = std::max(0, y - r); qy <= std::min(input.height - 1, y + r); ++qy) {
+                        for (int qx = std::max(0, x - r); qx <= std::min(input.width - 1, x + r); ++qx) {
+                            const size_t q = static_cast<size_t>(qy) * input.width + qx;
+                            if (has_variance[q]) {
+                                variance_sum += raw_variance[q];
+                                ++known;
+                            }
+                            const float* c = &input.color[q * 3];
+                            double luminance = Luminance(c[0], c[1], c[2]);
+                            luminance_sum += luminance;
+                            luminance_sum2 += luminance * luminance;
+                            ++pixels;
+                        }
+                    }
+                    double variance = known > 0 ? variance_sum / known
+                        : std::max(0.0, luminance_sum2 / pixels - (luminance_sum / pixels) * (luminance_sum / pixels));
+                    input.variance[static_cast<size_t>(y) * input.width + x] = static_cast<float>(std::max(variance, settings.min_variance));
+                }
+            }
+            return input;
+        }
+
+        // 以 AOV 计算 p, q 两个像素属于同一表面的程度
+        double FeatureWeight(const DenoiserInput& input, const DenoiserSettings& settings, size_t p, size_t q) {
+            double weight = 1;
+            if (!input.albedo.empty()) {
+                double distance2 = 0;
+                for (int c = 0; c < 3; ++c) {
+                    double d = input.albedo[p * 3 + c] - input.albedo[q * 3 + c];
+                    distance2 += d * d;
+                }
+                weight *= std::exp(-distance2 / (settings.sigma_albedo * settings.sigma_albedo));
+            }
+            if (!input.normal.empty()) {
+                // 没有击中物体的像素法线为 0, 只由深度区分
+                double cos_theta = 0, length_p = 0, length_q = 0;
+                for (int c = 0; c < 3; ++c) {
+                    cos_theta += input.normal[p * 3 + c] * input.normal[q * 3 + c];
+                    length_p += input.normal[p * 3 + c] * input.normal[p * 3 + c];
+                    length_q += input.normal[q * 3 + c] * input.normal[q * 3 + c];
+                }
+                if (length_p > 0 && length_q > 0) weight *= std::exp(-std::max(0.0, 1 - cos_theta) / settings.sigma_normal);
+            }
+            if (!input.depth.empty()) {
+                float z_p = input.depth[p], z_q = input.depth[q];
+                // 没有击中物体的像素只与同样没有击中物体的像素相似
+                if (std::isinf(z_p) || std::isinf(z_q)) {
+                    if (std::isinf(z_p) != std::isinf(z_q)) return 0;
+                }
+                else {
+                    weight *= std::exp(-std::abs(z_p - z_q) / (settings.sigma_depth * std::max(z_p, 1e-3f)));
+                }
+            }
+            return weight;
+        }
+
+        // 以方差归一化的块距离, 减去方差以去除噪声本身带来的偏差
+        double PatchWeight(const DenoiserInput& input, const DenoiserSettings& settings, int px, int py, int qx, int qy) {
+            const int r = settings.patch_radius;
+            const double k2 = settings.k * settings.k;
+            double distance = 0;
+            int patch_size = 0;
+            for (int dy = -r; dy <= r; ++dy) {
+                for (int dx = -r; dx <= r; ++dx) {
+                    int ax = px + dx, ay = py + dy, bx = qx + dx, by = qy + dy;
+                    if (ax < 0 || ay < 0 || bx < 0 || by < 0 ||
+                        ax >= input.width || bx >= input.width || ay >= input.height || by >= input.height) continue;
+                    size_t a = static_cast<size_t>(ay) * input.width + ax;
+                    size_t b = static_cast<size_t>(by) * input.width + bx;
+                    double variance = input.variance[a] + input.variance[b];
+                    for (int c = 0; c < 3; ++c) {
+                        double d = input.color[a * 3 + c] - input.color[b * 3 + c];
+                        distance += (d * d - variance) / (1e-8 + k2 * variance);
+                    }
+                    ++patch_size;
+                }
+            }
+            if (patch_size == 0) return 0;
+            return std::exp(-std::max(0.0, distance / (3 * patch_size)));
+        }
+    }
+
+    void DenoiseFilm(Film& film, const DenoiserSettings& settings) {
+        auto start_time = std::chrono::steady_clock::now();
+        const DenoiserInput input = GatherInput(film, settings);
+        const int width = input.width, height = input.height;
+        const int radius = settings.window_radius;
+
+        BS::work_stealing_pool& pool = SharedWorkerPool();
+        pool.parallel_for(0, height, [&](int row_begin, int row_end) {
+            for (int y = row_begin; y < row_end; ++y) {
+                for (int x = 0; x < width; ++x) {
+                    const size_t p = static_cast<size_t>(y) * width + x;
+                    double sum[3] = { 0, 0, 0 };
+                    double weight_sum = 0;
+                    for (int qy = std::max(0, y - radius); qy <= std::min(height - 1, y + radius); ++qy) {
+                        for (int qx = std::max(0, x - radius); qx <= std::min(width - 1, x + radius); ++qx) {
+                            const size_t q = static_cast<size_t>(qy) * width + qx;
+                            double weight = FeatureWeight(input, settings, p, q);
+                            if (weight < 1e-4) continue;
+                            weight *= PatchWeight(input, settings, x, y, qx, qy);
+                            for (int c = 0; c < 3; ++c) sum[c] += weight * input.color[q * 3 + c];
+                            weight_sum += weight;
+                        }
+                    }
+
+                    // 中心像素与自身的权重为 1, weight_sum 至少为 1
+                    double rgb[3];
+                    for (int c = 0; c < 3; ++c) {
+                        rgb[c] = weight_sum > 0 ? sum[c] / weight_sum : input.color[p * 3 + c];
+                        if (!input.albedo.empty()) rgb[c] *= std::max(static_cast<double>(input.albedo[p * 3 + c]), ALBEDO_EPSILON);
+                    }
+                    film.WriteColor(Color(rgb[0], rgb[1], rgb[2]), x, height - 1 - y);
+                }
+            }
+        }, 1);
+
+        auto end_time = std::chrono::steady_clock::now();
+        std::cout << "[INFO] Denoised in " << std::chrono::duration<double, std::milli>(end_time - start_time).count()
+            << " ms with " << pool.get_thread_count() << " threads." << std::endl;
+    }
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "film.h"
+
+namespace Aokana {
+
+    // 渲染后的降噪
+    // 以每个像素的亮度方差为尺度的非局部均值 (NL-means) 滤波, 并以 AOV (反照率, 法线, 深度) 做联合双边加权,
+    // 避免模糊几何与纹理的边缘; 启用反照率 AOV 时先除以反照率, 只对光照部分滤波, 再乘回反照率
+    // Rousselle et al., "Robust Denoising using Feature and Color Information", 2013
+    struct DenoiserSettings {
+        int window_radius = 6;      // 搜索窗口半径
+        int patch_radius = 1;       // 颜色比较的块半径
+        double k = 0.45;            // 颜色距离相对于方差的容忍度, 越大越平滑
+        // 像素方差的估计只来自几个样本, 噪声很大: 先在半径为 variance_filter_radius 的方形窗口内取平均, 再限制到不小于 min_variance.
+        // 窗口内没有像素多于一个样本时 (例如 1 spp) 以窗口内亮度的方差代替
+        int variance_filter_radius = 1;
+        double min_variance = 1e-4;
+        double sigma_albedo = 0.1;
+        double sigma_normal = 0.1;  // 以 1 - cos 计
+        double sigma_depth = 0.1;   // 以相对深度差计
+    };
+
+    // 对胶片的输出图像降噪, 结果写回 radiance 与 data; 累积的样本不变, 之后仍可以继续渲染
+    // 使用 film.aovs 中启用的深度, 法线与反照率, 没有启用的特征不参与加权
+    void DenoiseFilm(Film& film, const DenoiserSettings& settings = DenoiserSettings());
+}
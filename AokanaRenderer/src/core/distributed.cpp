@@ -0,0 +1,555 @@
+#include "distributed.h"
+#include "integrator.h"
+#include "scene_loader.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <WinSock2.h>
+#include <WS2tcpip.h>
+#pragma comment(lib, "Ws2_32.lib")
+#else
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace Aokana {
+
+    namespace {
+
+#if defined(_WIN32)
+        using socket_t = SOCKET;
+        constexpr socket_t INVALID_SOCKET_HANDLE = INVALID_SOCKET;
+        void CloseSocket(socket_t s) { closesocket(s); }
+        int PollSockets(pollfd* fds, size_t count, int timeout_ms) { return WSAPoll(fds, static_cast<ULONG>(count), timeout_ms); }
+
+        struct SocketLibrary {
+            SocketLibrary() { WSADATA data; ok = WSAStartup(MAKEWORD(2, 2), &data) == 0; }
+            ~SocketLibrary() { if (ok) WSACleanup(); }
+            bool ok = false;
+        };
+#else
+        using socket_t = int;
+        constexpr socket_t INVALID_SOCKET_HANDLE = -1;
+        void CloseSocket(socket_t s) { close(s); }
+        int PollSockets(pollfd* fds, size_t count, int timeout_ms) { return poll(fds, count, timeout_ms); }
+
+        struct SocketLibrary {
+            bool ok = true;
+        };
+#endif
+
+        enum MessageType : uint32_t {
+            MESSAGE_HELLO = 1,      // 工作进程 -> 协调进程: HelloMessage
+            MESSAGE_JOB = 2,        // 协调进程 -> 工作进程: DistributedJob
+            MESSAGE_TASK = 3,       // 协调进程 -> 工作进程: TaskMessage
+            MESSAGE_RESULT = 4,     // 工作进程 -> 协调进程: ResultHeader, 像素累积量, 样本统计量
+            MESSAGE_DONE = 5,       // 协调进程 -> 工作进程: 渲染结束
+        };
+
+        struct MessageHeader {
+            uint32_t type;
+            uint32_t size;
+        };
+
+        // 负载字节数的上限. 最大的消息是一个 16x16 tile 及其滤波器边缘的结果, 远小于这个值;
+        // 超过上限的消息头来自损坏或恶意的连接, 不为它分配内存
+        constexpr uint32_t MAX_MESSAGE_SIZE = 64u << 20;
+        // 工作进程开始发送一条消息后, 必须在这段时间内发送完, 否则认为它已经停止响应, 断开连接并重新分配它的任务
+        constexpr double MESSAGE_TIMEOUT_SECONDS = 30.0;
+
+        struct HelloMessage {
+            uint32_t version;
+            int32_t thread_count;
+        };
+
+        struct TaskMessage {
+            int32_t task_id;
+            int32_t tile_index;
+            int32_t first_sample;
+            int32_t sample_count;
+        };
+
+        // 之后依次是 [x_min, x_max] x [y_min, y_max] 范围的 FilmTileBuffer::Pixel
+        // 与 tile 范围内每个像素的 SampleStatistics
+        struct ResultHeader {
+            int32_t task_id;
+            int32_t x_min, y_min, x_max, y_max;
+        };
+
+        struct SampleStatistics {
+            int32_t sample_count;
+            float luminance_mean;
+            float luminance_m2;
+        };
+
+        static_assert(std::is_trivially_copyable_v<DistributedJob>, "DistributedJob is sent as raw bytes.");
+        static_assert(std::is_trivially_copyable_v<FilmTileBuffer::Pixel>, "FilmTileBuffer::Pixel is sent as raw bytes.");
+
+        bool SendAll(socket_t s, const char* data, size_t size) {
+            while (size > 0) {
+                int sent = send(s, data, static_cast<int>(std::min<size_t>(size, 1 << 30)), 0);
+                if (sent <= 0) return false;
+                data += sent;
+                size -= sent;
+            }
+            return true;
+        }
+
+        bool RecvAll(socket_t s, char* data, size_t size) {
+            while (size > 0) {
+                int received = recv(s, data, static_cast<int>(std::min<size_t>(size, 1 << 30)), 0);
+                if (received <= 0) return false;
+                data += received;
+                size -= received;
+            }
+            return true;
+        }
+
+        bool SendMessage(socket_t s, uint32_t type, const void* payload, size_t size) {
+            MessageHeader header{ type, static_cast<uint32_t>(size) };
+            return SendAll(s, reinterpret_cast<const char*>(&header), sizeof(header)) &&
+                SendAll(s, static_cast<const char*>(payload), size);
+        }
+
+        bool RecvMessage(socket_t s, uint32_t& type, std::vector<char>& payload) {
+            MessageHeader header;
+            if (!RecvAll(s, reinterpret_cast<char*>(&header), sizeof(header))) return false;
+            if (header.size > MAX_MESSAGE_SIZE) {
+                std::cerr << "[ERROR] Received a message of " << header.size << " bytes, closing the connection." << std::endl;
+                return false;
+            }
+            type = header.type;
+            payload.resize(header.size);
+            return RecvAll(s, payload.data(), payload.size());
+        }
+
+        // 读取当前已经到达的数据并追加到 buffer. 在 poll 报告可读之后调用, 不会阻塞; 连接关闭或出错时返回 false
+        bool RecvAvailable(socket_t s, std::vector<char>& buffer) {
+            char chunk[64 * 1024];
+            int received = recv(s, chunk, static_cast<int>(sizeof(chunk)), 0);
+            if (received <= 0) return false;
+            buffer.insert(buffer.end(), chunk, chunk + received);
+            return true;
+        }
+
+        // 从 buffer[offset] 开始取出一条完整的消息并前移 offset, 剩余的数据不足一条消息时返回 false;
+        // 消息头中的大小超过上限时同样返回 false 并把 error 设为 true
+        bool ExtractMessage(const std::vector<char>& buffer, size_t& offset, uint32_t& type, std::vector<char>& payload, bool& error) {
+            MessageHeader header;
+            if (buffer.size() - offset < sizeof(header)) return false;
+            std::memcpy(&header, buffer.data() + offset, sizeof(header));
+            if (header.size > MAX_MESSAGE_SIZE) {
+                std::cerr << "[ERROR] Received a message of " << header.size << " bytes, closing the connection." << std::endl;
+                error = true;
+                return false;
+            }
+            if (buffer.size() - offset - sizeof(header) < header.size) return false;
+            type = header.type;
+            const char* begin = buffer.data() + offset + sizeof(header);
+            payload.assign(begin, begin + header.size);
+            offset += sizeof(header) + header.size;
+            return true;
+        }
+
+        template <typename T>
+        void Append(std::vector<char>& out, const T* data, size_t count) {
+            const char* bytes = reinterpret_cast<const char*>(data);
+            out.insert(out.end(), bytes, bytes + sizeof(T) * count);
+        }
+
+        std::shared_ptr<Scene> CreateJobScene(const DistributedJob& job) {
+            std::shared_ptr<Scene> scene;
+            if (job.scene_file[0] != '\0') {
+                // 与协调进程使用同样的网格压缩, 否则工作进程渲染的是不同的几何
+                RenderSettings settings;
+                settings.mesh_compression = job.mesh_compression;
+                scene = LoadSceneFile(job.scene_file, &settings);
+                if (scene == nullptr) return nullptr;
+            }
+            else {
+                scene = SampleScene::Create(job.scene_id);
+                if (scene == nullptr) {
+                    std::cerr << "[ERROR] Unknown scene id " << job.scene_id << "." << std::endl;
+                    return nullptr;
+                }
+            }
+            std::shared_ptr<Filter> filter = CreateFilter(job.filter, job.filter_radius);
+            if (filter == nullptr) {
+                std::cerr << "[ERROR] Unknown filter \"" << job.filter << "\"." << std::endl;
+                return nullptr;
+            }
+            scene->camera.film->SetFilter(filter);
+            return scene;
+        }
+
+        struct WorkerConnection {
+            socket_t socket = INVALID_SOCKET_HANDLE;
+            int capacity = 0;           // 同时分配给该工作进程的任务数, 收到 HELLO 之前为 0
+            std::set<int> in_flight;
+            std::vector<char> received;     // 已经收到但还不是完整消息的数据
+            std::chrono::steady_clock::time_point message_start;   // received 中未完成的消息开始到达的时刻
+        };
+    }
+
+    bool RunDistributedCoordinator(const DistributedJob& job, uint16_t port, const std::string& output_path) {
+        SocketLibrary library;
+        if (!library.ok) {
+            std::cerr << "[ERROR] Failed to initialize the socket library." << std::endl;
+            return false;
+        }
+
+        std::shared_ptr<Scene> scene = CreateJobScene(job);
+        if (scene == nullptr) return false;
+        Film& film = *scene->camera.film;
+
+        // 任务按样本区间分成若干遍, 每一遍覆盖所有 tile, 因此整幅图像是逐渐收敛的
+        const int samples_per_task = job.samples_per_task > 0 ? job.samples_per_task : job.samples_per_pixel;
+        std::vector<TaskMessage> tasks;
+        for (int first = 0; first < job.samples_per_pixel; first += samples_per_task) {
+            for (size_t t = 0; t < film.tiles.size(); ++t) {
+                TaskMessage task;
+                task.task_id = static_cast<int32_t>(tasks.size());
+                task.tile_index = static_cast<int32_t>(t);
+                task.first_sample = first;
+                task.sample_count = std::min(samples_per_task, job.samples_per_pixel - first);
+                tasks.push_back(task);
+            }
+        }
+        std::deque<int> pending;
+        for (const TaskMessage& task : tasks) pending.push_back(task.task_id);
+        std::vector<uint8_t> finished(tasks.size(), 0);
+        size_t finished_count = 0;
+
+        socket_t listener = socket(AF_INET, SOCK_STREAM, 0);
+        if (listener == INVALID_SOCKET_HANDLE) {
+            std::cerr << "[ERROR] Failed to create the listening socket." << std::endl;
+            return false;
+        }
+        int reuse = 1;
+        setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_ANY);
+        address.sin_port = htons(port);
+        if (bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listener, 16) != 0) {
+            std::cerr << "[ERROR] Failed to listen on port " << port << "." << std::endl;
+            CloseSocket(listener);
+            return false;
+        }
+        std::cout << "[INFO] Waiting for workers on port " << port << ": " << tasks.size() << " tasks, "
+            << film.tiles.size() << " tiles, " << job.samples_per_pixel << " spp." << std::endl;
+
+        auto start_time = std::chrono::steady_clock::now();
+        std::vector<WorkerConnection> workers;
+
+        auto disconnect = [&](size_t w) {
+            for (int task_id : workers[w].in_flight) pending.push_front(task_id);
+            if (!workers[w].in_flight.empty()) {
+                std::cout << "[INFO] A worker disconnected, " << workers[w].in_flight.size() << " tasks requeued." << std::endl;
+            }
+            CloseSocket(workers[w].socket);
+            workers.erase(workers.begin() + w);
+        };
+
+        // 合并一个任务的结果; 负载不完整时返回 false
+        auto merge_result = [&](const std::vector<char>& payload) {
+            if (payload.size() < sizeof(ResultHeader)) return false;
+            ResultHeader header;
+            std::memcpy(&header, payload.data(), sizeof(header));
+            if (header.task_id < 0 || header.task_id >= static_cast<int>(tasks.size())) return false;
+            const TaskMessage& task = tasks[header.task_id];
+            const FilmTile& tile = film.tiles[task.tile_index];
+            const int tile_width = static_cast<int>(tile.u_max - tile.u_min) + 1;
+            const int tile_height = static_cast<int>(tile.v_max - tile.v_min) + 1;
+
+            FilmTileBuffer buffer;
+            buffer.x_min = header.x_min;
+            buffer.y_min = header.y_min;
+            buffer.x_max = header.x_max;
+            buffer.y_max = header.y_max;
+            if (buffer.x_min < 0 || buffer.y_min < 0 || buffer.x_max >= film.image_width || buffer.y_max >= film.image_height ||
+                buffer.x_max < buffer.x_min || buffer.y_max < buffer.y_min) return false;
+            buffer.pixels.resize(static_cast<size_t>(buffer.x_max - buffer.x_min + 1) * (buffer.y_max - buffer.y_min + 1));
+            const size_t pixel_bytes = buffer.pixels.size() * sizeof(FilmTileBuffer::Pixel);
+            std::vector<SampleStatistics> statistics(static_cast<size_t>(tile_width) * tile_height);
+            const size_t statistics_bytes = statistics.size() * sizeof(SampleStatistics);
+            if (payload.size() != sizeof(ResultHeader) + pixel_bytes + statistics_bytes) return false;
+            std::memcpy(buffer.pixels.data(), payload.data() + sizeof(ResultHeader), pixel_bytes);
+            std::memcpy(statistics.data(), payload.data() + sizeof(ResultHeader) + pixel_bytes, statistics_bytes);
+
+            // 任务可能因为重新排队而被执行两次, 只合并第一个结果
+            if (finished[header.task_id]) return true;
+            finished[header.task_id] = 1;
+            ++finished_count;
+
+            for (int v = 0; v < tile_height; ++v) {
+                for (int u = 0; u < tile_width; ++u) {
+                    const SampleStatistics& s = statistics[v * tile_width + u];
+                    film.MergeSampleStatistics(static_cast<int>(tile.u_min) + u, static_cast<int>(tile.v_min) + v,
+                        s.sample_count, s.luminance_mean, s.luminance_m2);
+                }
+            }
+            film.MergeTileBuffer(buffer);
+            return true;
+        };
+
+        auto assign_tasks = [&]() {
+            for (size_t w = 0; w < workers.size() && !pending.empty(); ) {
+                WorkerConnection& worker = workers[w];
+                bool ok = true;
+                while (ok && !pending.empty() && static_cast<int>(worker.in_flight.size()) < worker.capacity) {
+                    int task_id = pending.front();
+                    pending.pop_front();
+                    if (finished[task_id]) continue;
+                    worker.in_flight.insert(task_id);
+                    ok = SendMessage(worker.socket, MESSAGE_TASK, &tasks[task_id], sizeof(TaskMessage));
+                }
+                if (ok) ++w;
+                else disconnect(w);
+            }
+        };
+
+        // 处理工作进程 w 的一条消息, 返回 false 时断开该连接
+        auto handle_message = [&](size_t w, uint32_t type, const std::vector<char>& payload) {
+            if (type == MESSAGE_HELLO && payload.size() == sizeof(HelloMessage)) {
+                HelloMessage hello;
+                std::memcpy(&hello, payload.data(), sizeof(hello));
+                if (hello.version != DISTRIBUTED_PROTOCOL_VERSION ||
+                    !SendMessage(workers[w].socket, MESSAGE_JOB, &job, sizeof(job))) {
+                    std::cerr << "[ERROR] Rejected a worker speaking protocol version " << hello.version << "." << std::endl;
+                    return false;
+                }
+                // 每个线程保持两个任务, 线程渲染时下一个任务已经在路上
+                workers[w].capacity = std::max(1, hello.thread_count) * 2;
+                std::cout << "[INFO] Worker joined with " << hello.thread_count << " threads, "
+                    << workers.size() << " workers connected." << std::endl;
+                return true;
+            }
+            if (type == MESSAGE_RESULT) {
+                ResultHeader header{};
+                if (payload.size() >= sizeof(header)) std::memcpy(&header, payload.data(), sizeof(header));
+                if (!workers[w].in_flight.erase(header.task_id) || !merge_result(payload)) {
+                    std::cerr << "[ERROR] Received a malformed result, dropping the worker." << std::endl;
+                    return false;
+                }
+                return true;
+            }
+            return false;
+        };
+
+        size_t reported = 0;
+        while (finished_count < tasks.size()) {
+            std::vector<pollfd> fds(workers.size() + 1);
+            fds[0].fd = listener;
+            fds[0].events = POLLIN;
+            for (size_t w = 0; w < workers.size(); ++w) {
+                fds[w + 1].fd = workers[w].socket;
+                fds[w + 1].events = POLLIN;
+            }
+            if (PollSockets(fds.data(), fds.size(), 1000) < 0) {
+                std::cerr << "[ERROR] poll() failed." << std::endl;
+                break;
+            }
+
+            // 从后往前处理, 断开的连接从 workers 中删除时不影响前面的下标.
+            // 每次只读取已经到达的数据, 消息完整后才处理, 一个发送缓慢或中途停止的工作进程不会阻塞其他连接
+            for (size_t w = workers.size(); w-- > 0; ) {
+                if (!(fds[w + 1].revents & (POLLIN | POLLERR | POLLHUP))) continue;
+                std::vector<char>& received = workers[w].received;
+                const bool was_empty = received.empty();
+                if (!RecvAvailable(workers[w].socket, received)) {
+                    disconnect(w);
+                    continue;
+                }
+                size_t offset = 0;
+                uint32_t type;
+                std::vector<char> payload;
+                bool ok = true, error = false;
+                while (ok && ExtractMessage(received, offset, type, payload, error)) ok = handle_message(w, type, payload);
+                if (!ok || error) {
+                    disconnect(w);
+                    continue;
+                }
+                received.erase(received.begin(), received.begin() + offset);
+                if (!received.empty() && (was_empty || offset > 0)) workers[w].message_start = std::chrono::steady_clock::now();
+            }
+            for (size_t w = workers.size(); w-- > 0; ) {
+                if (workers[w].received.empty()) continue;
+                if (std::chrono::duration<double>(std::chrono::steady_clock::now() - workers[w].message_start).count() > MESSAGE_TIMEOUT_SECONDS) {
+                    std::cerr << "[ERROR] A worker stopped in the middle of a message, dropping it." << std::endl;
+                    disconnect(w);
+                }
+            }
+
+            if (fds[0].revents & POLLIN) {
+                socket_t client = accept(listener, nullptr, nullptr);
+                if (client != INVALID_SOCKET_HANDLE) {
+                    int no_delay = 1;
+                    setsockopt(client, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&no_delay), sizeof(no_delay));
+                    WorkerConnection worker;
+                    worker.socket = client;
+                    workers.push_back(std::move(worker));
+                }
+            }
+
+            assign_tasks();
+
+            if (finished_count * 10 / tasks.size() > reported) {
+                reported = finished_count * 10 / tasks.size();
+                double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+                std::cout << "[INFO] Distributed rendering " << reported * 10 << "% finished, " << elapsed << " s elapsed, "
+                    << workers.size() << " workers connected." << std::endl;
+            }
+        }
+
+        for (WorkerConnection& worker : workers) {
+            SendMessage(worker.socket, MESSAGE_DONE, nullptr, 0);
+            CloseSocket(worker.socket);
+        }
+        CloseSocket(listener);
+        if (finished_count < tasks.size()) return false;
+
+        film.SaveImage(output_path);
+        std::string exr_path = output_path.substr(0, output_path.find_last_of('.')) + ".exr";
+        if (exr_path != output_path) film.SaveImage(exr_path);
+        return true;
+    }
+
+    bool RunDistributedWorker(const std::string& host, uint16_t port) {
+        SocketLibrary library;
+        if (!library.ok) {
+            std::cerr << "[ERROR] Failed to initialize the socket library." << std::endl;
+            return false;
+        }
+
+        addrinfo hints{};
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* addresses = nullptr;
+        if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &addresses) != 0 || addresses == nullptr) {
+            std::cerr << "[ERROR] Failed to resolve \"" << host << "\"." << std::endl;
+            return false;
+        }
+        // 协调进程可能还没有启动, 重试一段时间
+        socket_t connection = INVALID_SOCKET_HANDLE;
+        for (int attempt = 0; attempt < 50 && connection == INVALID_SOCKET_HANDLE; ++attempt) {
+            connection = socket(addresses->ai_family, addresses->ai_socktype, addresses->ai_protocol);
+            if (connection != INVALID_SOCKET_HANDLE &&
+                connect(connection, addresses->ai_addr, static_cast<int>(addresses->ai_addrlen)) != 0) {
+                CloseSocket(connection);
+                connection = INVALID_SOCKET_HANDLE;
+                std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            }
+        }
+        freeaddrinfo(addresses);
+        if (connection == INVALID_SOCKET_HANDLE) {
+            std::cerr << "[ERROR] Failed to connect to " << host << ":" << port << "." << std::endl;
+            return false;
+        }
+        int no_delay = 1;
+        setsockopt(connection, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&no_delay), sizeof(no_delay));
+
+        BS::work_stealing_pool pool;
+        HelloMessage hello{ DISTRIBUTED_PROTOCOL_VERSION, static_cast<int32_t>(pool.get_thread_count()) };
+        uint32_t type;
+        std::vector<char> payload;
+        DistributedJob job;
+        if (!SendMessage(connection, MESSAGE_HELLO, &hello, sizeof(hello)) || !RecvMessage(connection, type, payload) ||
+            type != MESSAGE_JOB || payload.size() != sizeof(job)) {
+            std::cerr << "[ERROR] Handshake with the coordinator failed." << std::endl;
+            CloseSocket(connection);
+            return false;
+        }
+        std::memcpy(&job, payload.data(), sizeof(job));
+        job.scene_file[sizeof(job.scene_file) - 1] = '\0';
+        job.sampler[sizeof(job.sampler) - 1] = '\0';
+        job.filter[sizeof(job.filter) - 1] = '\0';
+        job.mesh_compression[sizeof(job.mesh_compression) - 1] = '\0';
+
+        SamplerIntegrator integrator;
+        integrator.max_depth = job.max_depth;
+        integrator.scene = CreateJobScene(job);
+        integrator.sampler = CreateSampler(job.sampler, job.samples_per_pixel);
+        if (integrator.scene == nullptr || integrator.sampler == nullptr) {
+            std::cerr << "[ERROR] Failed to set up the job." << std::endl;
+            CloseSocket(connection);
+            return false;
+        }
+        const Film& film = *integrator.scene->camera.film;
+        std::cout << "[INFO] Connected to " << host << ":" << port << ", rendering scene " << job.scene_id
+            << " with " << pool.get_thread_count() << " threads." << std::endl;
+
+        std::mutex send_mutex;
+        bool connected = true;
+        int task_count = 0;
+        while (RecvMessage(connection, type, payload)) {
+            if (type == MESSAGE_DONE) break;
+            if (type != MESSAGE_TASK || payload.size() != sizeof(TaskMessage)) continue;
+            TaskMessage task;
+            std::memcpy(&task, payload.data(), sizeof(task));
+            if (task.tile_index < 0 || task.tile_index >= static_cast<int>(film.tiles.size())) continue;
+            ++task_count;
+
+            pool.push_task([&, task]() {
+                // 每个任务使用只覆盖 tile 及其滤波器边缘的临时胶片, 同一 tile 的多个任务可以并行渲染
+                const FilmTile& tile = film.tiles[task.tile_index];
+                const int padding = film.filter_padding;
+                const int x_min = std::max(0, static_cast<int>(tile.u_min) - padding);
+                const int y_min = std::max(0, static_cast<int>(tile.v_min) - padding);
+                const int x_max = std::min(film.image_width - 1, static_cast<int>(tile.u_max) + padding);
+                const int y_max = std::min(film.image_height - 1, static_cast<int>(tile.v_max) + padding);
+                Film task_film(x_max - x_min + 1, y_max - y_min + 1);
+                task_film.SetCropWindow(film.image_width, film.image_height, x_min, y_min);
+                task_film.SetFilter(film.filter);
+                FilmTile local_tile(tile.u_min - x_min, tile.v_min - y_min, tile.u_max - x_min, tile.v_max - y_min);
+                FilmTileBuffer buffer;
+                buffer.Reset(task_film, local_tile);
+
+                std::unique_ptr<Sampler> task_sampler = integrator.sampler->Clone();
+                integrator.RenderTileSampleRange(*task_sampler, task_film, local_tile, task.first_sample, task.sample_count, buffer);
+
+                ResultHeader header{ task.task_id, buffer.x_min + x_min, buffer.y_min + y_min, buffer.x_max + x_min, buffer.y_max + y_min };
+                std::vector<SampleStatistics> statistics;
+                for (int v = static_cast<int>(local_tile.v_min); v <= local_tile.v_max; ++v) {
+                    for (int u = static_cast<int>(local_tile.u_min); u <= local_tile.u_max; ++u) {
+                        const FilmPixel& pixel = task_film.GetPixel(u, v);
+                        statistics.push_back({ pixel.sample_count, pixel.luminance_mean, pixel.luminance_m2 });
+                    }
+                }
+                std::vector<char> result;
+                Append(result, &header, 1);
+                Append(result, buffer.pixels.data(), buffer.pixels.size());
+                Append(result, statistics.data(), statistics.size());
+
+                std::lock_guard<std::mutex> lock(send_mutex);
+                if (connected) connected = SendMessage(connection, MESSAGE_RESULT, result.data(), result.size());
+            });
+        }
+        pool.wait_for_tasks();
+        CloseSocket(connection);
+        std::cout << "[INFO] Worker finished " << task_count << " tasks." << std::endl;
+        return connected;
+    }
+}
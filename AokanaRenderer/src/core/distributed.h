@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace Aokana {
+
+    // 分布式渲染
+    // 协调进程监听一个 TCP 端口, 把渲染拆成 (tile, 样本区间) 的任务分发给任意多个工作进程, 工作进程可以随时加入或退出.
+    // 工作进程按任务描述重建同一个场景, 渲染后把 tile (以及重建滤波器覆盖的相邻像素) 的浮点累积量与样本统计量发回,
+    // 协调进程把它们合并到自己的胶片中. 每个样本的随机数只由像素坐标与样本编号决定, 因此每个样本的值与任务如何分配无关;
+    // 但各任务的累积量按完成顺序合并, 浮点加法的顺序不同, 结果与本地渲染只在舍入误差的范围内一致.
+    // 工作进程断开时它未完成的任务重新排队.
+    //
+    // 消息格式: uint32 类型, uint32 负载字节数, 负载. 所有进程应运行在字节序相同的机器上
+
+    constexpr uint32_t DISTRIBUTED_PROTOCOL_VERSION = 3;
+
+    // 渲染任务的描述, 以原始字节发送给工作进程
+    struct DistributedJob {
+        int32_t scene_id = 0;
+        char scene_file[256] = "";      // 非空时代替 scene_id, 工作进程必须能以同一路径访问该文件
+        int32_t max_depth = 5;
+        int32_t samples_per_pixel = 16;
+        int32_t samples_per_task = 0;   // 每个任务为 tile 的每个像素渲染的样本数, 不大于 0 时一个任务渲染全部样本
+        char sampler[16] = "independent";
+        char filter[16] = "box";
+        double filter_radius = 0;       // 不大于 0 时使用滤波器的默认半径
+        char mesh_compression[32] = ""; // 场景文件中 "obj" 形状默认的压缩方式, 见 RenderSettings::mesh_compression
+    };
+
+    // 在 port 上等待工作进程并完成整个渲染, 结果保存到 output_path (按扩展名选择格式, 同时保存同名的 .exr)
+    bool RunDistributedCoordinator(const DistributedJob& job, uint16_t port, const std::string& output_path);
+    // 连接到 host:port 的协调进程并渲染它分发的任务, 直到渲染结束或连接断开
+    bool RunDistributedWorker(const std::string& host, uint16_t port);
+}
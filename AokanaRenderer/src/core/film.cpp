@@ -3,8 +3,59 @@
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include <stb_image_write.h>
 
+#include "image_io.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
 namespace Aokana {
 
+	double ToneMapping::Apply(double linear) const {
+		if (!(linear > 0)) return 0;    // 负值与 NaN
+		double x = linear * std::exp2(exposure);
+		switch (op) {
+		case Operator::Reinhard:
+			x = x / (1 + x);
+			break;
+		case Operator::ACES:
+			// Narkowicz 的 ACES 拟合曲线
+			x = (x * (2.51 * x + 0.03)) / (x * (2.43 * x + 0.59) + 0.14);
+			break;
+		default:
+			break;
+		}
+		return std::pow(Clamp01(x), 1.0 / gamma);
+	}
+
+	void Film::Allocate() {
+		size_t count = static_cast<size_t>(image_width) * image_height;
+		data = std::vector<unsigned char>(count * channels);
+		radiance = std::vector<float>(count * 3);
+		pixels = std::vector<FilmPixel>(count);
+		full_width = image_width;
+		full_height = image_height;
+		DivideTiles();
+		SetFilter(std::make_shared<BoxFilter>());
+	}
+
+	void Film::Clear() {
+		std::fill(data.begin(), data.end(), 0);
+		std::fill(radiance.begin(), radiance.end(), 0.0f);
+		std::fill(pixels.begin(), pixels.end(), FilmPixel());
+		if (aovs) EnableAOVs(aovs->flags);
+	}
+
+	void Film::SetFilter(std::shared_ptr<const Filter> filter) {
+		this->filter = std::move(filter);
+		filter_table = FilterTable(*this->filter);
+		// 样本位于 [x, x + 1), 到相邻第 k 个像素中心的最小距离为 k - 0.5
+		double radius = std::max(this->filter->radius.x, this->filter->radius.y);
+		filter_padding = std::max(0, static_cast<int>(std::ceil(radius - 0.5)));
+	}
+
 	void Film::DivideTiles() {
 		for (int i = 0; i < (image_width - 1) / tile_size + 1; ++i) {
 			int u0 = tile_size * i;
@@ -20,24 +71,153 @@ namespace Aokana {
 
 	void Film::WriteColor(Color pixel_color, int u, int v) {
 		v = image_height - 1 - v;
-		int index = (v * image_width + u) * 3;
+		size_t index = (static_cast<size_t>(v) * image_width + u) * 3;
 
-		// Divide the Color by the number of samples and gamma-correct for gamma=2.0.
-		double r = pixel_color.x;
-		double g = pixel_color.y;
-		double b = pixel_color.z;
+		radiance[index + 0] = static_cast<float>(pixel_color.x);
+		radiance[index + 1] = static_cast<float>(pixel_color.y);
+		radiance[index + 2] = static_cast<float>(pixel_color.z);
 
-		r = sqrt(r);
-		g = sqrt(g);
-		b = sqrt(b);
+		Color display = tone_mapping.Apply(pixel_color);
+		data[index + 0] = static_cast<unsigned char>(255.99 * display.x);
+		data[index + 1] = static_cast<unsigned char>(255.99 * display.y);
+		data[index + 2] = static_cast<unsigned char>(255.99 * display.z);
+	}
 
-		data[index + 0] = static_cast<unsigned char>(255.99 * r);
-		data[index + 1] = static_cast<unsigned char>(255.99 * g);
-		data[index + 2] = static_cast<unsigned char>(255.99 * b);
+	Color Film::GetRadiance(int x, int y) const {
+		size_t index = (static_cast<size_t>(y) * image_width + x) * 3;
+		return Color(radiance[index], radiance[index + 1], radiance[index + 2]);
+	}
+
+	std::vector<float> Film::GetRadianceBuffer() const {
+		return radiance;
+	}
+
+	void Film::UpdateToneMapping() {
+		for (int y = 0; y < image_height; ++y) {
+			for (int x = 0; x < image_width; ++x) {
+				size_t index = (static_cast<size_t>(y) * image_width + x) * 3;
+				Color display = tone_mapping.Apply(GetRadiance(x, y));
+				data[index + 0] = static_cast<unsigned char>(255.99 * display.x);
+				data[index + 1] = static_cast<unsigned char>(255.99 * display.y);
+				data[index + 2] = static_cast<unsigned char>(255.99 * display.z);
+			}
+		}
+	}
+
+	void Film::AddSample(int u, int v, const Color& radiance, double weight) {
+		FilmPixel& pixel = GetPixel(u, v);
+		pixel.rgb_sum[0] += weight * radiance.x;
+		pixel.rgb_sum[1] += weight * radiance.y;
+		pixel.rgb_sum[2] += weight * radiance.z;
+		pixel.weight_sum += weight;
+		AddSampleStatistics(u, v, radiance);
+	}
+
+	void Film::AddSampleStatistics(int u, int v, const Color& radiance) {
+		FilmPixel& pixel = GetPixel(u, v);
+		// Welford 在线方差
+		float luminance = static_cast<float>(0.2126 * radiance.x + 0.7152 * radiance.y + 0.0722 * radiance.z);
+		++pixel.sample_count;
+		float delta = luminance - pixel.luminance_mean;
+		pixel.luminance_mean += delta / pixel.sample_count;
+		pixel.luminance_m2 += delta * (luminance - pixel.luminance_mean);
+	}
+
+	void Film::MergeTileBuffer(const FilmTileBuffer& buffer) {
+		std::lock_guard<std::mutex> lock(merge_mutex);
+		const int buffer_width = buffer.x_max - buffer.x_min + 1;
+		for (int v = buffer.y_min; v <= buffer.y_max; ++v) {
+			for (int u = buffer.x_min; u <= buffer.x_max; ++u) {
+				const FilmTileBuffer::Pixel& splat = buffer.pixels[(v - buffer.y_min) * buffer_width + (u - buffer.x_min)];
+				if (splat.weight_sum == 0 && splat.rgb_sum[0] == 0 && splat.rgb_sum[1] == 0 && splat.rgb_sum[2] == 0) continue;
+				FilmPixel& pixel = GetPixel(u, v);
+				pixel.rgb_sum[0] += splat.rgb_sum[0];
+				pixel.rgb_sum[1] += splat.rgb_sum[1];
+				pixel.rgb_sum[2] += splat.rgb_sum[2];
+				pixel.weight_sum += splat.weight_sum;
+				ResolvePixel(u, v);
+			}
+		}
+	}
+
+	void Film::CopyImageRect(int x_min, int y_min, int x_max, int y_max, unsigned char* dst, size_t dst_row_stride) const {
+		std::lock_guard<std::mutex> lock(merge_mutex);
+		const size_t row_bytes = static_cast<size_t>(x_max - x_min + 1) * 3;
+		for (int y = y_min; y <= y_max; ++y) {
+			std::memcpy(dst + (y - y_min) * dst_row_stride, data.data() + (static_cast<size_t>(y) * image_width + x_min) * 3, row_bytes);
+		}
+	}
+
+	void Film::MergeSampleStatistics(int u, int v, int sample_count, float luminance_mean, float luminance_m2) {
+		if (sample_count == 0) return;
+		FilmPixel& pixel = GetPixel(u, v);
+		// Chan 等人的并行方差合并公式
+		int total = pixel.sample_count + sample_count;
+		float delta = luminance_mean - pixel.luminance_mean;
+		pixel.luminance_mean += delta * sample_count / total;
+		pixel.luminance_m2 += luminance_m2 + delta * delta * (static_cast<float>(pixel.sample_count) * sample_count / total);
+		pixel.sample_count = total;
+	}
+
+	void FilmTileBuffer::Reset(const Film& film, const FilmTile& tile) {
+		x_min = std::max(0, static_cast<int>(tile.u_min) - film.filter_padding);
+		y_min = std::max(0, static_cast<int>(tile.v_min) - film.filter_padding);
+		x_max = std::min(film.image_width - 1, static_cast<int>(tile.u_max) + film.filter_padding);
+		y_max = std::min(film.image_height - 1, static_cast<int>(tile.v_max) + film.filter_padding);
+		pixels.assign(static_cast<size_t>(x_max - x_min + 1) * (y_max - y_min + 1), Pixel());
+	}
+
+	void FilmTileBuffer::AddSample(const Film& film, const Point2& p_film, const Color& radiance) {
+		// 滤波器半径内的像素: 像素中心 (u + 0.5, v + 0.5) 与样本的距离小于半径
+		const Vector2& radius = film.filter->radius;
+		int u0 = std::max(x_min, static_cast<int>(std::ceil(p_film.x - 0.5 - radius.x)));
+		int u1 = std::min(x_max, static_cast<int>(std::floor(p_film.x - 0.5 + radius.x)));
+		int v0 = std::max(y_min, static_cast<int>(std::ceil(p_film.y - 0.5 - radius.y)));
+		int v1 = std::min(y_max, static_cast<int>(std::floor(p_film.y - 0.5 + radius.y)));
+		const int buffer_width = x_max - x_min + 1;
+		for (int v = v0; v <= v1; ++v) {
+			for (int u = u0; u <= u1; ++u) {
+				double weight = film.filter_table.Evaluate(Point2(p_film.x - (u + 0.5), p_film.y - (v + 0.5)));
+				if (weight == 0) continue;
+				Pixel& pixel = pixels[(v - y_min) * buffer_width + (u - x_min)];
+				pixel.rgb_sum[0] += weight * radiance.x;
+				pixel.rgb_sum[1] += weight * radiance.y;
+				pixel.rgb_sum[2] += weight * radiance.z;
+				pixel.weight_sum += weight;
+			}
+		}
+	}
+
+	Color Film::GetPixelColor(int u, int v) const {
+		const FilmPixel& pixel = GetPixel(u, v);
+		if (pixel.weight_sum == 0) return Color(0, 0, 0);
+		double inv_weight = 1.0 / pixel.weight_sum;
+		return Color(pixel.rgb_sum[0] * inv_weight, pixel.rgb_sum[1] * inv_weight, pixel.rgb_sum[2] * inv_weight);
+	}
+
+	double Film::RelativeError(int u, int v) const {
+		const FilmPixel& pixel = GetPixel(u, v);
+		if (pixel.sample_count < 2) return std::numeric_limits<double>::infinity();
+		double variance = pixel.luminance_m2 / (pixel.sample_count - 1);
+		double standard_error = std::sqrt(variance / pixel.sample_count);
+		// 暗部的相对误差容易被放大, 分母设置下限, 避免在几乎全黑的像素上浪费样本
+		return standard_error / std::max(static_cast<double>(pixel.luminance_mean), 0.01);
+	}
+
+	void Film::ResolvePixel(int u, int v) {
+		WriteColor(GetPixelColor(u, v), u, v);
 	}
 
 	void Film::SaveImage(std::string path) const {
-		std::cout << "[INFO] Film was successfully written to " << "\"" << path << "\"." << std::endl;
-		stbi_write_png(path.c_str(), image_width, image_height, 3, data.data(), 0);
+		std::string extension = path.substr(std::min(path.size(), path.find_last_of('.')));
+		std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+
+		bool success;
+		if (extension == ".pfm") success = WritePFM(path, image_width, image_height, GetRadianceBuffer().data());
+		else if (extension == ".exr") success = WriteEXR(path, image_width, image_height, GetRadianceBuffer().data(), true);
+		else success = stbi_write_png(path.c_str(), image_width, image_height, 3, data.data(), 0) != 0;
+
+		if (success) std::cout << "[INFO] Film was successfully written to " << "\"" << path << "\"." << std::endl;
+		else std::cerr << "[ERROR] Failed to write film to \"" << path << "\"." << std::endl;
 	}
 }
\ No newline at end of file
@@ -1,9 +1,14 @@
 #pragma once
 
+#include <cstdint>
+#include <memory>
+#include <mutex>
 #include <vector>
 #include <string>
 
 #include "vec.h"
+#include "filter.h"
+#include "aov.h"
 
 namespace Aokana {
 
@@ -16,6 +21,49 @@ namespace Aokana {
         double v_min, v_max;
     };
 
+    // 每个像素的累积统计量
+    // 颜色以 double 累加, 亮度的均值与方差以 float 按 Welford 算法在线更新, 用于自适应采样的收敛判定
+    struct FilmPixel {
+        double rgb_sum[3] = { 0, 0, 0 };
+        double weight_sum = 0;
+        float luminance_mean = 0;
+        float luminance_m2 = 0;
+        int sample_count = 0;
+    };
+
+    // 输出时的色调映射: 曝光 (以档为单位) -> 色调映射算子 -> gamma 编码, 得到 [0, 1] 内的显示值
+    // 默认设置与原来的输出一致: 截断到 [0, 1] 后取 gamma 2.0
+    struct ToneMapping {
+        enum class Operator { Clamp, Reinhard, ACES };
+        Operator op = Operator::Clamp;
+        double exposure = 0;
+        double gamma = 2.0;
+
+        double Apply(double linear) const;
+        Color Apply(const Color& linear) const { return Color(Apply(linear.x), Apply(linear.y), Apply(linear.z)); }
+    };
+
+    class Film;
+
+    // tile 的样本累加缓冲
+    // 覆盖 tile 向外扩展 Film::filter_padding 个像素的范围, 渲染线程把样本按滤波器权重累加到其中,
+    // tile 完成后由 Film::MergeTileBuffer 一次性合并到胶片; 相邻 tile 的边界像素只在合并时加锁
+    class FilmTileBuffer {
+    public:
+        struct Pixel {
+            double rgb_sum[3] = { 0, 0, 0 };
+            double weight_sum = 0;
+        };
+
+        // 清空缓冲并设置为 tile 对应的范围, 容量足够时不分配内存
+        void Reset(const Film& film, const FilmTile& tile);
+        // p_film 为样本在胶片上的连续像素坐标
+        void AddSample(const Film& film, const Point2& p_film, const Color& radiance);
+
+        int x_min = 0, y_min = 0, x_max = -1, y_max = -1;   // 胶片坐标, 边界包含在内
+        std::vector<Pixel> pixels;
+    };
+
     class Film {
     public:
         const int image_width = 512;
@@ -23,19 +71,89 @@ namespace Aokana {
         const int channels = 3;
         const int block_num = 2;
         const int tile_size = 16;
+        // 色调映射后的 8 位图像, 用于预览与 PNG 输出
         std::vector<unsigned char> data;
+        // 未经色调映射的线性 RGB 辐射度, 与 data 的排列相同
+        std::vector<float> radiance;
+        std::vector<FilmPixel> pixels;
         std::vector<FilmTile> tiles;
+        ToneMapping tone_mapping;
+        // 重建滤波器及其查找表; filter_padding 为样本能影响到的像素相对于样本所在像素的最大距离,
+        // 为 0 时样本只累加到所在的像素中, 不需要 FilmTileBuffer
+        std::shared_ptr<const Filter> filter;
+        FilterTable filter_table;
+        int filter_padding = 0;
+        // 裁剪窗口: 胶片只是 full_width x full_height 的完整图像中从 (crop_u, crop_v) 开始的一部分 (胶片坐标),
+        // 相机光线与采样器按完整图像中的坐标生成; 默认胶片就是完整图像
+        int full_width = 0, full_height = 0;
+        int crop_u = 0, crop_v = 0;
+        // 启用的 AOV, 没有启用时为 nullptr, 渲染时不产生任何开销
+        std::unique_ptr<AOVBuffers> aovs;
 
         Film() {
-            data = std::vector<unsigned char>(image_width * image_height * channels);
-            DivideTiles();
+            Allocate();
         }
         Film(int width, int height) : image_width(width), image_height(height) {
-            data = std::vector<unsigned char>(image_width * image_height * channels);
-            DivideTiles();
+            Allocate();
         }
         void DivideTiles();
-        void WriteColor(Color PIxel_color, int u, int v);
+        void SetFilter(std::shared_ptr<const Filter> filter);
+        void SetCropWindow(int full_width, int full_height, int crop_u, int crop_v) {
+            this->full_width = full_width;
+            this->full_height = full_height;
+            this->crop_u = crop_u;
+            this->crop_v = crop_v;
+        }
+        // 清除所有样本与输出, 保留滤波器, 裁剪窗口, 色调映射与启用的 AOV, 用于在同一胶片上渲染下一帧
+        void Clear();
+        // flags 为 AOVFlags 的组合, 为 0 时关闭 AOV
+        void EnableAOVs(uint32_t flags) { aovs = flags ? std::make_unique<AOVBuffers>(image_width, image_height, flags) : nullptr; }
+        // 保存像素 (u, v) 的线性辐射度, 并把色调映射后的结果写入 8 位图像
+        void WriteColor(Color pixel_color, int u, int v);
+
+        // 输出图像坐标 (第 0 行在最上面) 下的线性辐射度
+        Color GetRadiance(int x, int y) const;
+        // 全部像素的线性辐射度, 逐行存储的 RGB float
+        std::vector<float> GetRadianceBuffer() const;
+        // 修改 tone_mapping 后重新生成 8 位图像
+        void UpdateToneMapping();
+
+        FilmPixel& GetPixel(int u, int v) { return pixels[v * image_width + u]; }
+        const FilmPixel& GetPixel(int u, int v) const { return pixels[v * image_width + u]; }
+        // 向像素 (u, v) 累加一个样本; 不同线程写入不同的像素时无需加锁
+        void AddSample(int u, int v, const Color& radiance, double weight = 1.0);
+        // 向像素 (u, v) 累加一个位于 p_film 的样本, 按滤波器加权; 只能在 filter_padding 为 0 时使用
+        void AddSample(int u, int v, const Point2& p_film, const Color& radiance) {
+            AddSample(u, v, radiance, filter_table.Evaluate(Point2(p_film.x - (u + 0.5), p_film.y - (v + 0.5))));
+        }
+        // 只更新像素 (u, v) 自己的样本数与亮度统计量, 颜色由 FilmTileBuffer 累加
+        void AddSampleStatistics(int u, int v, const Color& radiance);
+        // 把 tile 缓冲合并到胶片并更新其覆盖的像素的输出, 可以被多个线程同时调用
+        void MergeTileBuffer(const FilmTileBuffer& buffer);
+        // 合并另一组样本的统计量 (样本数, 亮度均值与 M2), 用于合并分布式渲染的结果
+        void MergeSampleStatistics(int u, int v, int sample_count, float luminance_mean, float luminance_m2);
+        // 像素当前的颜色估计 (加权平均)
+        Color GetPixelColor(int u, int v) const;
+        // 像素亮度均值估计的相对标准误差, 样本数不足 2 时返回无穷大
+        double RelativeError(int u, int v) const;
+        // 把像素的颜色估计写入 8 位输出图像
+        void ResolvePixel(int u, int v);
+        // tile 向外扩展 padding 个像素后在输出图像中的像素范围; 胶片的 v 轴向上, 输出图像的第 0 行在最上面, 边界包含在内
+        void GetImageRect(const FilmTile& tile, int& x_min, int& y_min, int& x_max, int& y_max, int padding = 0) const {
+            x_min = std::max(0, static_cast<int>(tile.u_min) - padding);
+            x_max = std::min(image_width - 1, static_cast<int>(tile.u_max) + padding);
+            y_min = std::max(0, image_height - 1 - static_cast<int>(tile.v_max) - padding);
+            y_max = std::min(image_height - 1, image_height - 1 - static_cast<int>(tile.v_min) + padding);
+        }
+        // 把 8 位输出图像中 [x_min, x_max] x [y_min, y_max] 的像素逐行复制到 dst (行距 dst_row_stride 字节).
+        // 复制时持有合并锁, 渲染中其他 tile 的 MergeTileBuffer 不会同时写入这些像素
+        void CopyImageRect(int x_min, int y_min, int x_max, int y_max, unsigned char* dst, size_t dst_row_stride) const;
+        // 按扩展名选择格式: .pfm, .exr (半精度) 保存线性辐射度, 其他扩展名保存色调映射后的 PNG
         void SaveImage(std::string path) const;
+
+    private:
+        void Allocate();
+
+        mutable std::mutex merge_mutex;
     };
 }
\ No newline at end of file
@@ -0,0 +1,69 @@
+#include "filter.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace Aokana {
+
+    double BoxFilter::Evaluate(const Point2& p) const {
+        return (std::abs(p.x) <= radius.x && std::abs(p.y) <= radius.y) ? 1 : 0;
+    }
+
+    double TriangleFilter::Evaluate(const Point2& p) const {
+        return std::max(0.0, radius.x - std::abs(p.x)) * std::max(0.0, radius.y - std::abs(p.y));
+    }
+
+    GaussianFilter::GaussianFilter(const Vector2& radius, double sigma) :
+        Filter(radius),
+        sigma(sigma),
+        exp_x(std::exp(-radius.x * radius.x / (2 * sigma * sigma))),
+        exp_y(std::exp(-radius.y * radius.y / (2 * sigma * sigma))) {}
+
+    double GaussianFilter::Gaussian(double x) const {
+        return std::exp(-x * x / (2 * sigma * sigma));
+    }
+
+    double GaussianFilter::Evaluate(const Point2& p) const {
+        return std::max(0.0, Gaussian(p.x) - exp_x) * std::max(0.0, Gaussian(p.y) - exp_y);
+    }
+
+    double MitchellFilter::Mitchell1D(double x) const {
+        x = std::abs(2 * x);
+        if (x > 2) return 0;
+        if (x > 1) {
+            return ((-b - 6 * c) * x * x * x + (6 * b + 30 * c) * x * x +
+                (-12 * b - 48 * c) * x + (8 * b + 24 * c)) * (1.0 / 6.0);
+        }
+        return ((12 - 9 * b - 6 * c) * x * x * x + (-18 + 12 * b + 6 * c) * x * x +
+            (6 - 2 * b)) * (1.0 / 6.0);
+    }
+
+    double MitchellFilter::Evaluate(const Point2& p) const {
+        return Mitchell1D(p.x / radius.x) * Mitchell1D(p.y / radius.y);
+    }
+
+    FilterTable::FilterTable(const Filter& filter) :
+        inv_radius_x(1.0 / filter.radius.x),
+        inv_radius_y(1.0 / filter.radius.y),
+        values(TABLE_WIDTH * TABLE_WIDTH) {
+        // 在每个格子的中心取值
+        for (int y = 0; y < TABLE_WIDTH; ++y) {
+            for (int x = 0; x < TABLE_WIDTH; ++x) {
+                Point2 p((x + 0.5) * filter.radius.x / TABLE_WIDTH, (y + 0.5) * filter.radius.y / TABLE_WIDTH);
+                values[y * TABLE_WIDTH + x] = filter.Evaluate(p);
+            }
+        }
+    }
+
+    std::shared_ptr<Filter> CreateFilter(const std::string& name, double radius) {
+        auto r = [radius](double default_radius) {
+            double value = radius > 0 ? radius : default_radius;
+            return Vector2(value, value);
+        };
+        if (name == "box") return std::make_shared<BoxFilter>(r(0.5));
+        if (name == "tent" || name == "triangle") return std::make_shared<TriangleFilter>(r(1.0));
+        if (name == "gaussian") return std::make_shared<GaussianFilter>(r(1.5));
+        if (name == "mitchell") return std::make_shared<MitchellFilter>(r(2.0));
+        return nullptr;
+    }
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "vec.h"
+
+namespace Aokana {
+
+    // 像素重建滤波器
+    // 样本在胶片上的位置为连续的像素坐标, 像素 (x, y) 的中心在 (x + 0.5, y + 0.5);
+    // 样本按滤波器在 (样本位置 - 像素中心) 处的值加权, 累加到半径内的所有像素中
+    // https://pbr-book.org/3ed-2018/Sampling_and_Reconstruction/Image_Reconstruction
+    class Filter {
+    public:
+        Filter(const Vector2& radius) : radius(radius) {}
+        virtual ~Filter() = default;
+
+        // p 为相对于像素中心的偏移, 半径之外为 0
+        virtual double Evaluate(const Point2& p) const = 0;
+
+        const Vector2 radius;
+    };
+
+    // 盒式滤波器, 半径为 0.5 时等价于对像素内的样本直接取平均
+    class BoxFilter : public Filter {
+    public:
+        BoxFilter(const Vector2& radius = Vector2(0.5, 0.5)) : Filter(radius) {}
+        virtual double Evaluate(const Point2& p) const override;
+    };
+
+    // 帐篷 (三角形) 滤波器
+    class TriangleFilter : public Filter {
+    public:
+        TriangleFilter(const Vector2& radius = Vector2(1, 1)) : Filter(radius) {}
+        virtual double Evaluate(const Point2& p) const override;
+    };
+
+    // 高斯滤波器, 减去半径处的值使其在边界处平滑地降为 0
+    class GaussianFilter : public Filter {
+    public:
+        GaussianFilter(const Vector2& radius = Vector2(1.5, 1.5), double sigma = 0.5);
+        virtual double Evaluate(const Point2& p) const override;
+
+    private:
+        double Gaussian(double x) const;
+
+        const double sigma;
+        const double exp_x, exp_y;
+    };
+
+    // Mitchell-Netravali 滤波器, 默认 B = C = 1/3; 有负的旁瓣, 比高斯滤波器更锐利
+    class MitchellFilter : public Filter {
+    public:
+        MitchellFilter(const Vector2& radius = Vector2(2, 2), double b = 1.0 / 3.0, double c = 1.0 / 3.0) :
+            Filter(radius), b(b), c(c) {}
+        virtual double Evaluate(const Point2& p) const override;
+
+    private:
+        double Mitchell1D(double x) const;
+
+        const double b, c;
+    };
+
+    // 预先计算的滤波器表, 只保存第一象限, 查表代替逐样本计算滤波器
+    class FilterTable {
+    public:
+        static constexpr int TABLE_WIDTH = 32;
+
+        FilterTable() = default;
+        explicit FilterTable(const Filter& filter);
+
+        // p 为相对于像素中心的偏移, 调用者保证 p 在滤波器半径之内
+        double Evaluate(const Point2& p) const {
+            int ix = std::min(static_cast<int>(std::abs(p.x) * inv_radius_x * TABLE_WIDTH), TABLE_WIDTH - 1);
+            int iy = std::min(static_cast<int>(std::abs(p.y) * inv_radius_y * TABLE_WIDTH), TABLE_WIDTH - 1);
+            return values[iy * TABLE_WIDTH + ix];
+        }
+
+    private:
+        double inv_radius_x = 0, inv_radius_y = 0;
+        std::vector<double> values;
+    };
+
+    // 按名字创建滤波器: "box", "tent", "gaussian", "mitchell"; radius <= 0 时使用默认半径, 未知的名字返回 nullptr
+    std::shared_ptr<Filter> CreateFilter(const std::string& name, double radius = 0);
+}
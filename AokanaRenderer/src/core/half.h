@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+namespace Aokana {
+
+    // IEEE 754 半精度浮点数 (binary16) 与 float 之间的转换
+    // 1 位符号, 5 位指数, 10 位尾数; 最大值 65504, 超出范围的值变为无穷大, 过小的值变为非规格化数或 0
+
+    inline uint16_t FloatToHalf(float f) {
+        uint32_t bits;
+        std::memcpy(&bits, &f, sizeof(bits));
+        uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+        uint32_t exponent = (bits >> 23) & 0xff;
+        uint32_t mantissa = bits & 0x7fffff;
+
+        // 无穷大与 NaN, NaN 保留一位尾数
+        if (exponent == 0xff) return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+
+        int half_exponent = static_cast<int>(exponent) - 127 + 15;
+        if (half_exponent >= 0x1f) return sign | 0x7c00;
+        if (half_exponent <= 0) {
+            // 非规格化数: 补上隐含的 1 后右移, 就近舍入
+            if (half_exponent < -10) return sign;
+            mantissa |= 0x800000;
+            int shift = 14 - half_exponent;
+            uint32_t half_mantissa = mantissa >> shift;
+            uint32_t remainder = mantissa & ((1u << shift) - 1);
+            uint32_t halfway = 1u << (shift - 1);
+            if (remainder > halfway || (remainder == halfway && (half_mantissa & 1))) ++half_mantissa;
+            return sign | static_cast<uint16_t>(half_mantissa);
+        }
+
+        // 就近舍入到偶数, 尾数进位时会自然地进位到指数 (可能得到无穷大)
+        uint32_t half = (static_cast<uint32_t>(half_exponent) << 10) | (mantissa >> 13);
+        uint32_t remainder = mantissa & 0x1fff;
+        if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1))) ++half;
+        return sign | static_cast<uint16_t>(half);
+    }
+
+    inline float HalfToFloat(uint16_t h) {
+        uint32_t sign = static_cast<uint32_t>(h & 0x8000) << 16;
+        uint32_t exponent = (h >> 10) & 0x1f;
+        uint32_t mantissa = h & 0x3ff;
+        uint32_t bits;
+        if (exponent == 0x1f) {
+            bits = sign | 0x7f800000 | (mantissa << 13);
+        }
+        else if (exponent != 0) {
+            bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+        }
+        else if (mantissa == 0) {
+            bits = sign;
+        }
+        else {
+            // 非规格化数: 规格化后写成 float
+            exponent = 127 - 15 + 1;
+            while ((mantissa & 0x400) == 0) {
+                mantissa <<= 1;
+                --exponent;
+            }
+            bits = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+        }
+        float f;
+        std::memcpy(&f, &bits, sizeof(f));
+        return f;
+    }
+}
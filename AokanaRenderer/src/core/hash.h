@@ -66,6 +66,7 @@ namespace Aokana {
 		return v;
 	}
 
+	// size 为字节数
 	template <typename T>
 	inline uint64_t HashBuffer(const T* ptr, size_t size, uint64_t seed = 0) {
 		return MurmurHash64A((const unsigned char*)ptr, size, seed);
@@ -83,7 +84,7 @@ namespace Aokana {
 	template <typename T, typename... Args>
 	inline void HashRecursiveCopy(char* buf, T v, Args... args) {
 		memcpy(buf, &v, sizeof(T));
-		hashRecursiveCopy(buf + sizeof(T), args...);
+		HashRecursiveCopy(buf + sizeof(T), args...);
 	}
 
 	template <typename... Args>
@@ -92,7 +93,7 @@ namespace Aokana {
 		constexpr size_t sz = (sizeof(Args) + ... + 0);
 		constexpr size_t n = (sz + 7) / 8;
 		uint64_t buf[n];
-		hashRecursiveCopy((char*)buf, args...);
+		HashRecursiveCopy((char*)buf, args...);
 		return MurmurHash64A((const unsigned char*)buf, sz, 0);
 	}
 
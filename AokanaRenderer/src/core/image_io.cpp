@@ -0,0 +1,167 @@
+#include "image_io.h"
+#include "half.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+namespace Aokana {
+
+    namespace {
+
+        // 两种格式都规定为小端字节序
+        bool IsLittleEndian() {
+            const uint16_t one = 1;
+            unsigned char first;
+            std::memcpy(&first, &one, 1);
+            return first == 1;
+        }
+
+        template <typename T>
+        void AppendLittleEndian(std::vector<char>& out, T value) {
+            unsigned char bytes[sizeof(T)];
+            std::memcpy(bytes, &value, sizeof(T));
+            if (!IsLittleEndian()) std::reverse(bytes, bytes + sizeof(T));
+            out.insert(out.end(), bytes, bytes + sizeof(T));
+        }
+
+        void AppendString(std::vector<char>& out, const char* s) {
+            out.insert(out.end(), s, s + std::strlen(s) + 1);
+        }
+
+        // EXR 头部的一个属性: 名字, 类型, 值的字节数, 值
+        void AppendAttribute(std::vector<char>& out, const char* name, const char* type, const std::vector<char>& value) {
+            AppendString(out, name);
+            AppendString(out, type);
+            AppendLittleEndian<int32_t>(out, static_cast<int32_t>(value.size()));
+            out.insert(out.end(), value.begin(), value.end());
+        }
+
+        std::vector<char> Box2i(int x_min, int y_min, int x_max, int y_max) {
+            std::vector<char> value;
+            AppendLittleEndian<int32_t>(value, x_min);
+            AppendLittleEndian<int32_t>(value, y_min);
+            AppendLittleEndian<int32_t>(value, x_max);
+            AppendLittleEndian<int32_t>(value, y_max);
+            return value;
+        }
+    }
+
+    bool WritePFM(const std::string& path, int width, int height, const float* rgb, int channels) {
+        std::ofstream file(path, std::ios::binary);
+        if (!file) {
+            std::cerr << "[ERROR] Failed to open \"" << path << "\" for writing." << std::endl;
+            return false;
+        }
+        // 比例因子为负表示小端; PFM 的扫描线从下往上存储
+        file << (channels == 1 ? "Pf\n" : "PF\n") << width << " " << height << "\n-1.0\n";
+        std::vector<char> row;
+        row.reserve(static_cast<size_t>(width) * channels * sizeof(float));
+        for (int y = height - 1; y >= 0; --y) {
+            row.clear();
+            const float* src = rgb + static_cast<size_t>(y) * width * channels;
+            for (int i = 0; i < width * channels; ++i) AppendLittleEndian<float>(row, src[i]);
+            file.write(row.data(), row.size());
+        }
+        return static_cast<bool>(file);
+    }
+
+    EXRScanlineWriter::EXRScanlineWriter(const std::string& path, int width, int height, bool half_float) :
+        path(path), width(width), height(height), half_float(half_float) {
+        // https://openexr.com/en/latest/OpenEXRFileLayout.html
+        constexpr int32_t EXR_PIXEL_TYPE_HALF = 1;
+        constexpr int32_t EXR_PIXEL_TYPE_FLOAT = 2;
+        const int32_t pixel_type = half_float ? EXR_PIXEL_TYPE_HALF : EXR_PIXEL_TYPE_FLOAT;
+        const size_t channel_bytes = half_float ? sizeof(uint16_t) : sizeof(float);
+
+        std::vector<char> header;
+        AppendLittleEndian<uint32_t>(header, 20000630);     // magic
+        AppendLittleEndian<uint32_t>(header, 2);            // 版本 2, 单层扫描线
+
+        // 通道按名字的字母顺序排列, 像素数据也按这个顺序存储
+        const char* channel_names[3] = { "B", "G", "R" };
+        std::vector<char> channels;
+        for (const char* name : channel_names) {
+            AppendString(channels, name);
+            AppendLittleEndian<int32_t>(channels, pixel_type);
+            AppendLittleEndian<uint8_t>(channels, 0);       // pLinear
+            channels.insert(channels.end(), 3, 0);          // reserved
+            AppendLittleEndian<int32_t>(channels, 1);       // xSampling
+            AppendLittleEndian<int32_t>(channels, 1);       // ySampling
+        }
+        channels.push_back(0);
+        AppendAttribute(header, "channels", "chlist", channels);
+        AppendAttribute(header, "compression", "compression", { 0 });
+        AppendAttribute(header, "dataWindow", "box2i", Box2i(0, 0, width - 1, height - 1));
+        AppendAttribute(header, "displayWindow", "box2i", Box2i(0, 0, width - 1, height - 1));
+        AppendAttribute(header, "lineOrder", "lineOrder", { 0 });   // INCREASING_Y
+        std::vector<char> value;
+        AppendLittleEndian<float>(value, 1.0f);
+        AppendAttribute(header, "pixelAspectRatio", "float", value);
+        value.clear();
+        AppendLittleEndian<float>(value, 0.0f);
+        AppendLittleEndian<float>(value, 0.0f);
+        AppendAttribute(header, "screenWindowCenter", "v2f", value);
+        value.clear();
+        AppendLittleEndian<float>(value, 1.0f);
+        AppendAttribute(header, "screenWindowWidth", "float", value);
+        header.push_back(0);
+
+        // 不压缩时每个块是一条扫描线: y 坐标, 数据字节数, 然后依次是各通道的一行像素;
+        // 块的大小固定, 偏移表可以在写入像素之前算出, 因此整个文件可以顺序写入
+        line_data_size = static_cast<size_t>(width) * 3 * channel_bytes;
+        const size_t block_size = sizeof(int32_t) * 2 + line_data_size;
+        uint64_t offset = header.size() + sizeof(uint64_t) * static_cast<size_t>(height);
+        for (int y = 0; y < height; ++y) {
+            AppendLittleEndian<uint64_t>(header, offset);
+            offset += block_size;
+        }
+
+        file.open(path, std::ios::binary);
+        if (!file) {
+            std::cerr << "[ERROR] Failed to open \"" << path << "\" for writing." << std::endl;
+            return;
+        }
+        file.write(header.data(), header.size());
+        block.reserve(block_size);
+    }
+
+    bool EXRScanlineWriter::WriteScanlines(const float* rgb, int count) {
+        if (!file || next_y + count > height) return false;
+        const int channel_offsets[3] = { 2, 1, 0 };     // B, G, R
+        for (int line = 0; line < count; ++line, ++next_y) {
+            block.clear();
+            AppendLittleEndian<int32_t>(block, next_y);
+            AppendLittleEndian<int32_t>(block, static_cast<int32_t>(line_data_size));
+            const float* src = rgb + static_cast<size_t>(line) * width * 3;
+            for (int c = 0; c < 3; ++c) {
+                for (int x = 0; x < width; ++x) {
+                    float v = src[x * 3 + channel_offsets[c]];
+                    if (half_float) AppendLittleEndian<uint16_t>(block, FloatToHalf(v));
+                    else AppendLittleEndian<float>(block, v);
+                }
+            }
+            file.write(block.data(), block.size());
+        }
+        return static_cast<bool>(file);
+    }
+
+    bool EXRScanlineWriter::Finish() {
+        if (!file) return false;
+        if (next_y != height) {
+            std::cerr << "[ERROR] \"" << path << "\" is incomplete: " << next_y << "/" << height << " scanlines written." << std::endl;
+            file.close();
+            return false;
+        }
+        file.close();
+        return !file.fail();
+    }
+
+    bool WriteEXR(const std::string& path, int width, int height, const float* rgb, bool half_float) {
+        EXRScanlineWriter writer(path, width, height, half_float);
+        return writer.WriteScanlines(rgb, height) && writer.Finish();
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace Aokana {
+
+    // 高动态范围图像的输出, 保存未经色调映射的线性辐射度, 供后期合成或多个渲染任务的结果合并使用
+    // rgb 为逐行存储的 RGB 三通道 float, 第 0 行是图像最上面一行; 写入失败时返回 false
+
+    // Portable Float Map, 小端 32 位 float; channels 为 1 时写入单通道的灰度图
+    bool WritePFM(const std::string& path, int width, int height, const float* rgb, int channels = 3);
+
+    // OpenEXR 单层扫描线图像, 不压缩; half_float 为 true 时每个通道以 16 位半精度存储
+    bool WriteEXR(const std::string& path, int width, int height, const float* rgb, bool half_float = true);
+
+    // 逐条扫描线顺序写入的 OpenEXR 文件, 内存中只保留一条扫描线, 用于输出无法整幅放入内存的图像
+    // 扫描线必须从最上面一行开始按顺序写入, 全部写完后调用 Finish
+    class EXRScanlineWriter {
+    public:
+        EXRScanlineWriter(const std::string& path, int width, int height, bool half_float = true);
+
+        bool IsOpen() const { return file.is_open() && file.good(); }
+        // 写入接下来的 count 条扫描线, rgb 为逐行存储的 RGB 三通道 float
+        bool WriteScanlines(const float* rgb, int count);
+        bool Finish();
+
+        int NextScanline() const { return next_y; }
+
+    private:
+        std::string path;
+        int width, height;
+        bool half_float;
+        size_t line_data_size = 0;
+        int next_y = 0;
+        std::ofstream file;
+        std::vector<char> block;
+    };
+}
@@ -1,27 +1,113 @@
 #include "integrator.h"
 #include "thread_pool.h"
+#include "checkpoint.h"
+#include "tile_scheduler.h"
+#include "topology.h"
+#include "mpsc_queue.h"
+#include "shared_preview.h"
+#include "image_io.h"
 
 #include "../ui/ui.h"
 
+#include <algorithm>
 #include <chrono>
+#include <climits>
+#include <cstdio>
+#include <deque>
+#include <functional>
 #include <thread>
 
 namespace Aokana {
 
-    Color SamplerIntegrator::Li(const Ray& ray, const Color& background, int depth) {
+    namespace {
+
+        // 滤波器会影响相邻像素时返回当前线程的 tile 缓冲 (已设置为 tile 的范围), 否则返回 nullptr
+        FilmTileBuffer* BeginTileBuffer(const Film& film, const FilmTile& tile) {
+            if (film.filter_padding == 0) return nullptr;
+            thread_local FilmTileBuffer buffer;
+            buffer.Reset(film, tile);
+            return &buffer;
+        }
+
+        // 把帧号代入输出路径的模式. 模式中必须恰好有一个 %d 或 %0Nd, 可以用 %% 表示 %, 其他 % 开头的格式返回 false;
+        // 帧号由这里插入, 不把用户给出的路径当作 printf 的格式字符串
+        bool FormatFramePath(const std::string& pattern, int frame, std::string& path) {
+            path.clear();
+            int conversions = 0;
+            for (size_t i = 0; i < pattern.size(); ++i) {
+                if (pattern[i] != '%') {
+                    path += pattern[i];
+                    continue;
+                }
+                if (++i < pattern.size() && pattern[i] == '%') {
+                    path += '%';
+                    continue;
+                }
+                size_t width = 0;
+                if (i < pattern.size() && pattern[i] == '0') {
+                    while (++i < pattern.size() && pattern[i] >= '0' && pattern[i] <= '9' && width < 100) width = width * 10 + (pattern[i] - '0');
+                    if (width == 0) return false;
+                }
+                if (i >= pattern.size() || pattern[i] != 'd' || ++conversions > 1) return false;
+                std::string digits = std::to_string(frame < 0 ? -static_cast<long long>(frame) : frame);
+                const size_t length = digits.size() + (frame < 0 ? 1 : 0);
+                if (frame < 0) path += '-';
+                if (width > length) path.append(width - length, '0');
+                path += digits;
+            }
+            return conversions == 1;
+        }
+    }
+
+    Color SamplerIntegrator::Li(const Ray& ray, const Color& background, int depth, Sampler& sampler, AOVSample* aov) {
         if (depth <= 0) return Color(0, 0, 0);
         SurfaceInteraction isect;
-        if (!scene->IntersectP(ray, isect)) return background;
+        if (aov != nullptr) aov->time = ray.time;
+        if (!scene->IntersectP(ray, isect)) {
+            if (aov != nullptr) aov->albedo = background;
+            return background;
+        }
         Ray scattered;
         Color attenuation;
         Color emitted = isect.material->Emitted(isect.uv.u(), isect.uv.v(), isect.p);
-        if (!isect.material->Scatter(ray, isect, attenuation, scattered))
+        bool is_scattered = isect.material->Scatter(ray, isect, attenuation, scattered, sampler);
+        if (aov != nullptr) {
+            aov->hit = true;
+            aov->depth = (isect.p - ray.origin).Length();
+            aov->normal = isect.normal;
+            aov->albedo = is_scattered ? attenuation : emitted;
+            aov->material_id = isect.material->id;
+            aov->primitive_id = isect.primitive != nullptr ? isect.primitive->id : 0;
+        }
+        if (!is_scattered)
             return emitted;
 
-        return emitted + PairwiseMul(attenuation, Li(scattered, background, depth - 1));
+        return emitted + PairwiseMul(attenuation, Li(scattered, background, depth - 1, sampler, nullptr));
     }
 
 
+    void SamplerIntegrator::RenderPixelSamples(Sampler& pixel_sampler, Film& film, int x, int y, int sample_count,
+        FilmTileBuffer* tile_buffer, int first_sample) {
+        Camera& camera = scene->camera;
+        if (first_sample < 0) first_sample = film.GetPixel(x, y).sample_count;
+        for (int sample_index = first_sample; sample_index < first_sample + sample_count; ++sample_index) {
+            // 采样器按完整图像中的像素坐标取样本, 裁剪窗口的结果与渲染整幅图像时一致
+            pixel_sampler.StartPixelSample(film.crop_u + x, film.crop_v + y, sample_index);
+            CameraSample camera_sample = GetCameraSample(pixel_sampler, x, y, film);
+            Ray ray = camera.GetRay(camera_sample);
+            AOVSample aov;
+            Color radiance = Li(ray, scene->background, max_depth, pixel_sampler, film.aovs ? &aov : nullptr);
+            if (film.aovs) film.aovs->AddSample(x, y, aov);
+            if (tile_buffer != nullptr) {
+                film.AddSampleStatistics(x, y, radiance);
+                tile_buffer->AddSample(film, camera_sample.pixel_point, radiance);
+            }
+            else {
+                film.AddSample(x, y, camera_sample.pixel_point, radiance);
+            }
+        }
+    }
+
     void SamplerIntegrator::Render() {
         Camera& camera = scene->camera;
 
@@ -30,21 +116,12 @@ namespace Aokana {
         std::shared_ptr<Film> film = camera.film;
 
         const int total_PIxel = film->image_width * film->image_height;
+        FilmTileBuffer* tile_buffer = BeginTileBuffer(*film, FilmTile(0, 0, film->image_width - 1, film->image_height - 1));
 
         for (int j = 0; j < film->image_height;++j) {
             for (int i = 0;i < film->image_width;++i) {
-                Color radiance;
-                auto samples = sampler->Sampling();
-                for (auto& sample : samples) {
-                    sample.u = static_cast<double>(i + sample.u) / static_cast<double>(film->image_width - 1);
-                    sample.v = static_cast<double>(j + sample.v) / static_cast<double>(film->image_height - 1);
-                    Ray ray = camera.GetRay(sample);
-                    Color r = Li(ray, scene->background, max_depth);
-                    radiance += r;
-                }
-                radiance /= static_cast<double>(sampler->samples_per_pixel);
-                radiance = Clamp(radiance);
-                film->WriteColor(radiance, i, j);
+                RenderPixelSamples(*sampler, *film, i, j, sampler->samples_per_pixel, tile_buffer);
+                if (tile_buffer == nullptr) film->ResolvePixel(i, j);
 
                 int index = j * film->image_width + i;
                 if ((index + 1) % (total_PIxel / 20) == 0) {
@@ -54,6 +131,8 @@ namespace Aokana {
             }
         }
 
+        if (tile_buffer != nullptr) film->MergeTileBuffer(*tile_buffer);
+
         auto end_time = std::chrono::system_clock::now();
         auto duration = std::chrono::duration_cast<std::chrono::seconds>(end_time - start_time);
 
@@ -62,27 +141,232 @@ namespace Aokana {
     }
 
     void SamplerIntegrator::RenderOneTile(const FilmTile& tile) {
-        Camera& camera = scene->camera;
+        // 采样器是有状态的, 每个 tile 使用自己的副本; 像素循环内不再分配内存
+        std::unique_ptr<Sampler> tile_sampler = sampler->Clone();
+        RenderTile(*tile_sampler, *scene->camera.film, tile);
+    }
 
-        std::shared_ptr<Film> film = camera.film;
+    void SamplerIntegrator::RenderTile(Sampler& tile_sampler, Film& film, const FilmTile& tile) {
+        if (adaptive_sampling) {
+            RenderTileAdaptive(tile_sampler, film, tile);
+            return;
+        }
+        RenderTileSamples(tile_sampler, film, tile, tile_sampler.samples_per_pixel);
+    }
 
+    void SamplerIntegrator::RenderTileAdaptive(Sampler& tile_sampler, Film& film, const FilmTile& tile) {
+        // samples_per_pixel 是平均预算 (至少为 2, 以便估计方差): tile 内的样本总数不超过 samples_per_pixel * 像素数
+        const int spp = std::max(2, tile_sampler.samples_per_pixel);
+        const int min_spp = std::clamp(adaptive_min_spp > 0 ? adaptive_min_spp : spp / 4, 2, spp);
+        const int max_spp = std::max(spp, adaptive_max_spp > 0 ? adaptive_max_spp : 4 * spp);
+        const int u_min = static_cast<int>(tile.u_min), v_min = static_cast<int>(tile.v_min);
+        const int tile_width = static_cast<int>(tile.u_max) - u_min + 1;
+        const long long pixel_count = static_cast<long long>(tile_width) * (static_cast<int>(tile.v_max) - v_min + 1);
+        long long budget = pixel_count * (spp - min_spp);
+        FilmTileBuffer* tile_buffer = BeginTileBuffer(film, tile);
+
+        // 第一轮: 所有像素取 min_spp 个样本, 得到方差估计
         for (int j = static_cast<int>(tile.v_min); j <= tile.v_max;++j) {
             for (int i = static_cast<int>(tile.u_min);i <= tile.u_max;++i) {
-                Color radiance;
-                auto samples = sampler->Sampling();
-                for (auto& sample : samples) {
-                    sample.u = static_cast<double>(i + sample.u) / static_cast<double>(film->image_width - 1);
-                    sample.v = static_cast<double>(j + sample.v) / static_cast<double>(film->image_height - 1);
-                    Ray ray = camera.GetRay(sample);
-                    Color r = Li(ray, scene->background, max_depth);
-                    radiance += r;
+                RenderPixelSamples(tile_sampler, film, i, j, min_spp, tile_buffer);
+            }
+        }
+
+        // 之后每轮只对未收敛的像素把样本数翻倍, 误差大的像素优先使用剩余的预算;
+        // adaptive_min_spp 为 2 的幂时样本数也保持 2 的幂, 不破坏低差异序列前缀的分层性质
+        std::vector<std::pair<double, int>> active_pixels;
+        while (budget > 0) {
+            active_pixels.clear();
+            for (int j = static_cast<int>(tile.v_min); j <= tile.v_max;++j) {
+                for (int i = static_cast<int>(tile.u_min);i <= tile.u_max;++i) {
+                    double error = film.RelativeError(i, j);
+                    if (film.GetPixel(i, j).sample_count >= max_spp || error <= adaptive_threshold) continue;
+                    active_pixels.emplace_back(error, (j - v_min) * tile_width + (i - u_min));
                 }
-                radiance /= static_cast<double>(sampler->samples_per_pixel);
-                radiance = Clamp(radiance);
-                film->WriteColor(radiance, i, j);
             }
+            if (active_pixels.empty()) break;
+            std::sort(active_pixels.begin(), active_pixels.end(), std::greater<>());
+            for (const auto& [error, index] : active_pixels) {
+                const int i = u_min + index % tile_width, j = v_min + index / tile_width;
+                const int sample_count = film.GetPixel(i, j).sample_count;
+                const int added = static_cast<int>(std::min<long long>(std::min(sample_count, max_spp - sample_count), budget));
+                if (added <= 0) break;
+                RenderPixelSamples(tile_sampler, film, i, j, added, tile_buffer);
+                budget -= added;
+            }
+        }
+
+        if (tile_buffer != nullptr) {
+            film.MergeTileBuffer(*tile_buffer);
+            return;
+        }
+        for (int j = static_cast<int>(tile.v_min); j <= tile.v_max;++j) {
+            for (int i = static_cast<int>(tile.u_min);i <= tile.u_max;++i) {
+                film.ResolvePixel(i, j);
+            }
+        }
+    }
+
+    void SamplerIntegrator::ReportSampleCounts(const Film& film) const {
+        long long total_samples = 0;
+        int min_samples = INT_MAX, max_samples = 0;
+        for (const auto& pixel : film.pixels) {
+            total_samples += pixel.sample_count;
+            min_samples = std::min(min_samples, pixel.sample_count);
+            max_samples = std::max(max_samples, pixel.sample_count);
+        }
+        double average = static_cast<double>(total_samples) / film.pixels.size();
+        std::cout << "[INFO] Adaptive sampling: " << average << " spp on average (min " << min_samples
+            << ", max " << max_samples << ")." << std::endl;
+    }
+
+    void SamplerIntegrator::RenderTilePass(const FilmTile& tile, int sample_count) {
+        std::unique_ptr<Sampler> tile_sampler = sampler->Clone();
+        RenderTileSamples(*tile_sampler, *scene->camera.film, tile, sample_count);
+    }
+
+    void SamplerIntegrator::RenderTileSamples(Sampler& tile_sampler, Film& film, const FilmTile& tile, int sample_count) {
+        // 样本编号从像素已有的样本数继续, 因此多次渲染的结果与一次渲染同样数量的样本完全一致
+        FilmTileBuffer* tile_buffer = BeginTileBuffer(film, tile);
+        for (int j = static_cast<int>(tile.v_min); j <= tile.v_max;++j) {
+            for (int i = static_cast<int>(tile.u_min);i <= tile.u_max;++i) {
+                RenderPixelSamples(tile_sampler, film, i, j, sample_count, tile_buffer);
+                if (tile_buffer == nullptr) film.ResolvePixel(i, j);
+            }
+        }
+        if (tile_buffer != nullptr) film.MergeTileBuffer(*tile_buffer);
+    }
+
+    bool SamplerIntegrator::RenderAnimation(int first_frame, int last_frame, const std::string& output_pattern) {
+        if (scene->animation == nullptr) {
+            std::cerr << "[ERROR] The scene has no animation." << std::endl;
+            return false;
+        }
+        std::string path;
+        if (!FormatFramePath(output_pattern, first_frame, path)) {
+            std::cerr << "[ERROR] Output pattern \"" << output_pattern << "\" must contain exactly one %d or %0Nd (use %% for a literal %)." << std::endl;
+            return false;
+        }
+        // 每帧都从头渲染, 检查点只对单帧有意义
+        if (!checkpoint_path.empty()) {
+            std::cerr << "[ERROR] Checkpoints are ignored when rendering an animation." << std::endl;
+        }
+        const std::string saved_checkpoint_path = checkpoint_path;
+        checkpoint_path.clear();
+
+        std::shared_ptr<Film> film = scene->camera.film;
+        auto start_time = std::chrono::steady_clock::now();
+        for (int frame = first_frame; frame <= last_frame; ++frame) {
+            auto frame_start = std::chrono::steady_clock::now();
+            scene->animation->SetTime(*scene, scene->animation->FrameTime(frame));
+            film->Clear();
+            auto setup_end = std::chrono::steady_clock::now();
+
+            RenderWithMultithreading(false);
+
+            FormatFramePath(output_pattern, frame, path);
+            film->SaveImage(path);
+            if (film->aovs) film->aovs->Save(path.substr(0, path.find_last_of('.')), *film);
+
+            auto frame_end = std::chrono::steady_clock::now();
+            std::cout << "[INFO] Frame " << frame << " (" << frame - first_frame + 1 << "/" << last_frame - first_frame + 1
+                << ") finished in " << std::chrono::duration<double>(frame_end - frame_start).count() << " s, scene update "
+                << std::chrono::duration<double, std::milli>(setup_end - frame_start).count() << " ms." << std::endl;
+        }
+        std::cout << "[INFO] Animation finished in "
+            << std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count() << " s." << std::endl;
+        checkpoint_path = saved_checkpoint_path;
+        return true;
+    }
+
+    void SamplerIntegrator::RenderTileSampleRange(Sampler& tile_sampler, Film& film, const FilmTile& tile,
+        int first_sample, int sample_count, FilmTileBuffer& tile_buffer) {
+        for (int j = static_cast<int>(tile.v_min); j <= tile.v_max; ++j) {
+            for (int i = static_cast<int>(tile.u_min); i <= tile.u_max; ++i) {
+                RenderPixelSamples(tile_sampler, film, i, j, sample_count, &tile_buffer, first_sample);
+            }
+        }
+    }
+
+    std::unique_ptr<BS::work_stealing_pool> SamplerIntegrator::CreateWorkerPool(std::vector<int>& worker_cpus, int& node_count) const {
+        worker_cpus.clear();
+        node_count = 1;
+        if (!pin_threads && !numa_aware) return std::make_unique<BS::work_stealing_pool>();
+
+        CpuTopology topology = DetectCpuTopology();
+        std::vector<BS::concurrency_t> worker_nodes;
+        for (int node = 0; node < topology.NodeCount(); ++node) {
+            for (int cpu : topology.node_cpus[node]) {
+                worker_cpus.push_back(cpu);
+                worker_nodes.push_back(numa_aware ? node : 0);
+            }
+        }
+        if (numa_aware) node_count = topology.NodeCount();
+        std::cout << "[INFO] " << worker_cpus.size() << " workers on " << topology.NodeCount() << " NUMA node(s)"
+            << (pin_threads ? ", pinned." : ".") << std::endl;
+
+        std::function<void(BS::concurrency_t)> worker_init;
+        if (pin_threads) {
+            worker_init = [cpus = worker_cpus](BS::concurrency_t index) {
+                if (!PinCurrentThreadToCpu(cpus[index])) {
+                    std::cerr << "[ERROR] Failed to pin worker " << index << " to cpu " << cpus[index] << "." << std::endl;
+                }
+            };
         }
+        return std::make_unique<BS::work_stealing_pool>(worker_nodes, worker_init);
+    }
+
+    BS::work_stealing_pool& SamplerIntegrator::AcquireWorkerPool(std::vector<int>& worker_cpus, int& node_count) {
+        if (worker_pool == nullptr || worker_pool_pinned != pin_threads || worker_pool_numa_aware != numa_aware) {
+            // 先销毁旧的线程池, 避免两组线程同时存在
+            worker_pool.reset();
+            worker_pool = CreateWorkerPool(worker_pool_cpus, worker_pool_nodes);
+            worker_pool_pinned = pin_threads;
+            worker_pool_numa_aware = numa_aware;
+        }
+        worker_cpus = worker_pool_cpus;
+        node_count = worker_pool_nodes;
+        return *worker_pool;
+    }
+
+    namespace {
+
+        // 把 tile 对应的区域复制到预览纹理的流式上传缓冲中, 本帧的缓冲已满时返回 false
+        bool StreamTile(UI::Image& image, const Film& film, const FilmTile& tile) {
+            // 滤波器跨越像素时 tile 的样本也会更新周围的像素, 这些像素可能正在被相邻的 tile 合并, 因此先在锁内复制一份
+            int x_min, y_min, x_max, y_max;
+            film.GetImageRect(tile, x_min, y_min, x_max, y_max, film.filter_padding);
+            const size_t row_bytes = static_cast<size_t>(x_max - x_min + 1) * 3;
+            thread_local std::vector<unsigned char> pixels;
+            pixels.resize(row_bytes * (y_max - y_min + 1));
+            film.CopyImageRect(x_min, y_min, x_max, y_max, pixels.data(), row_bytes);
+            return image.StreamSubimage(x_min, y_min, x_max, y_max, pixels.data(), row_bytes);
+        }
+    }
 
+    void SamplerIntegrator::EstimateTileCosts(BS::work_stealing_pool& pool, TileScheduler& scheduler) {
+        Camera& camera = scene->camera;
+        std::shared_ptr<Film> film = camera.film;
+
+        // 每 4x4 个像素取一个样本, 只计时, 结果不写入胶片
+        constexpr int stride = 4;
+        pool.parallel_for(0, static_cast<int>(film->tiles.size()), [&](int begin, int end) {
+            std::unique_ptr<Sampler> prepass_sampler = sampler->Clone();
+            for (int index = begin; index < end; ++index) {
+                const FilmTile& tile = film->tiles[index];
+                auto tile_start = std::chrono::steady_clock::now();
+                for (int j = static_cast<int>(tile.v_min); j <= tile.v_max; j += stride) {
+                    for (int i = static_cast<int>(tile.u_min); i <= tile.u_max; i += stride) {
+                        prepass_sampler->StartPixelSample(i, j, 0);
+                        Ray ray = camera.GetRay(GetCameraSample(*prepass_sampler, i, j, *film));
+                        Li(ray, scene->background, max_depth, *prepass_sampler);
+                    }
+                }
+                auto tile_end = std::chrono::steady_clock::now();
+                // 加上一个很小的常数, 保证代价为正
+                scheduler.tile_costs[index] = std::chrono::duration<double, std::milli>(tile_end - tile_start).count() + 1e-6;
+            }
+        });
     }
 
     void SamplerIntegrator::RenderWithMultithreading(bool enable_gui) {
@@ -91,90 +375,226 @@ namespace Aokana {
         std::cout << "[INFO] Rendering start." << std::endl;
         auto start_time = std::chrono::system_clock::now();
 
-        BS::thread_pool pool;
+        std::vector<int> worker_cpus;
+        int node_count = 1;
+        BS::work_stealing_pool& pool = AcquireWorkerPool(worker_cpus, node_count);
         std::shared_ptr<Film> film = camera.film;
 
-        if (enable_gui) {
-            GLFWwindow* window = UI::CreateGUIWindow();
-            std::shared_ptr<UI::Image> image = std::make_shared<UI::Image>(film->image_width, film->image_height);
-
-            std::vector<int> flags(film->tiles.size());
+        // 每个工作线程的状态由该线程自己创建 (first touch), 在 NUMA 系统上分配在线程所在节点的内存中
+        struct WorkerState {
+            std::unique_ptr<Sampler> sampler;
+            long long samples = 0;
+            double busy_seconds = 0;
+        };
+        std::vector<WorkerState> worker_states(pool.get_thread_count());
+
+        // 渐进渲染时把 samples_per_pixel 分成若干遍, 每遍对整幅图像的每个像素取 progressive_spp_per_pass 个样本;
+        // 限时渲染时第一遍用于测量吞吐量, 之后每遍的样本数按剩余时间估计, 直到截止时间
+        const bool time_budgeted = time_budget_seconds > 0;
+        const bool incremental = progressive || time_budgeted;
+        const int total_spp = sampler->samples_per_pixel;
+        const int spp_per_pass = incremental ? std::max(1, progressive_spp_per_pass) : total_spp;
+
+        // 检查点同时记录渲染进度: 已完成的遍的样本数, 当前遍的样本数以及当前遍中完成的 tile
+        CheckpointSettings checkpoint_settings;
+        checkpoint_settings.samples_per_pixel = total_spp;
+        checkpoint_settings.sampler = sampler->Name();
+        checkpoint_settings.sampler_seed = sampler->Seed();
+        checkpoint_settings.adaptive_sampling = adaptive_sampling && !incremental;
+        checkpoint_settings.adaptive_threshold = adaptive_threshold;
+        checkpoint_settings.adaptive_min_spp = adaptive_min_spp;
+        checkpoint_settings.adaptive_max_spp = adaptive_max_spp;
+        RenderCheckpoint checkpoint(*film, checkpoint_settings, checkpoint_path, checkpoint_interval_seconds);
+        const bool resumed = resume_from_checkpoint && checkpoint.Resume(*film);
+        // 自适应采样在整个 tile 内分配样本, 不能把 tile 分成单独的行
+        TileScheduler scheduler(*film, node_count, incremental || !adaptive_sampling);
+        int& rendered_spp = checkpoint.rendered_spp;
+        int session_spp = 0;    // 本次运行中完成的样本数, 用于估计吞吐量
+        double milliseconds_per_spp = 0;
+
+        // 返回下一遍每个像素的样本数, 返回 0 表示渲染结束
+        auto plan_next_pass = [&]() -> int {
+            if (!incremental) return rendered_spp == 0 ? total_spp : 0;
+            if (!time_budgeted) return std::max(0, std::min(spp_per_pass, total_spp - rendered_spp));
+            if (session_spp == 0) return spp_per_pass;
+
+            auto now = std::chrono::system_clock::now();
+            double elapsed = std::chrono::duration<double, std::milli>(now - start_time).count();
+            double remaining = time_budget_seconds * 1000.0 - elapsed;
+            // 留 5% 的余量以免超时; 每遍最多让样本数翻倍, 保证预览按时更新
+            int affordable = static_cast<int>(0.95 * remaining / milliseconds_per_spp);
+            return std::max(0, std::min(affordable, rendered_spp));
+        };
+
+        // 完成的 tile 的编号, 由 GUI 线程取出并上传到预览纹理
+        MPSCQueue<int> completed_tiles;
+        // 不使用 GUI 时可以通过共享内存把完成的 tile 发布给独立的预览进程
+        std::unique_ptr<SharedPreviewWriter> shared_preview;
+        if (!enable_gui && !shared_preview_name.empty()) {
+            shared_preview = std::make_unique<SharedPreviewWriter>(shared_preview_name, *film);
+            shared_preview->PublishProgress(rendered_spp, false);
+        }
 
-            int tile_index = 0;
-            for (const auto& tile : film->tiles) {
-                pool.push_task(
-                    [&](int index) {
-                        RenderOneTile(tile);
-                        flags[index] = 1;
-                        printf("tile %d finish.\n", index);
-                    },
-                    tile_index++
-                );
+        // 提交当前遍中尚未完成的 tile
+        auto push_tiles = [&]() {
+            const int pass_spp = checkpoint.pass_spp;
+            std::vector<int> tile_indices;
+            for (int tile_index = 0; tile_index < static_cast<int>(film->tiles.size()); ++tile_index) {
+                if (!checkpoint.IsTileCompleted(tile_index)) tile_indices.push_back(tile_index);
+            }
+            scheduler.BeginPass(tile_indices);
+
+            // 每个线程一个任务, 从调度器中逐行 (自适应采样时逐个 tile) 取得工作
+            for (unsigned int worker = 0; worker < pool.get_thread_count(); ++worker) {
+                pool.push_task([&, pass_spp]() {
+                    const BS::concurrency_t worker_index = pool.get_current_worker_index().value_or(0);
+                    WorkerState& state = worker_states[worker_index];
+                    if (state.sampler == nullptr) state.sampler = sampler->Clone();
+                    const int node = static_cast<int>(pool.get_worker_group(worker_index));
+
+                    TileScheduler::TileRange* range = nullptr;
+                    while (scheduler.Acquire(range, node)) {
+                        int row_begin, row_end;
+                        while (scheduler.NextRows(*range, row_begin, row_end)) {
+                            const int index = range->tile_index;
+                            const FilmTile& tile = film->tiles[index];
+                            // 滤波器跨越像素时这些行的样本在渲染结束时合并到胶片, 因此 tile 完成时所有样本都已合并
+                            FilmTile rows_tile(tile.u_min, row_begin, tile.u_max, row_end - 1);
+
+                            auto count_samples = [&]() {
+                                long long samples = 0;
+                                for (int v = row_begin; v < row_end; ++v) {
+                                    for (int u = static_cast<int>(tile.u_min); u <= tile.u_max; ++u) samples += film->GetPixel(u, v).sample_count;
+                                }
+                                return samples;
+                            };
+                            const long long samples_before = count_samples();
+
+                            auto rows_start = std::chrono::steady_clock::now();
+                            if (incremental) RenderTileSamples(*state.sampler, *film, rows_tile, pass_spp);
+                            else RenderTile(*state.sampler, *film, rows_tile);
+                            auto rows_end = std::chrono::steady_clock::now();
+
+                            double rows_seconds = std::chrono::duration<double>(rows_end - rows_start).count();
+                            state.samples += count_samples() - samples_before;
+                            state.busy_seconds += rows_seconds;
+
+                            if (scheduler.FinishRows(index, row_end - row_begin, rows_seconds * 1000.0)) {
+                                checkpoint.MarkTileCompleted(index);
+                                if (enable_gui) completed_tiles.Push(index);
+                                if (shared_preview) shared_preview->PublishTile(index, *film);
+                                if (!incremental) printf("tile %d finish.\n", index);
+                            }
+                        }
+                    }
+                    scheduler.WorkerFinished();
+                });
             }
+        };
+
+        auto push_pass = [&](int pass_spp) {
+            checkpoint.BeginPass(*film, pass_spp);
+            push_tiles();
+        };
+
+        // 恢复时先完成检查点中未完成的那一遍
+        auto start_render = [&]() -> int {
+            if (resumed && checkpoint.pass_spp > 0) {
+                push_tiles();
+                return checkpoint.pass_spp;
+            }
+            int pass_spp = plan_next_pass();
+            if (pass_spp > 0) {
+                if (tile_cost_prepass && !scheduler.HasCostEstimate()) EstimateTileCosts(pool, scheduler);
+                push_pass(pass_spp);
+            }
+            return pass_spp;
+        };
+
+        auto finish_pass = [&]() {
+            session_spp += checkpoint.pass_spp;
+            checkpoint.EndPass();
+            checkpoint.Update(*film);
+            double tail_idle = scheduler.EndPass();
+            if (shared_preview) shared_preview->PublishProgress(rendered_spp, false);
+            std::cout << "[INFO] Tail idle: " << tail_idle * 100.0 << "% of thread time." << std::endl;
+            if (!incremental) return;
+            auto now = std::chrono::system_clock::now();
+            double elapsed = std::chrono::duration<double, std::milli>(now - start_time).count();
+            milliseconds_per_spp = elapsed / session_spp;
+            std::cout << "[INFO] Pass finished, " << rendered_spp << " spp, " << static_cast<long long>(elapsed) << " ms." << std::endl;
+            if (!progressive_preview_path.empty()) film->SaveImage(progressive_preview_path);
+        };
+
+        bool finished = true;
+        if (enable_gui) {
+            GLFWwindow* window = UI::CreateGUIWindow();
+            // 以胶片当前的内容创建预览纹理 (从检查点恢复时即为已完成的部分), 之后只更新完成的 tile
+            std::shared_ptr<UI::Image> image = std::make_shared<UI::Image>(film->image_width, film->image_height, film->data.data());
 
             glViewport(0, 0, image->width, image->height);
             glfwSetWindowSize(window, image->width, image->height);
 
-            std::shared_ptr<std::vector<unsigned char>> data = std::make_shared<std::vector<unsigned char>>(image->width * image->height * 3);
-
+            int pass_spp = start_render();
+
+            // 每个完成的 tile 只上传一次, 每帧的开销只与新完成的 tile 数有关;
+            // 每帧最多上传 image->stream_buffer_size 字节, 其余的 tile 留到之后的帧. flush_all 为 true 时上传全部 tile
+            std::deque<int> pending_tiles;
+            auto upload_completed_tiles = [&](bool flush_all) {
+                completed_tiles.ConsumeAll([&](int index) { pending_tiles.push_back(index); });
+                while (!pending_tiles.empty()) {
+                    if (!StreamTile(*image, *film, film->tiles[pending_tiles.front()])) {
+                        if (!flush_all) break;
+                        image->FlushStream();
+                        continue;
+                    }
+                    pending_tiles.pop_front();
+                }
+                image->FlushStream();
+            };
 
             while (!glfwWindowShouldClose(window)) {
                 glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
                 glClear(GL_COLOR_BUFFER_BIT);
 
+                upload_completed_tiles(false);
 
-                bool modified = false;
-                for (int i = 0;i < flags.size();++i) {
-                    if (flags[i] == 1) {
-                        modified = true;
-                        auto u_min = static_cast<int>(film->tiles[i].u_min);
-                        auto v_min = static_cast<int>(film->tiles[i].v_min);
-                        auto u_max = static_cast<int>(film->tiles[i].u_max);
-                        auto v_max = static_cast<int>(film->tiles[i].v_max);
-
-                        std::vector<unsigned char> image_data;
-                        for (int v = v_min, j = 0;v <= v_max;++v, ++j) {
-                            for (int u = u_min;u <= u_max;++u) {
-                                image_data.push_back(film->data[(v * film->image_width + u) * 3 + 0]);
-                                image_data.push_back(film->data[(v * film->image_width + u) * 3 + 1]);
-                                image_data.push_back(film->data[(v * film->image_width + u) * 3 + 2]);
-
-                                (*data)[(v * film->image_width + u) * 3 + 0] = film->data[(v * film->image_width + u) * 3 + 0];
-                                (*data)[(v * film->image_width + u) * 3 + 1] = film->data[(v * film->image_width + u) * 3 + 1];
-                                (*data)[(v * film->image_width + u) * 3 + 2] = film->data[(v * film->image_width + u) * 3 + 2];
-                            }
-                        }
-                    }
-                }
-
-                if (modified) {
-                    image = std::make_shared<UI::Image>(film->image_width, film->image_height, data->data());
+                // 上一遍的所有 tile 都已完成, 开始下一遍; 下一遍开始前先上传剩余的 tile, 避免与渲染线程同时访问
+                if (pass_spp > 0 && pool.get_tasks_total() == 0) {
+                    upload_completed_tiles(true);
+                    finish_pass();
+                    pass_spp = plan_next_pass();
+                    if (pass_spp > 0) push_pass(pass_spp);
                 }
+                checkpoint.Update(*film);
 
                 image->Draw();
                 glfwSwapBuffers(window);
                 glfwPollEvents();
             }
+            // 纹理与 PBO 要在 OpenGL 上下文销毁之前释放
+            image.reset();
             glfwTerminate();
             pool.wait_for_tasks();
+            // 窗口在渲染结束前被关闭时保留检查点, 之后可以继续渲染
+            if (pass_spp > 0) {
+                finished = false;
+                checkpoint.Update(*film, true);
+            }
 
             // UI::draw_gui(window, image);
 
         }
         else {
-            int tile_index = 0;
-            for (const auto& tile : film->tiles) {
-                pool.push_task(
-                    [&](int index) {
-                        RenderOneTile(tile);
-                        printf("tile %d finish.\n", index);
-                    },
-                    tile_index++
-                );
-                // pool.push_task(&SamplerIntegrator::RenderOneTile, this, camera, tile);
+            int pass_spp = start_render();
+            while (pass_spp > 0) {
+                while (!pool.wait_for_tasks_duration(std::chrono::milliseconds(200))) {
+                    checkpoint.Update(*film);
+                }
+                finish_pass();
+                pass_spp = plan_next_pass();
+                if (pass_spp > 0) push_pass(pass_spp);
             }
-            pool.wait_for_tasks();
-
         }
 
 
@@ -184,7 +604,81 @@ namespace Aokana {
 
         auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
         std::cout << "[INFO] Render finished. Rendering took " << duration.count() << " ms." << std::endl;
+        if (finished) checkpoint.Remove();
+        if (shared_preview) shared_preview->PublishProgress(rendered_spp, true);
+
+        // 吞吐量报告: 按核心给出忙碌时的样本速率与忙碌时间占比
+        double wall_seconds = std::max(1e-3, duration.count() / 1000.0);
+        long long total_samples = 0;
+        for (const auto& state : worker_states) total_samples += state.samples;
+        std::cout << "[INFO] Throughput: " << total_samples / wall_seconds / 1e6 << " Msamples/s with "
+            << worker_states.size() << " workers." << std::endl;
+        if (!worker_cpus.empty()) {
+            for (BS::concurrency_t i = 0; i < worker_states.size(); ++i) {
+                const WorkerState& state = worker_states[i];
+                double rate = state.busy_seconds > 0 ? state.samples / state.busy_seconds / 1e6 : 0.0;
+                printf("    worker %3u  cpu %3d  node %u  %8.3f Msamples/s  busy %5.1f%%\n",
+                    i, worker_cpus[i], pool.get_worker_group(i), rate, 100.0 * state.busy_seconds / wall_seconds);
+            }
+        }
+        if (adaptive_sampling && !incremental) ReportSampleCounts(*film);
+        if (time_budgeted) {
+            std::cout << "[INFO] Time budget " << time_budget_seconds << " s, achieved " << rendered_spp << " spp." << std::endl;
+        }
+
+    }
+
+    void SamplerIntegrator::RenderToStream(const std::string& path, int output_width, int band_tile_rows) {
+        Camera& camera = scene->camera;
+        const std::shared_ptr<Film> original_film = camera.film;
+        const int full_width = std::max(1, output_width);
+        const int full_height = std::max(1, static_cast<int>(std::lround(
+            static_cast<double>(full_width) * original_film->image_height / original_film->image_width)));
+        const int band_height = std::max(1, band_tile_rows) * original_film->tile_size;
+        const int band_count = (full_height + band_height - 1) / band_height;
+
+        if (progressive || time_budget_seconds > 0 || !checkpoint_path.empty() || !shared_preview_name.empty()) {
+            std::cerr << "[ERROR] Progressive rendering, time budget, checkpoints and shared preview are ignored when streaming." << std::endl;
+        }
+        const bool saved_progressive = progressive;
+        const double saved_time_budget = time_budget_seconds;
+        const std::string saved_checkpoint_path = checkpoint_path;
+        const std::string saved_shared_preview_name = shared_preview_name;
+        progressive = false;
+        time_budget_seconds = 0;
+        checkpoint_path.clear();
+        shared_preview_name.clear();
+
+        EXRScanlineWriter writer(path, full_width, full_height, false);
+        if (writer.IsOpen()) {
+            std::cout << "[INFO] Streaming " << full_width << "x" << full_height << " image to \"" << path << "\" in "
+                << band_count << " bands of " << band_height << " rows." << std::endl;
+
+            // 输出文件从最上面一行开始写入, 胶片的 v 轴向上, 因此条带从 v 最大的一端开始
+            for (int band = 0; band < band_count; ++band) {
+                const int v_max = full_height - 1 - band * band_height;
+                const int v_min = std::max(0, v_max - band_height + 1);
+                std::shared_ptr<Film> band_film = std::make_shared<Film>(full_width, v_max - v_min + 1);
+                band_film->SetCropWindow(full_width, full_height, 0, v_min);
+                band_film->SetFilter(original_film->filter);
+                band_film->tone_mapping = original_film->tone_mapping;
+
+                std::cout << "[INFO] Band " << band + 1 << "/" << band_count << "." << std::endl;
+                camera.film = band_film;
+                RenderWithMultithreading(false);
+                if (!writer.WriteScanlines(band_film->GetRadianceBuffer().data(), band_film->image_height)) {
+                    std::cerr << "[ERROR] Failed to write band " << band << " to \"" << path << "\"." << std::endl;
+                    break;
+                }
+            }
+            if (writer.Finish()) std::cout << "[INFO] Film was successfully written to \"" << path << "\"." << std::endl;
+        }
 
+        camera.film = original_film;
+        progressive = saved_progressive;
+        time_budget_seconds = saved_time_budget;
+        checkpoint_path = saved_checkpoint_path;
+        shared_preview_name = saved_shared_preview_name;
     }
 
 }
\ No newline at end of file
@@ -5,23 +5,111 @@
 #include "scene.h"
 #include "sampler.h"
 
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace BS {
+    class work_stealing_pool;
+}
+
 namespace Aokana {
 
+    class TileScheduler;
+
     class Integrator {
     public:
         int max_depth = 5;
         virtual void Render() = 0;
-        virtual Color Li(const Ray& ray, const Color& background, int depth) = 0;
+        // 路径上所有的随机数都取自 sampler, 调用前应已对当前像素样本调用过 StartPixelSample
+        virtual Color Li(const Ray& ray, const Color& background, int depth, Sampler& sampler) = 0;
     };
 
     class SamplerIntegrator : public Integrator {
     public:
         std::shared_ptr<Scene> scene;
         std::shared_ptr<Sampler> sampler;
+
+        // 自适应采样: samples_per_pixel 是每个 tile 的平均样本预算, 平均每像素的样本数不会超过它.
+        // 每个像素先取 adaptive_min_spp 个样本 (在 [2, samples_per_pixel] 内), 之后逐轮把未收敛像素的样本数翻倍,
+        // 误差大的像素优先, 直到亮度估计的相对误差低于 adaptive_threshold, 达到 adaptive_max_spp 或者用完预算;
+        // 收敛的像素不再采样, 节省的样本留给同一 tile 中噪声大的像素
+        bool adaptive_sampling = false;
+        double adaptive_threshold = 0.02;
+        int adaptive_min_spp = 0;   // 不大于 0 时取 samples_per_pixel / 4
+        int adaptive_max_spp = 0;   // 单个像素的上限, 不大于 0 时取 4 * samples_per_pixel
+
+        // 渐进渲染: 样本累加在胶片的高精度缓冲中, 每遍对整幅图像取 progressive_spp_per_pass 个样本,
+        // 每遍结束后图像都可以直接查看; progressive_preview_path 非空时每遍结束后保存预览. 渐进渲染不使用自适应采样
+        bool progressive = false;
+        int progressive_spp_per_pass = 1;
+        std::string progressive_preview_path;
+
+        // 限时渲染: 大于 0 时忽略 samples_per_pixel, 以 progressive_spp_per_pass 个样本的第一遍测量吞吐量,
+        // 之后不断追加样本直到用完 time_budget_seconds 秒, 每遍结束后的图像即为当前最好的结果
+        double time_budget_seconds = 0;
+
+        // 检查点: checkpoint_path 非空时每隔 checkpoint_interval_seconds 秒把累积状态写入该文件, 渲染完成后删除;
+        // resume_from_checkpoint 为 true 时从文件中恢复并只渲染剩余的部分
+        std::string checkpoint_path;
+        double checkpoint_interval_seconds = 60;
+        bool resume_from_checkpoint = false;
+
+        // 第一遍之前以稀疏的单样本预渲染估计每个 tile 的代价, 之后各遍使用上一遍的实测代价; 代价高的 tile 先渲染
+        bool tile_cost_prepass = true;
+
+        // 线程放置: pin_threads 为 true 时把每个工作线程绑定到一个逻辑处理器;
+        // numa_aware 为 true 时按 NUMA 节点给工作线程分组, 线程优先窃取同一节点的任务, 相邻的 tile 由同一节点渲染
+        bool pin_threads = false;
+        bool numa_aware = false;
+
+        // 无显示器预览: 非空且不使用 GUI 时把输出图像与完成的 tile 发布到该名字的共享内存中,
+        // 另一个进程可以用 AokanaRenderer --preview <name> 查看
+        std::string shared_preview_name;
     public:
-        virtual Color Li(const Ray& ray, const Color& background, int depth) override;
+        virtual Color Li(const Ray& ray, const Color& background, int depth, Sampler& sampler) override {
+            return Li(ray, background, depth, sampler, nullptr);
+        }
+        // aov 非空时在第一个交点处填写样本的 AOV
+        Color Li(const Ray& ray, const Color& background, int depth, Sampler& sampler, AOVSample* aov);
         virtual void Render() override;
         void RenderOneTile(const FilmTile& tile);
+        // 为 tile 内每个像素追加 sample_count 个样本并更新输出图像
+        void RenderTilePass(const FilmTile& tile, int sample_count);
         void RenderWithMultithreading(bool enable_gui = true);
+        // 流式渲染超大图像: 宽 output_width, 高度按胶片的宽高比计算, 以 band_tile_rows 行 tile 为一个条带从上到下渲染,
+        // 每个条带完成后写入 path (float 通道的 OpenEXR 扫描线文件) 并释放, 内存占用只与条带的大小有关.
+        // 每个条带的像素都与渲染整幅图像时一样取样本; 只是重建滤波器跨越条带边界的部分不会累加到相邻条带中.
+        // 流式渲染不支持渐进渲染, 限时渲染, 检查点与共享内存预览
+        void RenderToStream(const std::string& path, int output_width, int band_tile_rows = 4);
+        // 渲染场景动画中 [first_frame, last_frame] 的各帧, 第 frame 帧保存到 output_pattern 中的 %d 或 %0Nd 替换为帧号的路径
+        // (如 "frame_%04d.png", 可以用 %% 表示 %); 各帧共用已加载的场景与线程池, 每帧只更新动画对象的变换并重新拟合 BVH.
+        // 场景没有动画或 output_pattern 不是这样的模式时返回 false
+        bool RenderAnimation(int first_frame, int last_frame, const std::string& output_pattern);
+        // 分布式渲染的工作进程使用: 为 tile 内每个像素渲染编号为 [first_sample, first_sample + sample_count) 的样本,
+        // 颜色按重建滤波器累加到 tile_buffer 中, 这些样本的统计量写入 film 中 tile 的像素 (应事先清零)
+        void RenderTileSampleRange(Sampler& tile_sampler, Film& film, const FilmTile& tile,
+            int first_sample, int sample_count, FilmTileBuffer& tile_buffer);
+
+    private:
+        // 从像素当前已有的样本数 (first_sample 不小于 0 时从编号 first_sample) 开始, 为像素 (x, y) 累加 sample_count 个样本;
+        // tile_buffer 非空时样本按重建滤波器累加到 tile_buffer 中, 由调用者合并到胶片
+        void RenderPixelSamples(Sampler& pixel_sampler, Film& film, int x, int y, int sample_count,
+            FilmTileBuffer* tile_buffer = nullptr, int first_sample = -1);
+        void RenderTile(Sampler& tile_sampler, Film& film, const FilmTile& tile);
+        void RenderTileSamples(Sampler& tile_sampler, Film& film, const FilmTile& tile, int sample_count);
+        void RenderTileAdaptive(Sampler& tile_sampler, Film& film, const FilmTile& tile);
+        void ReportSampleCounts(const Film& film) const;
+        void EstimateTileCosts(BS::work_stealing_pool& pool, TileScheduler& scheduler);
+        // 按 pin_threads / numa_aware 创建线程池, 返回每个工作线程所在的逻辑处理器 (未启用时为空) 与节点数
+        std::unique_ptr<BS::work_stealing_pool> CreateWorkerPool(std::vector<int>& worker_cpus, int& node_count) const;
+        // 返回上一次渲染的线程池, 线程放置的设置改变时重新创建; 渲染动画时各帧共用同一组线程
+        BS::work_stealing_pool& AcquireWorkerPool(std::vector<int>& worker_cpus, int& node_count);
+
+        std::shared_ptr<BS::work_stealing_pool> worker_pool;
+        std::vector<int> worker_pool_cpus;
+        int worker_pool_nodes = 1;
+        bool worker_pool_pinned = false;
+        bool worker_pool_numa_aware = false;
     };
 }
\ No newline at end of file
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+
+#include "hash.h"
+#include "vec.h"
+
+namespace Aokana {
+
+    // 低差异序列的基础工具: 逆根 (radical inverse), Sobol 生成矩阵, Owen 置乱与随机排列
+    // https://pbr-book.org/4ed/Sampling_and_Reconstruction/Halton_Sampler
+    // https://pbr-book.org/4ed/Sampling_and_Reconstruction/Sobol_Samplers
+
+    constexpr double ONE_MINUS_EPSILON = 0x1.fffffffffffffp-1;
+
+    constexpr int PRIME_TABLE_SIZE = 64;
+    constexpr int PRIMES[PRIME_TABLE_SIZE] = {
+        2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53,
+        59, 61, 67, 71, 73, 79, 83, 89, 97, 101, 103, 107, 109, 113, 127, 131,
+        137, 139, 149, 151, 157, 163, 167, 173, 179, 181, 191, 193, 197, 199, 211, 223,
+        227, 229, 233, 239, 241, 251, 257, 263, 269, 271, 277, 281, 283, 293, 307, 311
+    };
+
+    inline uint32_t ReverseBits32(uint32_t n) {
+        n = (n << 16) | (n >> 16);
+        n = ((n & 0x00ff00ff) << 8) | ((n & 0xff00ff00) >> 8);
+        n = ((n & 0x0f0f0f0f) << 4) | ((n & 0xf0f0f0f0) >> 4);
+        n = ((n & 0x33333333) << 2) | ((n & 0xcccccccc) >> 2);
+        n = ((n & 0x55555555) << 1) | ((n & 0xaaaaaaaa) >> 1);
+        return n;
+    }
+
+    // 返回 [0, l) 的一个伪随机排列中第 i 个元素, 排列由 p 决定 (Kensler, "Correlated Multi-Jittered Sampling")
+    inline int PermutationElement(uint32_t i, uint32_t l, uint32_t p) {
+        uint32_t w = l - 1;
+        w |= w >> 1;
+        w |= w >> 2;
+        w |= w >> 4;
+        w |= w >> 8;
+        w |= w >> 16;
+        do {
+            i ^= p;
+            i *= 0xe170893d;
+            i ^= p >> 16;
+            i ^= (i & w) >> 4;
+            i ^= p >> 8;
+            i *= 0x0929eb3f;
+            i ^= p >> 23;
+            i ^= (i & w) >> 1;
+            i *= 1 | p >> 27;
+            i *= 0x6935fa69;
+            i ^= (i & w) >> 11;
+            i *= 0x74dcb303;
+            i ^= (i & w) >> 2;
+            i *= 0x9e501cc3;
+            i ^= (i & w) >> 2;
+            i *= 0xc860a3df;
+            i &= w;
+            i ^= i >> 5;
+        } while (i >= l);
+        return (i + p) % l;
+    }
+
+    // 以 PRIMES[base_index] 为底的逆根: 将 a 的各位数字关于小数点镜像
+    inline double RadicalInverse(int base_index, uint64_t a) {
+        int base = PRIMES[base_index];
+        const double inv_base = 1.0 / base;
+        double inv_base_m = 1;
+        uint64_t reversed_digits = 0;
+        while (a) {
+            uint64_t next = a / base;
+            uint64_t digit = a - next * base;
+            reversed_digits = reversed_digits * base + digit;
+            inv_base_m *= inv_base;
+            a = next;
+        }
+        return std::min(reversed_digits * inv_base_m, ONE_MINUS_EPSILON);
+    }
+
+    // 带 Owen 置乱的逆根: 每一位数字按照其更高位数字决定的随机排列置换, 保持序列的分层性质
+    inline double OwenScrambledRadicalInverse(int base_index, uint64_t a, uint32_t hash) {
+        int base = PRIMES[base_index];
+        const double inv_base = 1.0 / base;
+        double inv_base_m = 1;
+        uint64_t reversed_digits = 0;
+        // a 的高位全为 0 时仍需继续置乱, 直到达到 double 的精度
+        while (1 - (base - 1) * inv_base_m < 1) {
+            uint64_t next = a / base;
+            int digit = static_cast<int>(a - next * base);
+            uint32_t digit_hash = static_cast<uint32_t>(MixBits(hash ^ reversed_digits));
+            digit = PermutationElement(digit, base, digit_hash);
+            reversed_digits = reversed_digits * base + digit;
+            inv_base_m *= inv_base;
+            a = next;
+        }
+        return std::min(reversed_digits * inv_base_m, ONE_MINUS_EPSILON);
+    }
+
+    // 二维 Sobol 序列的前两维: 第 0 维是 van der Corput 序列 (单位矩阵),
+    // 第 1 维的生成矩阵是模 2 的 Pascal 矩阵, 由 Lucas 定理第 k 列第 j 位为 1 当且仅当 (j & k) == j
+    // 两维合在一起构成 (0, 2) 序列: 任意 2^m 个连续对齐的样本在所有面积为 2^-m 的基本区间中各有一个
+    inline uint32_t SobolGeneratorColumn(int dimension, int k) {
+        if (dimension == 0) return 1u << (31 - k);
+        uint32_t column = 0;
+        for (int j = 0; j <= k; ++j) {
+            if ((j & k) == j) column |= 1u << (31 - j);
+        }
+        return column;
+    }
+
+    // 返回 Sobol 序列第 a 个点在 dimension (0 或 1) 上的 32 位定点表示
+    inline uint32_t SobolSampleBits(uint64_t a, int dimension) {
+        static const struct SobolMatrices {
+            SobolMatrices() {
+                for (int k = 0; k < 32; ++k) {
+                    columns[0][k] = SobolGeneratorColumn(0, k);
+                    columns[1][k] = SobolGeneratorColumn(1, k);
+                }
+            }
+            uint32_t columns[2][32];
+        } matrices;
+
+        uint32_t v = 0;
+        for (int k = 0; a != 0 && k < 32; a >>= 1, ++k) {
+            if (a & 1) v ^= matrices.columns[dimension][k];
+        }
+        return v;
+    }
+
+    // Owen 置乱 (精确版本): 第 b 位是否翻转由更高的 b 位决定
+    inline uint32_t OwenScramble(uint32_t v, uint32_t seed) {
+        if (seed & 1) v ^= 1u << 31;
+        for (int b = 1; b < 32; ++b) {
+            uint32_t mask = (~0u) << (32 - b);
+            if (static_cast<uint32_t>(MixBits((v & mask) ^ seed)) & (1u << b)) {
+                v ^= 1u << (31 - b);
+            }
+        }
+        return v;
+    }
+
+    inline double BitsToUnitDouble(uint32_t v) {
+        return std::min(v * 0x1p-32, ONE_MINUS_EPSILON);
+    }
+
+    inline double SobolSample(uint64_t a, int dimension, uint32_t seed) {
+        return BitsToUnitDouble(OwenScramble(SobolSampleBits(a, dimension), seed));
+    }
+}
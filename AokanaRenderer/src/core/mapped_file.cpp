@@ -0,0 +1,83 @@
+#include "mapped_file.h"
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Aokana {
+
+    bool MappedFile::Open(const std::string& path) {
+        Close();
+#if defined(_WIN32)
+        HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (handle == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER file_size;
+        if (!GetFileSizeEx(handle, &file_size)) {
+            CloseHandle(handle);
+            return false;
+        }
+        file = handle;
+        size = static_cast<size_t>(file_size.QuadPart);
+        if (size == 0) return true;
+        mapping = CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping == nullptr) {
+            Close();
+            return false;
+        }
+        data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        if (data == nullptr) {
+            Close();
+            return false;
+        }
+#else
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat status;
+        if (fstat(fd, &status) != 0) {
+            close(fd);
+            return false;
+        }
+        size = static_cast<size_t>(status.st_size);
+        if (size == 0) {
+            close(fd);
+            return true;
+        }
+        void* address = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (address == MAP_FAILED) {
+            size = 0;
+            return false;
+        }
+        // 文件的各部分会被多个线程同时读取, 提示内核提前读入整个文件
+        madvise(address, size, MADV_WILLNEED);
+        data = static_cast<const char*>(address);
+#endif
+        return true;
+    }
+
+    void MappedFile::Close() {
+#if defined(_WIN32)
+        if (data != nullptr) UnmapViewOfFile(data);
+        if (mapping != nullptr) CloseHandle(mapping);
+        if (file != nullptr) CloseHandle(file);
+        mapping = nullptr;
+        file = nullptr;
+#else
+        if (data != nullptr) munmap(const_cast<char*>(data), size);
+#endif
+        data = nullptr;
+        size = 0;
+    }
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace Aokana {
+
+    // 只读的内存映射文件 (POSIX mmap, Windows 上为文件映射), 用于读取很大的资源文件而不必先拷贝到内存中
+    class MappedFile {
+    public:
+        MappedFile() = default;
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+        ~MappedFile() { Close(); }
+
+        // 失败时返回 false; 空文件也能成功打开, 此时 Data() 为 nullptr
+        bool Open(const std::string& path);
+        void Close();
+
+        const char* Data() const { return data; }
+        size_t Size() const { return size; }
+
+    private:
+        const char* data = nullptr;
+        size_t size = 0;
+#if defined(_WIN32)
+        void* file = nullptr;
+        void* mapping = nullptr;
+#endif
+    };
+}
@@ -1,11 +1,13 @@
 #include "material.h"
 #include "interaction.h"
+#include "sampling.h"
 
 namespace Aokana {
     bool Lambertian::Scatter(const Ray& ray_in, const SurfaceInteraction& hit_point,
-        Color& attenuation, Ray& scattered) const {
+        Color& attenuation, Ray& scattered, Sampler& sampler) const {
 
-        Vector3 scatter_direction = Normalize(Vector3(hit_point.normal) + Vector3::RandomUnitVector());
+        sampler.Get1D();
+        Vector3 scatter_direction = Normalize(Vector3(hit_point.normal) + SampleUniformSphere(sampler.Get2D()));
 
         if (scatter_direction.near_zero())
             scatter_direction = Vector3(hit_point.normal);
@@ -16,17 +18,21 @@ namespace Aokana {
     }
 
     bool Metal::Scatter(const Ray& ray_in, const SurfaceInteraction& hit_point,
-        Color& attenuation, Ray& scattered) const {
+        Color& attenuation, Ray& scattered, Sampler& sampler) const {
 
+        double u_radius = sampler.Get1D();
+        Point2 u = sampler.Get2D();
         Vector3 reflected = Reflect(Normalize(ray_in.direction), hit_point.normal);
-        scattered = Ray(hit_point.p, reflected + fuzz * Vector3::RandomInUnitSphere(), ray_in.time);
+        scattered = Ray(hit_point.p, reflected + fuzz * SampleUniformBall(u_radius, u), ray_in.time);
         attenuation = albedo;
         return (Dot(scattered.direction, hit_point.normal) > 0);
     }
 
     bool Dielectric::Scatter(const Ray& ray_in, const SurfaceInteraction& hit_point,
-        Color& attenuation, Ray& scattered) const {
+        Color& attenuation, Ray& scattered, Sampler& sampler) const {
 
+        double u_reflect = sampler.Get1D();
+        sampler.Get2D();
         attenuation = Color(1.0, 1.0, 1.0);
         double refraction_ratio = hit_point.front_face ? (1.0 / ir) : ir;
         Vector3 unit_direction = Normalize(ray_in.direction);
@@ -36,7 +42,7 @@ namespace Aokana {
         bool cannot_refract = refraction_ratio * sin_theta > 1.0;
         Vector3 direction;
 
-        if (cannot_refract || Reflectance(cos_theta, refraction_ratio) > RandomDoubleIn01()) direction = Reflect(unit_direction, hit_point.normal);
+        if (cannot_refract || Reflectance(cos_theta, refraction_ratio) > u_reflect) direction = Reflect(unit_direction, hit_point.normal);
         else direction = Refract(unit_direction, hit_point.normal, refraction_ratio);
 
         scattered = Ray(hit_point.p, direction, ray_in.time);
@@ -1,8 +1,12 @@
 #pragma once
 
+#include <atomic>
+#include <cstdint>
+
 #include "ray.h"
 #include "interaction.h"
 #include "texture.h"
+#include "sampler.h"
 
 namespace Aokana {
 
@@ -10,12 +14,23 @@ namespace Aokana {
 
     class Material {
     public:
+        Material() : id(next_id.fetch_add(1, std::memory_order_relaxed)) {}
+        virtual ~Material() = default;
+
+        // 按创建顺序分配的编号, 从 1 开始, 用于输出材质编号 AOV
+        const uint32_t id;
+
         virtual Color Emitted(double u, double v, const Point3& p) const {
             return Color(0, 0, 0);
         }
 
+        // 散射所需的随机数都取自 sampler: 每次调用先取一个 Get1D 再取一个 Get2D, 不论是否用到 (不散射的材质路径就此结束, 可以不取),
+        // 这样每次反弹占用的维度固定, 低差异采样器的各维度在不同材质之间保持对齐
         virtual bool Scatter(const Ray& ray_in, const SurfaceInteraction& hit_point,
-            Color& attenuation, Ray& scattered) const = 0;
+            Color& attenuation, Ray& scattered, Sampler& sampler) const = 0;
+
+    private:
+        inline static std::atomic<uint32_t> next_id{ 1 };
     };
 
 
@@ -25,7 +40,7 @@ namespace Aokana {
         Lambertian(std::shared_ptr<Texture> a) : albedo(a) {}
 
         virtual bool Scatter(const Ray& ray_in, const SurfaceInteraction& hit_point,
-            Color& attenuation, Ray& scattered) const override;
+            Color& attenuation, Ray& scattered, Sampler& sampler) const override;
     public:
         std::shared_ptr<Texture> albedo;
     };
@@ -36,7 +51,7 @@ namespace Aokana {
         Metal(const Color& a, double f) :albedo(a), fuzz(f < 1 ? f : 1) {}
 
         virtual bool Scatter(const Ray& ray_in, const SurfaceInteraction& hit_point,
-            Color& attenuation, Ray& scattered) const override;
+            Color& attenuation, Ray& scattered, Sampler& sampler) const override;
 
     public:
         Color albedo;
@@ -49,7 +64,7 @@ namespace Aokana {
         Dielectric(double index_of_refraction) : ir(index_of_refraction) {}
 
         virtual bool Scatter(const Ray& ray_in, const SurfaceInteraction& hit_point,
-            Color& attenuation, Ray& scattered) const override;
+            Color& attenuation, Ray& scattered, Sampler& sampler) const override;
 
     public:
         double ir; // Index of Rafraction
@@ -63,7 +78,7 @@ namespace Aokana {
         DiffuseLight(Color c) : emit(std::make_shared<SolidColor>(c)) {}
 
         virtual bool Scatter(const Ray& ray_in, const SurfaceInteraction& hit_point,
-            Color& attenuation, Ray& scattered) const override {
+            Color& attenuation, Ray& scattered, Sampler&) const override {
             return false;
         }
 
@@ -0,0 +1,384 @@
+#include "mesh_file.h"
+#include "buffer_cache.h"
+#include "mapped_file.h"
+#include "thread_pool.h"
+#include "worker_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace Aokana {
+
+    namespace {
+
+        static_assert(sizeof(Point3) == 3 * sizeof(double) && sizeof(Normal3) == 3 * sizeof(double) && sizeof(Point2) == 2 * sizeof(double),
+            "Mesh files map vertex data directly onto Point3 / Normal3 / Point2.");
+        static_assert(sizeof(MeshBVHNode) == 56, "MeshBVHNode must not contain padding.");
+
+        constexpr uint64_t SECTION_ALIGNMENT = 64;
+
+        uint64_t AlignUp(uint64_t offset) {
+            return (offset + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT * SECTION_ALIGNMENT;
+        }
+
+        void StoreBounds(const Bounds3& box, double bounds[6]) {
+            bounds[0] = box.p_min.x; bounds[1] = box.p_min.y; bounds[2] = box.p_min.z;
+            bounds[3] = box.p_max.x; bounds[4] = box.p_max.y; bounds[5] = box.p_max.z;
+        }
+
+        Bounds3 LoadBounds(const double bounds[6]) {
+            return Bounds3(Point3(bounds[0], bounds[1], bounds[2]), Point3(bounds[3], bounds[4], bounds[5]));
+        }
+
+        // 沿三角形重心跨度最大的轴按中位数划分, 构建与 BVHNode 结构相同的二叉树
+        class MeshBVHBuilder {
+        public:
+            explicit MeshBVHBuilder(const std::shared_ptr<const TriangleMesh>& mesh) {
+                const int count = mesh->triangle_count;
+                triangle_bounds.reserve(count);
+                centroids.reserve(count);
+                order.resize(count);
+                for (int i = 0; i < count; ++i) {
+                    triangle_bounds.push_back(MeshTriangle(mesh, i).WorldBound());
+                    const Bounds3& b = triangle_bounds.back();
+                    centroids.push_back(Point3((b.p_min.x + b.p_max.x) / 2, (b.p_min.y + b.p_max.y) / 2, (b.p_min.z + b.p_max.z) / 2));
+                    order[i] = i;
+                }
+                nodes.reserve(count > 1 ? count - 1 : 1);
+            }
+
+            std::vector<MeshBVHNode> Build() {
+                if (order.size() == 1) {
+                    MeshBVHNode node;
+                    StoreBounds(triangle_bounds[0], node.bounds);
+                    node.children[0] = node.children[1] = ~0;
+                    nodes.push_back(node);
+                }
+                else if (!order.empty()) {
+                    BuildNode(0, order.size());
+                }
+                return std::move(nodes);
+            }
+
+        private:
+            // 返回子树的引用: 只有一个三角形时直接引用三角形, 否则引用新建的节点
+            int32_t BuildNode(size_t begin, size_t end) {
+                if (end - begin == 1) return ~order[begin];
+
+                Bounds3 centroid_bounds;
+                for (size_t i = begin; i < end; ++i) centroid_bounds = Bounds3::Merge(centroid_bounds, Bounds3(centroids[order[i]]));
+                Vector3 extent = centroid_bounds.p_max - centroid_bounds.p_min;
+                int axis = (extent.x > extent.y && extent.x > extent.z) ? 0 : (extent.y > extent.z ? 1 : 2);
+
+                const size_t mid = begin + (end - begin) / 2;
+                std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end,
+                    [&](int a, int b) { return centroids[a][axis] < centroids[b][axis]; });
+
+                // 先序排列: 先占住当前节点的位置, 再构建子树
+                const int32_t index = static_cast<int32_t>(nodes.size());
+                nodes.emplace_back();
+                int32_t left = BuildNode(begin, mid);
+                int32_t right = BuildNode(mid, end);
+
+                Bounds3 box = Bounds3::Merge(ChildBounds(left), ChildBounds(right));
+                MeshBVHNode& node = nodes[index];
+                StoreBounds(box, node.bounds);
+                node.children[0] = left;
+                node.children[1] = right;
+                return index;
+            }
+
+            Bounds3 ChildBounds(int32_t child) const {
+                return child >= 0 ? LoadBounds(nodes[child].bounds) : triangle_bounds[~child];
+            }
+
+            std::vector<Bounds3> triangle_bounds;
+            std::vector<Point3> centroids;
+            std::vector<int> order;
+            std::vector<MeshBVHNode> nodes;
+        };
+
+        void WriteSection(std::ofstream& out, uint64_t offset, const void* data, size_t size) {
+            static const char zeros[SECTION_ALIGNMENT] = {};
+            uint64_t position = static_cast<uint64_t>(out.tellp());
+            out.write(zeros, static_cast<std::streamsize>(offset - position));
+            out.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+        }
+
+        // 检查一段数据是否完整地位于文件之内且正确对齐
+        bool ValidSection(uint64_t offset, uint64_t count, uint64_t element_size, uint64_t file_size) {
+            if (offset == 0 || offset % SECTION_ALIGNMENT != 0 || offset > file_size) return false;
+            return count <= (file_size - offset) / element_size;
+        }
+    }
+
+    bool WriteMeshFile(const std::string& path, const std::shared_ptr<const TriangleMesh>& mesh, bool build_bvh) {
+        auto start_time = std::chrono::steady_clock::now();
+        if constexpr (std::endian::native != std::endian::little) {
+            std::cerr << "[ERROR] Mesh files can only be written on little-endian machines." << std::endl;
+            return false;
+        }
+
+        std::vector<MeshBVHNode> nodes;
+        if (build_bvh) nodes = MeshBVHBuilder(mesh).Build();
+
+        const uint64_t vertex_count = static_cast<uint64_t>(mesh->vertex_count);
+        const uint64_t triangle_count = static_cast<uint64_t>(mesh->triangle_count);
+        const size_t vertices = static_cast<size_t>(vertex_count);
+
+        // 文件中保存未压缩的属性, 以便读取时直接映射; 压缩过的属性先解码
+        std::vector<Point3> decoded_p;
+        std::vector<Normal3> decoded_n;
+        std::vector<Point2> decoded_uv;
+        const Point3* p = mesh->p;
+        const Normal3* n = mesh->n;
+        const Point2* uv = mesh->uv;
+        if (p == nullptr) {
+            for (int i = 0; i < mesh->vertex_count; ++i) decoded_p.push_back(mesh->Position(i));
+            p = decoded_p.data();
+        }
+        if (n == nullptr && mesh->HasNormals()) {
+            for (int i = 0; i < mesh->vertex_count; ++i) decoded_n.push_back(mesh->Normal(i));
+            n = decoded_n.data();
+        }
+        if (uv == nullptr && mesh->HasUVs()) {
+            for (int i = 0; i < mesh->vertex_count; ++i) decoded_uv.push_back(mesh->UV(i));
+            uv = decoded_uv.data();
+        }
+
+        MeshFileHeader header = {};
+        std::memcpy(header.magic, MESH_FILE_MAGIC, sizeof(header.magic));
+        header.version = MESH_FILE_VERSION;
+        header.flags = (mesh->reverse_orientation ? MESH_FILE_REVERSE_ORIENTATION : 0) |
+            (mesh->transform_swaps_handedness ? MESH_FILE_SWAPS_HANDEDNESS : 0);
+        header.vertex_count = vertex_count;
+        header.triangle_count = triangle_count;
+        header.bvh_node_count = nodes.size();
+
+        uint64_t offset = AlignUp(sizeof(MeshFileHeader));
+        auto reserve = [&](uint64_t size) {
+            uint64_t section = offset;
+            offset = AlignUp(offset + size);
+            return section;
+        };
+        header.positions_offset = reserve(vertex_count * sizeof(Point3));
+        header.normals_offset = n ? reserve(vertex_count * sizeof(Normal3)) : 0;
+        header.uvs_offset = uv ? reserve(vertex_count * sizeof(Point2)) : 0;
+        header.indices_offset = reserve(triangle_count * 3 * sizeof(int32_t));
+        header.bvh_offset = nodes.empty() ? 0 : reserve(nodes.size() * sizeof(MeshBVHNode));
+
+        Bounds3 bounds;
+        for (int i = 0; i < mesh->vertex_count; ++i) bounds = Bounds3::Merge(bounds, Bounds3(p[i]));
+        StoreBounds(bounds, header.bounds);
+
+        header.positions_hash = BufferCache<Point3>::Hash({ p, vertices });
+        header.normals_hash = n ? BufferCache<Normal3>::Hash({ n, vertices }) : 0;
+        header.uvs_hash = uv ? BufferCache<Point2>::Hash({ uv, vertices }) : 0;
+        header.indices_hash = BufferCache<int>::Hash({ mesh->indices, static_cast<size_t>(triangle_count) * 3 });
+
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            std::cerr << "[ERROR] Failed to open \"" << path << "\" for writing." << std::endl;
+            return false;
+        }
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        WriteSection(out, header.positions_offset, p, vertex_count * sizeof(Point3));
+        if (n) WriteSection(out, header.normals_offset, n, vertex_count * sizeof(Normal3));
+        if (uv) WriteSection(out, header.uvs_offset, uv, vertex_count * sizeof(Point2));
+        WriteSection(out, header.indices_offset, mesh->indices, triangle_count * 3 * sizeof(int32_t));
+        if (!nodes.empty()) WriteSection(out, header.bvh_offset, nodes.data(), nodes.size() * sizeof(MeshBVHNode));
+        out.close();
+        if (!out) {
+            std::cerr << "[ERROR] Failed to write mesh file \"" << path << "\"." << std::endl;
+            return false;
+        }
+
+        auto end_time = std::chrono::steady_clock::now();
+        std::cout << "[INFO] Wrote \"" << path << "\": " << triangle_count << " triangles, " << vertex_count << " vertices, "
+            << nodes.size() << " BVH nodes in " << std::chrono::duration<double, std::milli>(end_time - start_time).count() << " ms." << std::endl;
+        return true;
+    }
+
+    MeshFile LoadMeshFile(const std::string& path) {
+        auto start_time = std::chrono::steady_clock::now();
+        MeshFile result;
+        if constexpr (std::endian::native != std::endian::little) {
+            std::cerr << "[ERROR] Mesh files can only be read on little-endian machines." << std::endl;
+            return result;
+        }
+
+        auto file = std::make_shared<MappedFile>();
+        if (!file->Open(path)) {
+            std::cerr << "[ERROR] Failed to open mesh file \"" << path << "\"." << std::endl;
+            return result;
+        }
+        const uint64_t file_size = file->Size();
+        MeshFileHeader header;
+        if (file_size < sizeof(header)) {
+            std::cerr << "[ERROR] \"" << path << "\" is not a mesh file." << std::endl;
+            return result;
+        }
+        std::memcpy(&header, file->Data(), sizeof(header));
+        if (std::memcmp(header.magic, MESH_FILE_MAGIC, sizeof(header.magic)) != 0) {
+            std::cerr << "[ERROR] \"" << path << "\" is not a mesh file." << std::endl;
+            return result;
+        }
+        if (header.version != MESH_FILE_VERSION) {
+            std::cerr << "[ERROR] Mesh file \"" << path << "\" has version " << header.version
+                << ", expected " << MESH_FILE_VERSION << "." << std::endl;
+            return result;
+        }
+
+        bool valid = header.vertex_count <= static_cast<uint64_t>(INT_MAX) && header.triangle_count <= static_cast<uint64_t>(INT_MAX) / 3;
+        valid &= ValidSection(header.positions_offset, header.vertex_count, sizeof(Point3), file_size);
+        valid &= header.normals_offset == 0 || ValidSection(header.normals_offset, header.vertex_count, sizeof(Normal3), file_size);
+        valid &= header.uvs_offset == 0 || ValidSection(header.uvs_offset, header.vertex_count, sizeof(Point2), file_size);
+        valid &= ValidSection(header.indices_offset, header.triangle_count * 3, sizeof(int32_t), file_size);
+        valid &= header.bvh_offset == 0 || ValidSection(header.bvh_offset, header.bvh_node_count, sizeof(MeshBVHNode), file_size);
+        if (!valid) {
+            std::cerr << "[ERROR] Mesh file \"" << path << "\" is truncated or corrupted." << std::endl;
+            return result;
+        }
+
+        const char* data = file->Data();
+        const int* indices = reinterpret_cast<const int*>(data + header.indices_offset);
+        const int vertex_count = static_cast<int>(header.vertex_count);
+        const size_t index_count = header.triangle_count * 3;
+
+        // 越界的索引会在求交时读到映射之外的内存, 只检查这一项; 顶点数据本身不需要解析
+        std::atomic<bool> index_out_of_range{ false };
+        BS::work_stealing_pool& pool = SharedWorkerPool();
+        pool.parallel_for(size_t(0), index_count, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                if (static_cast<unsigned>(indices[i]) >= static_cast<unsigned>(vertex_count)) {
+                    index_out_of_range.store(true, std::memory_order_relaxed);
+                    return;
+                }
+            }
+        });
+        if (index_out_of_range) {
+            std::cerr << "[ERROR] Mesh file \"" << path << "\" contains out of range vertex indices." << std::endl;
+            return result;
+        }
+
+        // 数据已经在缓存中时使用缓存的副本, 否则缓存直接引用映射的文件
+        const size_t vertices = static_cast<size_t>(vertex_count);
+        const Point3* p = g_point3_buffer_cache->LookupOrAdd(
+            { reinterpret_cast<const Point3*>(data + header.positions_offset), vertices }, header.positions_hash, file);
+        const Normal3* n = header.normals_offset == 0 ? nullptr : g_normal3_buffer_cache->LookupOrAdd(
+            { reinterpret_cast<const Normal3*>(data + header.normals_offset), vertices }, header.normals_hash, file);
+        const Point2* uv = header.uvs_offset == 0 ? nullptr : g_point2_buffer_cache->LookupOrAdd(
+            { reinterpret_cast<const Point2*>(data + header.uvs_offset), vertices }, header.uvs_hash, file);
+        indices = g_int_buffer_cache->LookupOrAdd({ indices, index_count }, header.indices_hash, file);
+
+        result.mesh = std::make_shared<TriangleMesh>(
+            static_cast<int>(header.triangle_count), vertex_count, indices, p, n, uv,
+            (header.flags & MESH_FILE_REVERSE_ORIENTATION) != 0, (header.flags & MESH_FILE_SWAPS_HANDEDNESS) != 0,
+            file);
+        if (header.bvh_offset != 0) {
+            result.bvh_nodes = reinterpret_cast<const MeshBVHNode*>(data + header.bvh_offset);
+            result.bvh_node_count = header.bvh_node_count;
+        }
+
+        auto end_time = std::chrono::steady_clock::now();
+        std::cout << "[INFO] Mapped \"" << path << "\": " << header.triangle_count << " triangles, " << header.vertex_count
+            << " vertices, " << header.bvh_node_count << " BVH nodes in "
+            << std::chrono::duration<double, std::milli>(end_time - start_time).count() << " ms." << std::endl;
+        return result;
+    }
+
+    std::vector<std::shared_ptr<Primitive>> CreateMeshPrimitives(const MeshFile& file, const std::shared_ptr<Material>& material) {
+        std::vector<std::shared_ptr<Primitive>> triangles;
+        if (!file.mesh) return triangles;
+
+        if (file.bvh_node_count > 0) {
+            // 子节点总是排在父节点之后, 顺序扫描一遍即可得到每个节点的深度; 校验只读节点数组, 不分配图元
+            const int32_t node_count = static_cast<int32_t>(std::min<size_t>(file.bvh_node_count, INT32_MAX));
+            std::vector<uint8_t> depth(node_count, 0);
+            int32_t invalid_node = -1;
+            for (int32_t i = 0; i < node_count && invalid_node < 0; ++i) {
+                for (int32_t child : file.bvh_nodes[i].children) {
+                    bool valid = child >= 0 ? child > i && child < node_count && depth[i] + 1 < MeshFileBVH::MAX_DEPTH :
+                        ~child < file.mesh->triangle_count;
+                    if (!valid) {
+                        invalid_node = i;
+                        break;
+                    }
+                    if (child >= 0) depth[child] = std::max<uint8_t>(depth[child], depth[i] + 1);
+                }
+            }
+            if (invalid_node < 0) return { std::make_shared<MeshFileBVH>(file, material) };
+            std::cerr << "[ERROR] Invalid BVH node " << invalid_node << " in mesh file, ignoring the stored BVH." << std::endl;
+        }
+
+        triangles.reserve(file.mesh->triangle_count);
+        for (const auto& triangle : CreateTriangles(file.mesh)) {
+            triangles.push_back(std::make_shared<GeometricPrimitive>(triangle, material));
+        }
+        return triangles;
+    }
+
+    MeshFileBVH::MeshFileBVH(const MeshFile& file, const std::shared_ptr<Material>& material) :
+        mesh(file.mesh), nodes(file.bvh_nodes), material(material) {
+        id = next_id.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    bool MeshFileBVH::Intersect(const Ray& ray, double t_min, double t_max) const {
+        // 栈中保存 MeshBVHNode::children 形式的引用: 不小于 0 为节点, 小于 0 为三角形
+        int32_t stack[MAX_DEPTH + 1];
+        int stack_size = 0;
+        stack[stack_size++] = 0;
+        SurfaceInteraction hit_point;
+        while (stack_size > 0) {
+            const int32_t ref = stack[--stack_size];
+            if (ref < 0) {
+                if (IntersectMeshTriangle(*mesh, ~ref, ray, hit_point, t_min, t_max)) return true;
+                continue;
+            }
+            const MeshBVHNode& node = nodes[ref];
+            if (!LoadBounds(node.bounds).Hit(ray, t_min, t_max)) continue;
+            if (node.children[1] != node.children[0]) stack[stack_size++] = node.children[1];
+            stack[stack_size++] = node.children[0];
+        }
+        return false;
+    }
+
+    bool MeshFileBVH::IntersectP(const Ray& ray, SurfaceInteraction& isect, double t_min, double t_max) const {
+        int32_t stack[MAX_DEPTH + 1];
+        int stack_size = 0;
+        stack[stack_size++] = 0;
+        bool hit = false;
+        while (stack_size > 0) {
+            const int32_t ref = stack[--stack_size];
+            if (ref < 0) {
+                if (IntersectMeshTriangle(*mesh, ~ref, ray, isect, t_min, t_max)) {
+                    hit = true;
+                    t_max = isect.time;
+                }
+                continue;
+            }
+            const MeshBVHNode& node = nodes[ref];
+            if (!LoadBounds(node.bounds).Hit(ray, t_min, t_max)) continue;
+            if (node.children[1] != node.children[0]) stack[stack_size++] = node.children[1];
+            stack[stack_size++] = node.children[0];
+        }
+        if (!hit) return false;
+        isect.primitive = this;
+        isect.material = material.get();
+        return true;
+    }
+
+    Bounds3 MeshFileBVH::WorldBound(double, double) const {
+        return LoadBounds(nodes[0].bounds);
+    }
+
+    const Material* MeshFileBVH::GetMaterial() const {
+        return material.get();
+    }
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "primitive.h"
+#include "triangle.h"
+
+namespace Aokana {
+
+    // 二进制网格文件 (.amesh)
+    // 各段数据的内存布局与 TriangleMesh 使用的类型完全相同, 读取时把整个文件映射到内存中, 网格直接引用映射的数据而不做任何解析或拷贝.
+    // 可以附带一个预先构建好的 BVH, 渲染时直接在映射的节点数组上遍历, 不必重新划分, 也不为节点与三角形创建对象.
+    // 头部保存了各段数据的哈希值, 在 BufferCache 中查找时不必先读一遍数据来计算哈希; 但哈希值相同时仍要逐字节比较确认,
+    // 命中缓存的段会被完整读取一次 (之后网格使用缓存中的副本, 映射的这一段不再被访问), 未命中的段在读取时不会被访问.
+    //
+    // 文件布局: MeshFileHeader | positions (Point3[vertex_count]) | normals (Normal3[vertex_count], 可选)
+    //          | uvs (Point2[vertex_count], 可选) | indices (int32[3 * triangle_count]) | bvh (MeshBVHNode[bvh_node_count], 可选)
+    // 每一段从 64 字节对齐的偏移处开始, 偏移为 0 表示没有这一段. 所有数值均为小端序
+
+    constexpr char MESH_FILE_MAGIC[8] = { 'A', 'O', 'K', 'M', 'E', 'S', 'H', '\0' };
+    constexpr uint32_t MESH_FILE_VERSION = 2;
+
+    constexpr uint32_t MESH_FILE_REVERSE_ORIENTATION = 1 << 0;
+    constexpr uint32_t MESH_FILE_SWAPS_HANDEDNESS = 1 << 1;
+
+    struct MeshFileHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t flags;
+        uint64_t vertex_count;
+        uint64_t triangle_count;
+        uint64_t bvh_node_count;
+        uint64_t positions_offset;
+        uint64_t normals_offset;
+        uint64_t uvs_offset;
+        uint64_t indices_offset;
+        uint64_t bvh_offset;
+        double bounds[6];               // 所有顶点的包围盒, min xyz, max xyz
+        uint64_t positions_hash;        // 各段数据的 BufferCache<T>::Hash, 没有的段为 0
+        uint64_t normals_hash;
+        uint64_t uvs_hash;
+        uint64_t indices_hash;
+    };
+
+    // 与 BVHNode 一一对应的二叉节点, 节点按先序排列, 根节点为第 0 个.
+    // 子节点编号不小于 0 时指向另一个节点, 小于 0 时指向第 ~child 个三角形; 只有一个三角形的节点两个子节点相同
+    struct MeshBVHNode {
+        double bounds[6];
+        int32_t children[2];
+    };
+
+    struct MeshFile {
+        std::shared_ptr<TriangleMesh> mesh;
+        const MeshBVHNode* bvh_nodes = nullptr;     // 指向映射的文件, 由 mesh 保持有效
+        size_t bvh_node_count = 0;
+    };
+
+    // 把网格写入 path, build_bvh 为 true 时同时构建并保存 BVH. 失败时输出错误并返回 false
+    bool WriteMeshFile(const std::string& path, const std::shared_ptr<const TriangleMesh>& mesh, bool build_bvh = true);
+    // 映射并校验网格文件, 失败时输出错误并返回 mesh 为空的结果.
+    // 顶点与索引数据经过 BufferCache 去重: 已经读取过内容相同的数据时网格直接使用已有的缓冲区
+    MeshFile LoadMeshFile(const std::string& path);
+    // 文件带有有效的 BVH 时返回单个 MeshFileBVH, 否则为网格的每个三角形创建一个图元
+    std::vector<std::shared_ptr<Primitive>> CreateMeshPrimitives(const MeshFile& file, const std::shared_ptr<Material>& material);
+
+    // 直接在映射的 MeshBVHNode 数组与网格的索引上遍历文件中保存的 BVH, 不为节点与三角形分配任何对象.
+    // 整个网格使用同一个材质与图元编号. 节点应已经过 CreateMeshPrimitives 的校验
+    class MeshFileBVH : public Primitive {
+    public:
+        // 遍历栈的深度, 更深的 BVH 不能直接遍历
+        static constexpr int MAX_DEPTH = 64;
+
+        MeshFileBVH(const MeshFile& file, const std::shared_ptr<Material>& material);
+
+        virtual bool Intersect(const Ray& ray, double t_min = 0.0001, double t_max = 1.0) const override;
+        virtual bool IntersectP(const Ray& ray, SurfaceInteraction& isect, double t_min = 0.0001, double t_max = 1.0) const override;
+        virtual Bounds3 WorldBound(double time0 = 0.0001, double time1 = 1.0) const override;
+        virtual const Material* GetMaterial() const override;
+
+    private:
+        std::shared_ptr<const TriangleMesh> mesh;   // 同时保持映射的文件有效
+        const MeshBVHNode* nodes;
+        std::shared_ptr<Material> material;
+    };
+}
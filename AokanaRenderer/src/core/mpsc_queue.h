@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <utility>
+
+namespace Aokana {
+
+    // 多生产者, 单消费者的无锁队列
+    // 生产者以 CAS 把节点压入一个无锁栈; 消费者一次取走整个栈, 反转后按入队顺序处理.
+    // Push 可以在任意线程调用, ConsumeAll 只能由同一个消费者线程调用, 每次调用的开销只与新入队的元素个数有关
+    template <typename T>
+    class MPSCQueue {
+    public:
+        MPSCQueue() = default;
+        MPSCQueue(const MPSCQueue&) = delete;
+        MPSCQueue& operator=(const MPSCQueue&) = delete;
+
+        ~MPSCQueue() {
+            Node* node = head.exchange(nullptr, std::memory_order_acquire);
+            while (node != nullptr) {
+                Node* next = node->next;
+                delete node;
+                node = next;
+            }
+        }
+
+        void Push(T value) {
+            Node* node = new Node{ std::move(value), head.load(std::memory_order_relaxed) };
+            // release: 生产者在入队之前写入的数据 (例如 tile 的像素) 对消费者可见
+            while (!head.compare_exchange_weak(node->next, node, std::memory_order_release, std::memory_order_relaxed)) {}
+        }
+
+        // 按入队顺序对所有新元素调用 consumer, 返回处理的元素个数
+        template <typename F>
+        size_t ConsumeAll(F&& consumer) {
+            Node* node = head.exchange(nullptr, std::memory_order_acquire);
+
+            Node* reversed = nullptr;
+            while (node != nullptr) {
+                Node* next = node->next;
+                node->next = reversed;
+                reversed = node;
+                node = next;
+            }
+
+            size_t count = 0;
+            while (reversed != nullptr) {
+                Node* next = reversed->next;
+                consumer(reversed->value);
+                delete reversed;
+                reversed = next;
+                ++count;
+            }
+            return count;
+        }
+
+        bool Empty() const { return head.load(std::memory_order_relaxed) == nullptr; }
+
+    private:
+        struct Node {
+            T value;
+            Node* next;
+        };
+
+        std::atomic<Node*> head = nullptr;
+    };
+}
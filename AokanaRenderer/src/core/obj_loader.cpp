@@ -0,0 +1,365 @@
+#include "obj_loader.h"
+#include "mapped_file.h"
+#include "thread_pool.h"
+#include "worker_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <cstdint>
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+
+namespace Aokana {
+
+    namespace {
+
+        constexpr size_t MIN_CHUNK_SIZE = 1 << 20;  // 小于 1 MB 的块不值得单独分给一个线程
+        constexpr int NO_INDEX = INT_MIN;
+
+        // 面的一个角. 正数索引在解析时已经转为从 0 开始的全局索引;
+        // 负数索引相对于块内已读到的元素数, 对应的 relative 位为 1, 拼接时再加上之前各块的元素数
+        struct ObjCorner {
+            int v, vt, vn;
+            uint8_t relative;
+        };
+
+        struct ObjChunk {
+            std::vector<Point3> positions;
+            std::vector<Point2> uvs;
+            std::vector<Normal3> normals;
+            std::vector<ObjCorner> corners;         // 每三个为一个三角形
+            bool all_corners_have_uv = true;
+            bool all_corners_have_normal = true;
+            std::string error;
+        };
+
+        bool IsSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+        const char* SkipSpaces(const char* p, const char* end) {
+            while (p < end && IsSpace(*p)) ++p;
+            return p;
+        }
+
+        bool ParseDouble(const char*& p, const char* end, double& value) {
+            p = SkipSpaces(p, end);
+            // from_chars 不接受前导的 '+'
+            if (p < end && *p == '+') ++p;
+            auto [next, ec] = std::from_chars(p, end, value);
+            if (ec != std::errc()) return false;
+            p = next;
+            return true;
+        }
+
+        bool ParseInt(const char*& p, const char* end, int& value) {
+            if (p < end && *p == '+') ++p;
+            auto [next, ec] = std::from_chars(p, end, value);
+            if (ec != std::errc()) return false;
+            p = next;
+            return true;
+        }
+
+        // 把 OBJ 索引转换为 ObjCorner 中的表示, 0 不是合法的索引
+        bool ResolveIndex(int index, size_t local_count, int& resolved, uint8_t& relative, uint8_t bit) {
+            if (index > 0) {
+                resolved = index - 1;
+            }
+            else if (index < 0) {
+                resolved = static_cast<int>(local_count) + index;
+                relative |= bit;
+            }
+            else {
+                return false;
+            }
+            return true;
+        }
+
+        // 解析 "v", "v/vt", "v//vn" 或 "v/vt/vn"
+        bool ParseCorner(const char*& p, const char* end, const ObjChunk& chunk, ObjCorner& corner) {
+            int v = 0, vt = 0, vn = 0;
+            corner = ObjCorner{ NO_INDEX, NO_INDEX, NO_INDEX, 0 };
+            if (!ParseInt(p, end, v) || !ResolveIndex(v, chunk.positions.size(), corner.v, corner.relative, 1)) return false;
+            if (p < end && *p == '/') {
+                ++p;
+                if (p < end && *p != '/') {
+                    if (!ParseInt(p, end, vt) || !ResolveIndex(vt, chunk.uvs.size(), corner.vt, corner.relative, 2)) return false;
+                }
+                if (p < end && *p == '/') {
+                    ++p;
+                    if (!ParseInt(p, end, vn) || !ResolveIndex(vn, chunk.normals.size(), corner.vn, corner.relative, 4)) return false;
+                }
+            }
+            return p == end || IsSpace(*p);
+        }
+
+        void ParseChunk(const char* begin, const char* end, ObjChunk& chunk) {
+            // 按块的字节数粗略估计元素个数, 减少扩容的次数
+            chunk.positions.reserve((end - begin) / 64);
+            chunk.corners.reserve((end - begin) / 16);
+            std::vector<ObjCorner> polygon;
+
+            const char* line = begin;
+            while (line < end) {
+                const char* line_end = static_cast<const char*>(std::memchr(line, '\n', end - line));
+                if (line_end == nullptr) line_end = end;
+                const char* p = SkipSpaces(line, line_end);
+
+                if (p + 1 < line_end && p[0] == 'v' && IsSpace(p[1])) {
+                    double x, y, z;
+                    ++p;
+                    if (!ParseDouble(p, line_end, x) || !ParseDouble(p, line_end, y) || !ParseDouble(p, line_end, z)) {
+                        chunk.error = "Malformed vertex \"" + std::string(line, line_end) + "\"";
+                        return;
+                    }
+                    chunk.positions.emplace_back(x, y, z);
+                }
+                else if (p + 2 < line_end && p[0] == 'v' && p[1] == 't' && IsSpace(p[2])) {
+                    double u, v = 0;
+                    p += 2;
+                    if (!ParseDouble(p, line_end, u)) {
+                        chunk.error = "Malformed texture coordinate \"" + std::string(line, line_end) + "\"";
+                        return;
+                    }
+                    ParseDouble(p, line_end, v);
+                    chunk.uvs.emplace_back(u, v);
+                }
+                else if (p + 2 < line_end && p[0] == 'v' && p[1] == 'n' && IsSpace(p[2])) {
+                    double x, y, z;
+                    p += 2;
+                    if (!ParseDouble(p, line_end, x) || !ParseDouble(p, line_end, y) || !ParseDouble(p, line_end, z)) {
+                        chunk.error = "Malformed normal \"" + std::string(line, line_end) + "\"";
+                        return;
+                    }
+                    chunk.normals.emplace_back(x, y, z);
+                }
+                else if (p + 1 < line_end && p[0] == 'f' && IsSpace(p[1])) {
+                    polygon.clear();
+                    ++p;
+                    while ((p = SkipSpaces(p, line_end)) < line_end && *p != '#') {
+                        ObjCorner corner;
+                        if (!ParseCorner(p, line_end, chunk, corner)) {
+                            chunk.error = "Malformed face \"" + std::string(line, line_end) + "\"";
+                            return;
+                        }
+                        polygon.push_back(corner);
+                    }
+                    if (polygon.size() < 3) {
+                        chunk.error = "Face with fewer than 3 vertices \"" + std::string(line, line_end) + "\"";
+                        return;
+                    }
+                    for (const ObjCorner& corner : polygon) {
+                        chunk.all_corners_have_uv &= corner.vt != NO_INDEX;
+                        chunk.all_corners_have_normal &= corner.vn != NO_INDEX;
+                    }
+                    // 扇形三角化
+                    for (size_t i = 2; i < polygon.size(); ++i) {
+                        chunk.corners.push_back(polygon[0]);
+                        chunk.corners.push_back(polygon[i - 1]);
+                        chunk.corners.push_back(polygon[i]);
+                    }
+                }
+                line = line_end + 1;
+            }
+        }
+
+        // 把块内索引转换为全局索引, 越界时返回 false
+        bool GlobalIndex(int index, bool relative, size_t offset, size_t total, int& global) {
+            if (index == NO_INDEX) {
+                global = -1;
+                return true;
+            }
+            int64_t value = relative ? static_cast<int64_t>(offset) + index : index;
+            if (value < 0 || value >= static_cast<int64_t>(total)) return false;
+            global = static_cast<int>(value);
+            return true;
+        }
+
+        struct VertexKey {
+            int v, vt, vn;
+            bool operator==(const VertexKey& rhs) const { return v == rhs.v && vt == rhs.vt && vn == rhs.vn; }
+        };
+
+        struct VertexKeyHasher {
+            size_t operator()(const VertexKey& key) const {
+                uint64_t h = static_cast<uint32_t>(key.v) * 0x9E3779B97F4A7C15ull;
+                h ^= (static_cast<uint64_t>(static_cast<uint32_t>(key.vt)) << 32 | static_cast<uint32_t>(key.vn)) + 0x632BE59BD9B4E019ull + (h << 6) + (h >> 2);
+                return static_cast<size_t>(h);
+            }
+        };
+    }
+
+    std::shared_ptr<TriangleMesh> LoadObjMesh(const std::string& path, const Transform& render_from_object, bool reverse_orientation, const MeshCompression& compression) {
+        auto start_time = std::chrono::steady_clock::now();
+
+        MappedFile file;
+        if (!file.Open(path)) {
+            std::cerr << "[ERROR] Failed to open OBJ file \"" << path << "\"." << std::endl;
+            return nullptr;
+        }
+        const char* data = file.Data();
+        const size_t size = file.Size();
+
+        BS::work_stealing_pool& pool = SharedWorkerPool();
+
+        // 按大小均分后把每个块的起点推到下一行的开头
+        size_t chunk_count = std::clamp<size_t>(size / MIN_CHUNK_SIZE, 1, static_cast<size_t>(pool.get_thread_count()) * 4);
+        std::vector<size_t> boundaries(chunk_count + 1, size);
+        boundaries[0] = 0;
+        for (size_t i = 1; i < chunk_count; ++i) {
+            size_t offset = std::max(size * i / chunk_count, boundaries[i - 1]);
+            const void* newline = offset < size ? std::memchr(data + offset, '\n', size - offset) : nullptr;
+            boundaries[i] = newline ? static_cast<const char*>(newline) - data + 1 : size;
+        }
+
+        std::vector<ObjChunk> chunks(chunk_count);
+        pool.parallel_for(size_t(0), chunk_count, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                ParseChunk(data + boundaries[i], data + boundaries[i + 1], chunks[i]);
+            }
+        }, 1);
+
+        // 各块元素在全局数组中的起始位置
+        std::vector<size_t> position_offset(chunk_count + 1, 0), uv_offset(chunk_count + 1, 0);
+        std::vector<size_t> normal_offset(chunk_count + 1, 0), corner_offset(chunk_count + 1, 0);
+        bool has_uv = true, has_normal = true;
+        for (size_t i = 0; i < chunk_count; ++i) {
+            if (!chunks[i].error.empty()) {
+                std::cerr << "[ERROR] " << chunks[i].error << " in OBJ file \"" << path << "\"." << std::endl;
+                return nullptr;
+            }
+            position_offset[i + 1] = position_offset[i] + chunks[i].positions.size();
+            uv_offset[i + 1] = uv_offset[i] + chunks[i].uvs.size();
+            normal_offset[i + 1] = normal_offset[i] + chunks[i].normals.size();
+            corner_offset[i + 1] = corner_offset[i] + chunks[i].corners.size();
+            has_uv &= chunks[i].all_corners_have_uv;
+            has_normal &= chunks[i].all_corners_have_normal;
+        }
+        const size_t position_count = position_offset[chunk_count];
+        const size_t corner_count = corner_offset[chunk_count];
+        if (corner_count == 0) {
+            std::cerr << "[ERROR] OBJ file \"" << path << "\" contains no faces." << std::endl;
+            return nullptr;
+        }
+        if (position_count > static_cast<size_t>(INT_MAX) || corner_count > static_cast<size_t>(INT_MAX)) {
+            std::cerr << "[ERROR] OBJ file \"" << path << "\" is too large to be indexed with 32-bit integers." << std::endl;
+            return nullptr;
+        }
+        has_uv &= uv_offset[chunk_count] > 0;
+        has_normal &= normal_offset[chunk_count] > 0;
+
+        // 拼接各块的顶点数据, 并把面的索引转换为全局索引
+        std::vector<Point3> positions(position_count);
+        std::vector<Point2> uvs(has_uv ? uv_offset[chunk_count] : 0);
+        std::vector<Normal3> normals(has_normal ? normal_offset[chunk_count] : 0);
+        std::vector<VertexKey> keys(corner_count);
+        std::atomic<bool> index_out_of_range{ false };
+        pool.parallel_for(size_t(0), chunk_count, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                const ObjChunk& chunk = chunks[i];
+                std::copy(chunk.positions.begin(), chunk.positions.end(), positions.begin() + position_offset[i]);
+                if (has_uv) std::copy(chunk.uvs.begin(), chunk.uvs.end(), uvs.begin() + uv_offset[i]);
+                if (has_normal) std::copy(chunk.normals.begin(), chunk.normals.end(), normals.begin() + normal_offset[i]);
+                for (size_t c = 0; c < chunk.corners.size(); ++c) {
+                    const ObjCorner& corner = chunk.corners[c];
+                    VertexKey& key = keys[corner_offset[i] + c];
+                    bool valid = GlobalIndex(corner.v, corner.relative & 1, position_offset[i], position_count, key.v);
+                    valid &= GlobalIndex(has_uv ? corner.vt : NO_INDEX, corner.relative & 2, uv_offset[i], uvs.size(), key.vt);
+                    valid &= GlobalIndex(has_normal ? corner.vn : NO_INDEX, corner.relative & 4, normal_offset[i], normals.size(), key.vn);
+                    if (!valid) index_out_of_range.store(true, std::memory_order_relaxed);
+                }
+            }
+        }, 1);
+        chunks.clear();
+        if (index_out_of_range) {
+            std::cerr << "[ERROR] Face index out of range in OBJ file \"" << path << "\"." << std::endl;
+            return nullptr;
+        }
+
+        // 顶点默认与位置一一对应. 每个位置由引用它的第一个角决定纹理坐标和法线,
+        // 与之不同的角 (位置在 UV 接缝或硬边上) 另外生成新的顶点
+        std::vector<int> indices(corner_count);
+        std::vector<Point2> vertex_uvs;
+        std::vector<Normal3> vertex_normals;
+        if (!has_uv && !has_normal) {
+            pool.parallel_for(size_t(0), corner_count, [&](size_t begin, size_t end) {
+                for (size_t c = begin; c < end; ++c) indices[c] = keys[c].v;
+            });
+        }
+        else {
+            std::vector<std::atomic<int>> owner(position_count);
+            pool.parallel_for(size_t(0), position_count, [&](size_t begin, size_t end) {
+                for (size_t v = begin; v < end; ++v) owner[v].store(INT_MAX, std::memory_order_relaxed);
+            });
+            pool.parallel_for(size_t(0), corner_count, [&](size_t begin, size_t end) {
+                for (size_t c = begin; c < end; ++c) {
+                    std::atomic<int>& first = owner[keys[c].v];
+                    int current = first.load(std::memory_order_relaxed);
+                    while (static_cast<int>(c) < current && !first.compare_exchange_weak(current, static_cast<int>(c), std::memory_order_relaxed)) {}
+                }
+            });
+            std::atomic<bool> needs_split{ false };
+            pool.parallel_for(size_t(0), corner_count, [&](size_t begin, size_t end) {
+                bool split = false;
+                for (size_t c = begin; c < end; ++c) {
+                    const VertexKey& key = keys[c];
+                    const VertexKey& first = keys[owner[key.v].load(std::memory_order_relaxed)];
+                    if (key.vt == first.vt && key.vn == first.vn) {
+                        indices[c] = key.v;
+                    }
+                    else {
+                        indices[c] = -1;
+                        split = true;
+                    }
+                }
+                if (split) needs_split.store(true, std::memory_order_relaxed);
+            });
+
+            // 未被任何面引用的位置使用默认的纹理坐标和法线
+            if (has_uv) vertex_uvs.resize(position_count);
+            if (has_normal) vertex_normals.resize(position_count);
+            pool.parallel_for(size_t(0), position_count, [&](size_t begin, size_t end) {
+                for (size_t v = begin; v < end; ++v) {
+                    int first = owner[v].load(std::memory_order_relaxed);
+                    if (first == INT_MAX) continue;
+                    if (has_uv) vertex_uvs[v] = uvs[keys[first].vt];
+                    if (has_normal) vertex_normals[v] = normals[keys[first].vn];
+                }
+            });
+
+            if (needs_split) {
+                std::unordered_map<VertexKey, int, VertexKeyHasher> split_vertices;
+                for (size_t c = 0; c < corner_count; ++c) {
+                    if (indices[c] >= 0) continue;
+                    const VertexKey& key = keys[c];
+                    auto [iter, inserted] = split_vertices.try_emplace(key, static_cast<int>(positions.size()));
+                    if (inserted) {
+                        positions.push_back(positions[key.v]);
+                        if (has_uv) vertex_uvs.push_back(uvs[key.vt]);
+                        if (has_normal) vertex_normals.push_back(normals[key.vn]);
+                    }
+                    indices[c] = iter->second;
+                }
+                if (positions.size() > static_cast<size_t>(INT_MAX)) {
+                    std::cerr << "[ERROR] OBJ file \"" << path << "\" is too large to be indexed with 32-bit integers." << std::endl;
+                    return nullptr;
+                }
+            }
+        }
+        keys.clear();
+        keys.shrink_to_fit();
+
+        const size_t vertex_count = positions.size();
+        auto mesh = std::make_shared<TriangleMesh>(render_from_object, reverse_orientation, std::move(indices),
+            std::move(positions), std::vector<Vector3>(), std::move(vertex_normals), std::move(vertex_uvs), std::vector<int>(), compression);
+
+        auto end_time = std::chrono::steady_clock::now();
+        std::cout << "[INFO] Loaded \"" << path << "\": " << mesh->triangle_count << " triangles, " << vertex_count
+            << " vertices, " << mesh->BytesUsed() / 1024 << " KB in " << std::chrono::duration<double, std::milli>(end_time - start_time).count()
+            << " ms with " << chunk_count << " chunks." << std::endl;
+        return mesh;
+    }
+}
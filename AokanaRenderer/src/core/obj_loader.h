@@ -0,0 +1,19 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include "transform.h"
+#include "triangle.h"
+
+namespace Aokana {
+
+    // Wavefront OBJ 读取
+    // 文件以内存映射方式打开, 按行边界切成若干块在线程池上并行解析, 各块的结果按顺序拼接后直接生成带索引的 TriangleMesh.
+    // 支持 v / vt / vn / f (含负数的相对索引, 多边形按扇形三角化), 其余语句 (o, g, s, usemtl, mtllib, l, p) 被忽略.
+    // 同一位置在不同面上使用不同的纹理坐标或法线时会拆成多个顶点; 只有所有面都给出纹理坐标 (法线) 时网格才带有它们.
+    // 顶点属性按 compression 压缩. 失败时输出错误并返回 nullptr
+    std::shared_ptr<TriangleMesh> LoadObjMesh(const std::string& path,
+        const Transform& render_from_object = Transform(), bool reverse_orientation = false,
+        const MeshCompression& compression = MeshCompression());
+}
@@ -1,5 +1,6 @@
 #include "primitive.h"
-#include "../external/obj_loader/OBJ_Loader.h"
+#include "mesh_file.h"
+#include "obj_loader.h"
 
 
 namespace Aokana {
@@ -77,38 +78,23 @@ namespace Aokana {
         }
     }
 
-    void Aggregate::AddObj(const std::string& filepath, const std::shared_ptr<Material>& material, bool filp_x_axis) {
-        objl::Loader objLoader;
-        objLoader.LoadFile(filepath);
-
-        double flip = 1.0;
-        if (filp_x_axis) flip = -1.0;
-
-        for (auto& mesh : objLoader.LoadedMeshes) {
-            for (int i = 2;i < mesh.Indices.size();i += 3) {
-                Point3 a(
-                    flip * mesh.Vertices[mesh.Indices[i - 2]].Position.X,
-                    mesh.Vertices[mesh.Indices[i - 2]].Position.Y,
-                    mesh.Vertices[mesh.Indices[i - 2]].Position.Z);
-
-                Point3 b(
-                    flip * mesh.Vertices[mesh.Indices[i - 1]].Position.X,
-                    mesh.Vertices[mesh.Indices[i - 1]].Position.Y,
-                    mesh.Vertices[mesh.Indices[i - 1]].Position.Z);
-
-                Point3 c(
-                    flip * mesh.Vertices[mesh.Indices[i]].Position.X,
-                    mesh.Vertices[mesh.Indices[i]].Position.Y,
-                    mesh.Vertices[mesh.Indices[i]].Position.Z);
-
-                primitives.push_back(
-                    std::make_shared<GeometricPrimitive>(
-                        std::make_shared<Triangle>(a, b, c),
-                        material
-                    )
-                );
-            }
+    void Aggregate::AddObj(const std::string& filepath, const std::shared_ptr<Material>& material, bool filp_x_axis, const MeshCompression& compression) {
+        Transform render_from_object = filp_x_axis ? Transform::Scale(-1, 1, 1) : Transform();
+        std::shared_ptr<TriangleMesh> mesh = LoadObjMesh(filepath, render_from_object, false, compression);
+        if (!mesh) return;
+
+        std::vector<std::shared_ptr<Primitive>> triangles;
+        triangles.reserve(mesh->triangle_count);
+        for (const auto& triangle : CreateTriangles(mesh)) {
+            triangles.push_back(std::make_shared<GeometricPrimitive>(triangle, material));
         }
+        AddPrimitives(triangles);
+    }
+
+    void Aggregate::AddMesh(const std::string& filepath, const std::shared_ptr<Material>& material) {
+        MeshFile file = LoadMeshFile(filepath);
+        if (!file.mesh) return;
+        AddPrimitives(CreateMeshPrimitives(file, material));
     }
 
-}
\ No newline at end of file
+}
@@ -1,9 +1,13 @@
 #pragma once
 
+#include <atomic>
+#include <cstdint>
+
 #include "interaction.h"
 #include "bounds.h"
 #include "material.h"
 #include "shape.h"
+#include "quantized.h"
 
 namespace Aokana {
 
@@ -12,10 +16,18 @@ namespace Aokana {
 
     class Primitive {
     public:
+        virtual ~Primitive() = default;
+
+        // 可以被光线击中的图元 (GeometricPrimitive, MeshFileBVH) 按创建顺序从 1 开始编号, 用于输出图元编号 AOV; 聚合体的编号为 0
+        uint32_t id = 0;
+
         virtual bool Intersect(const Ray& ray, double t_min = 0.0001, double t_max = 1.0) const = 0;
         virtual bool IntersectP(const Ray& ray, SurfaceInteraction& isect, double t_min = 0.0001, double t_max = 1.0) const = 0;
         virtual Bounds3 WorldBound(double time0 = 0.0001, double time1 = 1.0) const = 0;
         virtual const Material* GetMaterial() const = 0;
+
+    protected:
+        inline static std::atomic<uint32_t> next_id{ 1 };
     };
 
     class GeometricPrimitive : public Primitive {
@@ -23,7 +35,9 @@ namespace Aokana {
         GeometricPrimitive(
             const std::shared_ptr<Shape>& shape,
             const std::shared_ptr<Material>& material) :
-            shape(shape), material(material) {}
+            shape(shape), material(material) {
+            id = next_id.fetch_add(1, std::memory_order_relaxed);
+        }
 
         virtual bool Intersect(const Ray& ray, double t_min = 0.0001, double t_max = 1.0) const override;
         virtual bool IntersectP(const Ray& ray, SurfaceInteraction& isect, double t_min = 0.0001, double t_max = 1.0) const override;
@@ -48,7 +62,10 @@ namespace Aokana {
 
         void AddPrimitive(const std::shared_ptr<Primitive>& primitive);
         void AddPrimitives(const std::vector<std::shared_ptr<Primitive>>& primitive_list);
-        void AddObj(const std::string& filepath, const std::shared_ptr<Material>& material, bool filp_x_axis = true);
+        void AddObj(const std::string& filepath, const std::shared_ptr<Material>& material, bool filp_x_axis = true,
+            const MeshCompression& compression = MeshCompression());
+        // 读取二进制网格文件 (见 mesh_file.h), 文件带有 BVH 时只加入一个直接遍历该 BVH 的图元
+        void AddMesh(const std::string& filepath, const std::shared_ptr<Material>& material);
 
     public:
         std::vector<std::shared_ptr<Primitive>> primitives;
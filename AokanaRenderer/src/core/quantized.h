@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+#include "utils.h"
+
+namespace Aokana {
+
+    // 16 位定点数, 表示 [min, min + extent] 中的值. 精度为 extent / 65535, 相同的输入总是得到相同的结果,
+    // 因此相邻三角形共享的顶点量化后仍然重合
+    inline uint16_t QuantizeUnorm16(double value, double min, double extent) {
+        if (extent <= 0) return 0;
+        return static_cast<uint16_t>(std::round(Clamp01((value - min) / extent) * 65535));
+    }
+
+    inline double DequantizeUnorm16(uint16_t q, double min, double extent) {
+        return min + q * (extent / 65535.0);
+    }
+
+    struct QuantizedPoint2 {
+        uint16_t x, y;
+    };
+
+    struct QuantizedPoint3 {
+        uint16_t x, y, z;
+    };
+
+    // 网格顶点属性的压缩方式. 压缩是有损的, 会改变着色, 因此默认全部关闭, 由场景文件或命令行选择
+    struct MeshCompression {
+        bool normals = false;       // 法线使用八面体映射 (OctahedralVector, 4 字节)
+        bool uvs = false;           // 纹理坐标使用相对于网格 UV 范围的 16 位定点数 (4 字节)
+        bool positions = false;     // 位置使用相对于网格包围盒的 16 位定点数 (6 字节), 精度为包围盒尺寸的 1 / 65535
+    };
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include "hash.h"
+
+namespace Aokana {
+
+    // PCG32 伪随机数生成器
+    // https://www.pcg-random.org/
+    // 状态只有 16 个 byte, 可以廉价地为每个像素样本重新设置序列, 并支持 O(log n) 跳跃到序列中的任意位置
+    class RNG {
+    public:
+        RNG() : state(PCG32_DEFAULT_STATE), inc(PCG32_DEFAULT_STREAM) {}
+        RNG(uint64_t sequence_index, uint64_t offset) { SetSequence(sequence_index, offset); }
+        explicit RNG(uint64_t sequence_index) { SetSequence(sequence_index); }
+
+        void SetSequence(uint64_t sequence_index, uint64_t offset) {
+            state = 0u;
+            inc = (sequence_index << 1u) | 1u;
+            Uniform32();
+            state += offset;
+            Uniform32();
+        }
+
+        void SetSequence(uint64_t sequence_index) { SetSequence(sequence_index, MixBits(sequence_index)); }
+
+        uint32_t Uniform32() {
+            uint64_t old_state = state;
+            state = old_state * PCG32_MULT + inc;
+            uint32_t xorshifted = static_cast<uint32_t>(((old_state >> 18u) ^ old_state) >> 27u);
+            uint32_t rot = static_cast<uint32_t>(old_state >> 59u);
+            return (xorshifted >> rot) | (xorshifted << ((~rot + 1u) & 31));
+        }
+
+        uint64_t Uniform64() {
+            uint64_t v0 = Uniform32(), v1 = Uniform32();
+            return (v0 << 32) | v1;
+        }
+
+        // 返回 [0, 1) 内的均匀随机数
+        double UniformDouble() {
+            return std::min(ONE_MINUS_EPSILON, (Uniform64() >> 11) * 0x1p-53);
+        }
+
+        // 返回 [0, bound) 内的均匀随机整数
+        uint32_t UniformBounded(uint32_t bound) {
+            uint32_t threshold = (~bound + 1u) % bound;
+            while (true) {
+                uint32_t r = Uniform32();
+                if (r >= threshold) return r % bound;
+            }
+        }
+
+        // 将生成器向前 (或向后) 跳过 delta 个输出
+        void Advance(int64_t idelta) {
+            uint64_t cur_mult = PCG32_MULT, cur_plus = inc, acc_mult = 1u;
+            uint64_t acc_plus = 0u, delta = static_cast<uint64_t>(idelta);
+            while (delta > 0) {
+                if (delta & 1) {
+                    acc_mult *= cur_mult;
+                    acc_plus = acc_plus * cur_mult + cur_plus;
+                }
+                cur_plus = (cur_mult + 1) * cur_plus;
+                cur_mult *= cur_mult;
+                delta /= 2;
+            }
+            state = acc_mult * state + acc_plus;
+        }
+
+    private:
+        static constexpr uint64_t PCG32_DEFAULT_STATE = 0x853c49e6748fea9bULL;
+        static constexpr uint64_t PCG32_DEFAULT_STREAM = 0xda3e39cb94b95bdbULL;
+        static constexpr uint64_t PCG32_MULT = 0x5851f42d4c957f2dULL;
+        static constexpr double ONE_MINUS_EPSILON = 0x1.fffffffffffffp-1;
+
+        uint64_t state, inc;
+    };
+}
@@ -1,13 +1,313 @@
 #include "sampler.h"
+#include "lowdiscrepancy.h"
 
 namespace Aokana {
 
-    std::vector<Sample> SimpleSampler::Sampling() const {
-        std::vector<Sample> samples(samples_per_pixel);
-        for (int i = 0;i < samples_per_pixel;++i) {
-            samples[i].u = RandomDoubleIn01();
-            samples[i].v = RandomDoubleIn01();
+    void SimpleSampler::StartPixelSample(int x, int y, int sample_index, int dimension) {
+        // 每个像素一条独立的 PCG32 序列, 每个样本在序列中占用 2^16 个维度
+        rng.SetSequence(Hash(x, y, seed));
+        rng.Advance(sample_index * 65536ull + dimension);
+    }
+
+    double SimpleSampler::Get1D() {
+        return rng.UniformDouble();
+    }
+
+    Point2 SimpleSampler::Get2D() {
+        double u = rng.UniformDouble();
+        double v = rng.UniformDouble();
+        return Point2(u, v);
+    }
+
+    Point2 SimpleSampler::GetPixel2D() {
+        return Get2D();
+    }
+
+    std::unique_ptr<Sampler> SimpleSampler::Clone() const {
+        return std::make_unique<SimpleSampler>(*this);
+    }
+
+    void HaltonSampler::StartPixelSample(int x, int y, int sample_index, int dimension) {
+        pixel_x = x;
+        pixel_y = y;
+        this->sample_index = sample_index;
+        // 第 0, 1 维保留给 GetPixel2D
+        this->dimension = std::max(2, dimension);
+    }
+
+    double HaltonSampler::SampleDimension(int dim) const {
+        // 超出素数表的维度循环使用表中的底, 不同的哈希种子保证它们之间不相关
+        uint32_t hash = static_cast<uint32_t>(Hash(pixel_x, pixel_y, dim, seed));
+        return OwenScrambledRadicalInverse(dim % PRIME_TABLE_SIZE, sample_index, hash);
+    }
+
+    double HaltonSampler::Get1D() {
+        return SampleDimension(dimension++);
+    }
+
+    Point2 HaltonSampler::Get2D() {
+        int dim = dimension;
+        dimension += 2;
+        return Point2(SampleDimension(dim), SampleDimension(dim + 1));
+    }
+
+    Point2 HaltonSampler::GetPixel2D() {
+        return Point2(SampleDimension(0), SampleDimension(1));
+    }
+
+    std::unique_ptr<Sampler> HaltonSampler::Clone() const {
+        return std::make_unique<HaltonSampler>(*this);
+    }
+
+    void SobolSampler::StartPixelSample(int x, int y, int sample_index, int dimension) {
+        pixel_x = x;
+        pixel_y = y;
+        this->sample_index = sample_index;
+        this->dimension = std::max(2, dimension);
+    }
+
+    int SobolSampler::PermutedIndex(uint64_t hash) const {
+        // 每 samples_per_pixel 个样本为一组, 组内做随机排列; 超出的样本继续使用序列后面的点
+        int group = sample_index / samples_per_pixel;
+        int offset = sample_index - group * samples_per_pixel;
+        return group * samples_per_pixel + PermutationElement(offset, samples_per_pixel, static_cast<uint32_t>(hash));
+    }
+
+    double SobolSampler::Get1D() {
+        uint64_t hash = Hash(pixel_x, pixel_y, dimension, seed);
+        int index = PermutedIndex(hash);
+        ++dimension;
+        return SobolSample(index, 0, static_cast<uint32_t>(hash >> 32));
+    }
+
+    Point2 SobolSampler::Get2D() {
+        uint64_t hash = Hash(pixel_x, pixel_y, dimension, seed);
+        int index = PermutedIndex(hash);
+        dimension += 2;
+        uint32_t scramble = static_cast<uint32_t>(MixBits(hash));
+        return Point2(
+            SobolSample(index, 0, static_cast<uint32_t>(hash >> 32)),
+            SobolSample(index, 1, scramble));
+    }
+
+    Point2 SobolSampler::GetPixel2D() {
+        // 像素维度不做排列, 保持 Sobol 序列前缀的分层性质, 便于渐进渲染
+        uint64_t hash = Hash(pixel_x, pixel_y, 0, seed);
+        return Point2(
+            SobolSample(sample_index, 0, static_cast<uint32_t>(hash >> 32)),
+            SobolSample(sample_index, 1, static_cast<uint32_t>(MixBits(hash))));
+    }
+
+    std::unique_ptr<Sampler> SobolSampler::Clone() const {
+        return std::make_unique<SobolSampler>(*this);
+    }
+
+    PMJ02Sampler::PMJ02Sampler(int spp, uint64_t seed) : Sampler(spp), seed(seed) {
+        while (set_size < spp && set_size < PMJ02_MAX_SET_SIZE) set_size *= 2;
+
+        auto points = std::make_shared<std::vector<Point2>>();
+        points->reserve(static_cast<size_t>(set_size) * PMJ02_SET_COUNT);
+        for (int i = 0; i < PMJ02_SET_COUNT; ++i) {
+            std::vector<Point2> set = GeneratePMJ02Samples(set_size, MixBits(seed + i));
+            points->insert(points->end(), set.begin(), set.end());
         }
-        return samples;
+        sets = points;
+    }
+
+    void PMJ02Sampler::StartPixelSample(int x, int y, int sample_index, int dimension) {
+        pixel_x = x;
+        pixel_y = y;
+        this->sample_index = sample_index;
+        this->dimension = std::max(2, dimension);
+    }
+
+    Point2 PMJ02Sampler::SampleDimension(int dim) const {
+        uint64_t hash = Hash(pixel_x, pixel_y, dim, seed);
+        // 像素维度保持原有顺序以保留渐进性, 其余维度在每组 samples_per_pixel 个样本内随机排列
+        int index = sample_index;
+        if (dim != 0) {
+            int group = sample_index / samples_per_pixel;
+            int offset = sample_index - group * samples_per_pixel;
+            index = group * samples_per_pixel + PermutationElement(offset, samples_per_pixel, static_cast<uint32_t>(hash));
+        }
+        int set = static_cast<int>((hash >> 32) % PMJ02_SET_COUNT);
+        set = (set + index / set_size) % PMJ02_SET_COUNT;
+        Point2 u = (*sets)[static_cast<size_t>(set) * set_size + index % set_size];
+
+        // Cranley-Patterson 旋转
+        uint64_t offset_bits = MixBits(hash);
+        u.x += static_cast<uint32_t>(offset_bits) * 0x1p-32;
+        u.y += static_cast<uint32_t>(offset_bits >> 32) * 0x1p-32;
+        if (u.x >= 1) u.x -= 1;
+        if (u.y >= 1) u.y -= 1;
+        return Point2(std::min(u.x, ONE_MINUS_EPSILON), std::min(u.y, ONE_MINUS_EPSILON));
+    }
+
+    double PMJ02Sampler::Get1D() {
+        // 一维样本只需分层: 在 samples_per_pixel 个区间内做随机排列的抖动采样
+        uint64_t hash = Hash(pixel_x, pixel_y, dimension, seed);
+        ++dimension;
+        int offset = sample_index % samples_per_pixel;
+        int stratum = PermutationElement(offset, samples_per_pixel, static_cast<uint32_t>(hash));
+        double jitter = static_cast<uint32_t>(MixBits(hash ^ sample_index)) * 0x1p-32;
+        return std::min((stratum + jitter) / samples_per_pixel, ONE_MINUS_EPSILON);
+    }
+
+    Point2 PMJ02Sampler::Get2D() {
+        int dim = dimension;
+        dimension += 2;
+        return SampleDimension(dim);
+    }
+
+    Point2 PMJ02Sampler::GetPixel2D() {
+        return SampleDimension(0);
+    }
+
+    std::unique_ptr<Sampler> PMJ02Sampler::Clone() const {
+        return std::make_unique<PMJ02Sampler>(*this);
+    }
+
+    namespace {
+
+        // 渐进地构造 pmj02 点集: 每次把点数翻倍, 新的点放在旧点所在格子的空余子格中,
+        // 并保证前 2n 个点在所有形状的基本区间 (2^-k x 2^-(m-k)) 中各占一个
+        class PMJ02Generator {
+        public:
+            explicit PMJ02Generator(uint64_t seed) : rng(seed) {}
+
+            std::vector<Point2> Generate(int count) {
+                points.clear();
+                points.reserve(count);
+                points.push_back(Point2(rng.UniformDouble(), rng.UniformDouble()));
+
+                for (int n = 1, m = 0; n < count; n *= 2, ++m) {
+                    ResetStrata(m + 1, n);
+                    points.resize(2 * n);
+                    int grid = 2 << (m / 2);
+                    if ((m & 1) == 0) {
+                        // n = 4^k: 每个旧点在 2 sqrt(n) 的网格中, 新点放在其对角的子格
+                        for (int i = 0; i < n; ++i) {
+                            int cx = static_cast<int>(points[i].x * grid);
+                            int cy = static_cast<int>(points[i].y * grid);
+                            points[n + i] = PlaceOrJitter(cx ^ 1, cy ^ 1, grid);
+                        }
+                    }
+                    else {
+                        // n = 2 * 4^k: 点 i 和 i + n / 2 位于同一个格子的两个对角子格, 两个新点填满剩余的两个子格
+                        int half = n / 2;
+                        for (int i = 0; i < half; ++i) {
+                            int cx = static_cast<int>(points[i].x * grid);
+                            int cy = static_cast<int>(points[i].y * grid);
+                            PlacePair(cx, cy, grid, points[n + i], points[n + half + i]);
+                        }
+                    }
+                }
+                points.resize(count);
+                return points;
+            }
+
+        private:
+            // 将 [0, 1) 划分为 2^log_total 个最细的条带, 形状 k 的格子由 x 的前 k 位与 y 的前 log_total - k 位确定
+            int CellIndex(int k, int x_stratum, int y_stratum) const {
+                return ((y_stratum >> k) << k) | (x_stratum >> (log_total - k));
+            }
+
+            void ResetStrata(int log_count, int point_count) {
+                log_total = log_count;
+                occupied.assign(static_cast<size_t>(log_total + 1) << log_total, 0);
+                for (int i = 0; i < point_count; ++i) SetOccupied(points[i], 1);
+            }
+
+            void SetOccupied(const Point2& p, char value) {
+                int total = 1 << log_total;
+                int x_stratum = std::min(static_cast<int>(p.x * total), total - 1);
+                int y_stratum = std::min(static_cast<int>(p.y * total), total - 1);
+                for (int k = 0; k <= log_total; ++k) {
+                    occupied[(static_cast<size_t>(k) << log_total) + CellIndex(k, x_stratum, y_stratum)] = value;
+                }
+            }
+
+            bool IsFree(int x_stratum, int y_stratum) const {
+                for (int k = 0; k <= log_total; ++k) {
+                    if (occupied[(static_cast<size_t>(k) << log_total) + CellIndex(k, x_stratum, y_stratum)]) return false;
+                }
+                return true;
+            }
+
+            // 在 grid x grid 网格的子格 (cx, cy) 中寻找一个不与已有点共享任何基本区间的位置
+            bool Place(int cx, int cy, int grid, Point2& p) {
+                int total = 1 << log_total;
+                int strata_per_cell = total / grid;
+                x_candidates.clear();
+                y_candidates.clear();
+                for (int i = 0; i < strata_per_cell; ++i) {
+                    int x_stratum = cx * strata_per_cell + i;
+                    int y_stratum = cy * strata_per_cell + i;
+                    // 形状 log_total 的格子就是 x 方向最细的条带, 形状 0 的格子就是 y 方向最细的条带
+                    if (!occupied[(static_cast<size_t>(log_total) << log_total) + x_stratum]) x_candidates.push_back(x_stratum);
+                    if (!occupied[y_stratum]) y_candidates.push_back(y_stratum);
+                }
+                Shuffle(x_candidates);
+                Shuffle(y_candidates);
+                for (int x_stratum : x_candidates) {
+                    for (int y_stratum : y_candidates) {
+                        if (IsFree(x_stratum, y_stratum)) {
+                            p = Point2((x_stratum + rng.UniformDouble()) / total, (y_stratum + rng.UniformDouble()) / total);
+                            SetOccupied(p, 1);
+                            return true;
+                        }
+                    }
+                }
+                return false;
+            }
+
+            Point2 PlaceOrJitter(int cx, int cy, int grid) {
+                Point2 p;
+                if (Place(cx, cy, grid, p)) return p;
+                // 理论上不会发生; 退化为子格内的抖动采样
+                p = Point2((cx + rng.UniformDouble()) / grid, (cy + rng.UniformDouble()) / grid);
+                SetOccupied(p, 1);
+                return p;
+            }
+
+            void PlacePair(int cx, int cy, int grid, Point2& a, Point2& b) {
+                bool swap = rng.Uniform32() & 1;
+                for (int attempt = 0; attempt < 2; ++attempt, swap = !swap) {
+                    int ax = swap ? cx ^ 1 : cx, ay = swap ? cy : cy ^ 1;
+                    int bx = swap ? cx : cx ^ 1, by = swap ? cy ^ 1 : cy;
+                    if (Place(ax, ay, grid, a)) {
+                        if (Place(bx, by, grid, b)) return;
+                        SetOccupied(a, 0);
+                    }
+                }
+                a = PlaceOrJitter(swap ? cx ^ 1 : cx, swap ? cy : cy ^ 1, grid);
+                b = PlaceOrJitter(swap ? cx : cx ^ 1, swap ? cy ^ 1 : cy, grid);
+            }
+
+            void Shuffle(std::vector<int>& v) {
+                for (size_t i = v.size(); i > 1; --i) {
+                    std::swap(v[i - 1], v[rng.UniformBounded(static_cast<uint32_t>(i))]);
+                }
+            }
+
+            RNG rng;
+            std::vector<Point2> points;
+            std::vector<char> occupied;
+            std::vector<int> x_candidates, y_candidates;
+            int log_total = 0;
+        };
+    }
+
+    std::vector<Point2> GeneratePMJ02Samples(int count, uint64_t seed) {
+        PMJ02Generator generator(seed);
+        return generator.Generate(count);
+    }
+
+    std::shared_ptr<Sampler> CreateSampler(const std::string& name, int spp, uint64_t seed) {
+        if (name == "independent") return std::make_shared<SimpleSampler>(spp, seed);
+        if (name == "halton") return std::make_shared<HaltonSampler>(spp, seed);
+        if (name == "sobol") return std::make_shared<SobolSampler>(spp, seed);
+        if (name == "pmj02") return std::make_shared<PMJ02Sampler>(spp, seed);
+        return nullptr;
     }
-}
\ No newline at end of file
+}
@@ -1,30 +1,139 @@
 #pragma once
 
+#include <memory>
+#include <cstdint>
+#include <string>
 #include <vector>
 
 #include "utils.h"
+#include "vec.h"
+#include "rng.h"
 
 namespace Aokana {
-    struct Sample {
-        double u;
-        double v;
-    };
 
+    // 采样器按维度逐个提供样本值, 不分配任何内存:
+    // 每个像素样本开始时调用 StartPixelSample(x, y, sample_index), 之后按固定顺序调用 GetPixel2D / Get1D / Get2D,
+    // 同一个 (像素, 样本编号, 维度) 总是得到同样的值, 因此渲染结果与线程调度无关
+    // 采样器是有状态的, 多线程渲染时每个任务应通过 Clone() 持有一份独立的副本
     class Sampler {
     public:
         Sampler() = default;
         Sampler(int spp) : samples_per_pixel(spp) {}
+        virtual ~Sampler() = default;
 
         int samples_per_pixel = 20;
-        virtual std::vector<Sample> Sampling() const = 0;
+
+        virtual void StartPixelSample(int x, int y, int sample_index, int dimension = 0) = 0;
+        virtual double Get1D() = 0;
+        virtual Point2 Get2D() = 0;
+        virtual Point2 GetPixel2D() = 0;    // 像素内的胶片采样位置, 总是使用第 0, 1 维
+        virtual std::unique_ptr<Sampler> Clone() const = 0;
+        // CreateSampler 使用的名字与随机种子, 检查点用它们确认恢复时使用的是同一个采样器
+        virtual const char* Name() const = 0;
+        virtual uint64_t Seed() const = 0;
     };
 
+    // 独立均匀随机采样
     class SimpleSampler : public Sampler {
     public:
         SimpleSampler() = default;
-        SimpleSampler(int spp) : Sampler(spp) {}
+        SimpleSampler(int spp, uint64_t seed = 0) : Sampler(spp), seed(seed) {}
+
+        virtual void StartPixelSample(int x, int y, int sample_index, int dimension = 0) override;
+        virtual double Get1D() override;
+        virtual Point2 Get2D() override;
+        virtual Point2 GetPixel2D() override;
+        virtual std::unique_ptr<Sampler> Clone() const override;
+        virtual const char* Name() const override { return "independent"; }
+        virtual uint64_t Seed() const override { return seed; }
+
+    private:
+        uint64_t seed = 0;
+        RNG rng;
+    };
+
+    // Halton 序列采样器
+    // 每个像素使用同一个 Halton 序列, 第 d 维以第 d 个素数为底; 各维度按 (像素, 维度) 的哈希做 Owen 置乱, 消除像素间的相关性
+    class HaltonSampler : public Sampler {
+    public:
+        HaltonSampler(int spp, uint64_t seed = 0) : Sampler(spp), seed(seed) {}
+
+        virtual void StartPixelSample(int x, int y, int sample_index, int dimension = 0) override;
+        virtual double Get1D() override;
+        virtual Point2 Get2D() override;
+        virtual Point2 GetPixel2D() override;
+        virtual std::unique_ptr<Sampler> Clone() const override;
+        virtual const char* Name() const override { return "halton"; }
+        virtual uint64_t Seed() const override { return seed; }
+
+    private:
+        double SampleDimension(int dim) const;
+
+        uint64_t seed = 0;
+        int pixel_x = 0, pixel_y = 0;
+        int sample_index = 0;
+        int dimension = 0;
+    };
+
+    // Owen 置乱的 Sobol 采样器 (padded Sobol)
+    // 每两个维度使用 Sobol 序列的前两维 (一个 (0, 2) 序列), 不同维度之间通过对样本编号做随机排列去相关,
+    // 因此不需要高维的生成矩阵, 每个二维投影都有最好的分层
+    class SobolSampler : public Sampler {
+    public:
+        SobolSampler(int spp, uint64_t seed = 0) : Sampler(spp), seed(seed) {}
+
+        virtual void StartPixelSample(int x, int y, int sample_index, int dimension = 0) override;
+        virtual double Get1D() override;
+        virtual Point2 Get2D() override;
+        virtual Point2 GetPixel2D() override;
+        virtual std::unique_ptr<Sampler> Clone() const override;
+        virtual const char* Name() const override { return "sobol"; }
+        virtual uint64_t Seed() const override { return seed; }
+
+    private:
+        int PermutedIndex(uint64_t hash) const;
+
+        uint64_t seed = 0;
+        int pixel_x = 0, pixel_y = 0;
+        int sample_index = 0;
+        int dimension = 0;
+    };
+
+    // 渐进多重抖动 (0, 2) 序列采样器
+    // Christensen et al., "Progressive Multi-Jittered Sample Sequences", 2018
+    // 构造时生成若干组 pmj02 点集, 任意 2 的幂个前缀样本都构成 (0, m, 2) 网; 每个 (像素, 维度) 选择一组点集,
+    // 对样本编号做随机排列并做 Cranley-Patterson 旋转
+    class PMJ02Sampler : public Sampler {
+    public:
+        PMJ02Sampler(int spp, uint64_t seed = 0);
+
+        virtual void StartPixelSample(int x, int y, int sample_index, int dimension = 0) override;
+        virtual double Get1D() override;
+        virtual Point2 Get2D() override;
+        virtual Point2 GetPixel2D() override;
+        virtual std::unique_ptr<Sampler> Clone() const override;
+        virtual const char* Name() const override { return "pmj02"; }
+        virtual uint64_t Seed() const override { return seed; }
+
+        static constexpr int PMJ02_SET_COUNT = 5;
+        static constexpr int PMJ02_MAX_SET_SIZE = 1 << 14;
 
-        virtual std::vector<Sample> Sampling() const override;
+    private:
+        Point2 SampleDimension(int dim) const;
+
+        uint64_t seed = 0;
+        int pixel_x = 0, pixel_y = 0;
+        int sample_index = 0;
+        int dimension = 0;
+        int set_size = 1;
+        // 点集在所有副本之间共享, Clone() 不会复制
+        std::shared_ptr<const std::vector<Point2>> sets;
     };
 
-}
\ No newline at end of file
+    // 生成 count 个 pmj02 点 (count 为 2 的幂)
+    std::vector<Point2> GeneratePMJ02Samples(int count, uint64_t seed);
+
+    // 按名字创建采样器: "independent", "halton", "sobol", "pmj02"; 未知的名字返回 nullptr
+    std::shared_ptr<Sampler> CreateSampler(const std::string& name, int spp, uint64_t seed = 0);
+
+}
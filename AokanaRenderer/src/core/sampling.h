@@ -0,0 +1,39 @@
+#pragma once
+
+#include "vec.h"
+#include "utils.h"
+
+namespace Aokana {
+
+    // 将 [0, 1)^2 上的均匀样本以同心映射 (Shirley-Chiu concentric mapping) 变换到单位圆盘上
+    // 相比极坐标映射, 同心映射保持了样本的分层结构, 低差异序列的样本映射后仍然分布均匀
+    inline Point2 SampleUniformDiskConcentric(const Point2& u) {
+        double u_x = 2 * u.x - 1;
+        double u_y = 2 * u.y - 1;
+        if (u_x == 0 && u_y == 0) return Point2(0, 0);
+
+        double r, theta;
+        if (std::abs(u_x) > std::abs(u_y)) {
+            r = u_x;
+            theta = (PI / 4) * (u_y / u_x);
+        }
+        else {
+            r = u_y;
+            theta = (PI / 2) - (PI / 4) * (u_x / u_y);
+        }
+        return Point2(r * std::cos(theta), r * std::sin(theta));
+    }
+
+    // 将 [0, 1)^2 上的均匀样本映射为单位球面上均匀分布的方向
+    inline Vector3 SampleUniformSphere(const Point2& u) {
+        double z = 1 - 2 * u.x;
+        double r = std::sqrt(std::max(0.0, 1 - z * z));
+        double phi = 2 * PI * u.y;
+        return Vector3(r * std::cos(phi), r * std::sin(phi), z);
+    }
+
+    // 单位球内均匀分布的点: 方向取自 u, 半径取 u_radius 的立方根
+    inline Vector3 SampleUniformBall(double u_radius, const Point2& u) {
+        return std::cbrt(u_radius) * SampleUniformSphere(u);
+    }
+}
@@ -1,6 +1,7 @@
 #include "scene.h"
 #include "moving_sphere.h"
 #include "bvh.h"
+#include "compressed_bvh.h"
 
 namespace Aokana {
 
@@ -12,6 +13,23 @@ namespace Aokana {
         return aggregate->IntersectP(ray, isect, t_min, t_max);
     }
 
+    void Scene::Refit() {
+        double time0 = camera.ShutterOpen(), time1 = camera.ShutterClose();
+        if (auto* bvh = dynamic_cast<BVHNode*>(aggregate.get())) {
+            bvh->Refit(time0, time1);
+        }
+        else if (auto* compressed_bvh = dynamic_cast<CompressedBVH*>(aggregate.get())) {
+            compressed_bvh->Refit(time0, time1);
+        }
+        else if (auto* list = dynamic_cast<Aggregate*>(aggregate.get())) {
+            list->world_bound = Bounds3();
+            for (const auto& primitive : list->primitives) {
+                list->world_bound = Bounds3::Merge(list->world_bound, primitive->WorldBound(time0, time1));
+            }
+        }
+        world_bound = aggregate->WorldBound(time0, time1);
+    }
+
     namespace SampleScene {
 
         Scene RandomBallScene() {
@@ -318,6 +336,97 @@ namespace Aokana {
 
             return Scene(bvh_root, camera, background);
         }
+
+        Scene AnimatedSpheresScene() {
+            auto aggregate = std::make_shared<Aggregate>();
+            auto animation = std::make_shared<SceneAnimation>();
+            animation->frames_per_second = 24;
+            animation->frame_count = 48;
+
+            auto checker = std::make_shared<CheckerTexture>(Color(0.2, 0.3, 0.1), Color(0.9, 0.9, 0.9));
+            aggregate->AddPrimitive(
+                std::make_shared<GeometricPrimitive>(
+                    std::make_shared<Sphere>(Point3(0, -1000, 0), 1000),
+                    std::make_shared<Lambertian>(checker)
+                )
+            );
+
+            // 图元在物体空间中位于原点, 由关键帧给出位置
+            auto add_animated = [&](const std::shared_ptr<Shape>& shape, const std::shared_ptr<Material>& material,
+                std::vector<TransformKeyframe> keyframes) {
+                auto primitive = std::make_shared<AnimatedPrimitive>(
+                    std::make_shared<GeometricPrimitive>(shape, material), std::move(keyframes));
+                aggregate->AddPrimitive(primitive);
+                animation->primitives.push_back(primitive);
+            };
+
+            // 自转的地球
+            auto earth_texture = std::make_shared<ImageTexture>("./assets/textures/earthmap.jpg");
+            add_animated(std::make_shared<Sphere>(Point3(0, 0, 0), 1.0), std::make_shared<Lambertian>(earth_texture), {
+                { 0.0, Vector3(0, 1, 0), Vector3(0, 0, 0), 1.0 },
+                { 2.0, Vector3(0, 1, 0), Vector3(0, 360, 0), 1.0 },
+            });
+            // 弹跳的漫反射球
+            std::vector<TransformKeyframe> bounce;
+            for (int i = 0; i <= 8; ++i) {
+                double height = (i % 2 == 0) ? 0.5 : 1.8;
+                bounce.push_back({ i * 0.25, Vector3(-2.5, height, 1.5), Vector3(0, 0, 0), 1.0 });
+            }
+            add_animated(std::make_shared<Sphere>(Point3(0, 0, 0), 0.5),
+                std::make_shared<Lambertian>(Color(0.8, 0.3, 0.3)), bounce);
+            // 绕地球公转的金属球
+            std::vector<TransformKeyframe> orbit;
+            for (int i = 0; i <= 16; ++i) {
+                double angle = 2 * PI * i / 16;
+                orbit.push_back({ i * 0.125, Vector3(2.5 * std::cos(angle), 1.0, 2.5 * std::sin(angle)), Vector3(0, 0, 0), 1.0 });
+            }
+            add_animated(std::make_shared<Sphere>(Point3(0, 0, 0), 0.4),
+                std::make_shared<Metal>(Color(0.7, 0.6, 0.5), 0.0), orbit);
+            // 逐渐放大的玻璃球
+            add_animated(std::make_shared<Sphere>(Point3(0, 0, 0), 0.5), std::make_shared<Dielectric>(1.5), {
+                { 0.0, Vector3(2.5, 0.5, -1.5), Vector3(0, 0, 0), 0.5 },
+                { 2.0, Vector3(2.5, 0.75, -1.5), Vector3(0, 0, 0), 1.5 },
+            });
+
+            // 相机绕场景转动四分之一圈
+            animation->aspect_ratio = 16.0 / 9.0;
+            for (int i = 0; i <= 4; ++i) {
+                double angle = Radians(-15.0 + 22.5 * i);
+                CameraKeyframe key;
+                key.time = i * 0.5;
+                key.look_from = Point3(13 * std::cos(angle), 3, 13 * std::sin(angle));
+                key.look_at = Point3(0, 0.8, 0);
+                key.vfov = 25;
+                key.aperture = 0.05;
+                key.focus_distance = 13;
+                animation->camera_keyframes.push_back(key);
+            }
+            const CameraKeyframe& first = animation->camera_keyframes.front();
+            Camera camera(first.look_from, first.look_at, animation->camera_up, first.vfov, animation->aspect_ratio,
+                first.aperture, first.focus_distance, 0.0, 1.0);
+
+            Color background(0.70, 0.80, 1.00);
+            auto bvh_root = std::make_shared<BVHNode>(aggregate, 0.0, 1.0);
+
+            Scene scene(bvh_root, camera, background);
+            scene.animation = animation;
+            return scene;
+        }
+
+        std::shared_ptr<Scene> Create(int scene_id) {
+            SeedRandom(0);
+            switch (scene_id) {
+            case 0: return std::make_shared<Scene>(RandomBallScene());
+            case 1: return std::make_shared<Scene>(TwoSpheresScene());
+            case 2: return std::make_shared<Scene>(TwoPerlinSpheresScene());
+            case 3: return std::make_shared<Scene>(EarthScene());
+            case 4: return std::make_shared<Scene>(SimpleLightScene());
+            case 5: return std::make_shared<Scene>(BunnyScene());
+            case 6: return std::make_shared<Scene>(CornellBox());
+            case 7: return std::make_shared<Scene>(AnimatedSpheresScene());
+            default: return nullptr;
+            }
+        }
     }
 
 }
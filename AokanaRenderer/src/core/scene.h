@@ -5,6 +5,7 @@
 #include "primitive.h"
 #include "interaction.h"
 #include "camera.h"
+#include "animation.h"
 
 namespace Aokana {
 
@@ -19,10 +20,14 @@ namespace Aokana {
         const Bounds3& WorldBound() const { return world_bound; }
         bool Intersect(const Ray& ray, double t_min = 0.0001, double t_max = INF) const;
         bool IntersectP(const Ray& ray, SurfaceInteraction& isect, double t_min = 0.0001, double t_max = INF) const;
+        // 动画图元移动后重新拟合加速结构并更新场景的包围盒
+        void Refit();
 
     public:
         Camera camera;
         Color background;
+        // 场景的关键帧动画, 静态场景为 nullptr
+        std::shared_ptr<SceneAnimation> animation;
     private:
         std::shared_ptr<Primitive> aggregate;
         Bounds3 world_bound;
@@ -36,5 +41,10 @@ namespace Aokana {
         Scene SimpleLightScene();
         Scene BunnyScene();
         Scene CornellBox();
+        Scene AnimatedSpheresScene();
+
+        // 按编号创建示例场景 (与交互界面中的编号一致), 未知的编号返回 nullptr;
+        // 创建前重置随机数, 同一个编号在不同进程中得到完全相同的场景
+        std::shared_ptr<Scene> Create(int scene_id);
     }
 }
\ No newline at end of file
@@ -0,0 +1,318 @@
+#include "scene_loader.h"
+#include "moving_sphere.h"
+#include "buffer_cache.h"
+#include "bvh.h"
+#include "compressed_bvh.h"
+
+#include "../external/nlohmann/json.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+
+namespace Aokana {
+
+    namespace {
+
+        using json = nlohmann::json;
+
+        Vector3 ReadVector3(const json& value) {
+            if (!value.is_array() || value.size() != 3) {
+                throw std::runtime_error("expected an array of 3 numbers, got " + value.dump());
+            }
+            return Vector3(value[0].get<double>(), value[1].get<double>(), value[2].get<double>());
+        }
+
+        Vector3 ReadVector3(const json& object, const char* key, const Vector3& fallback) {
+            return object.contains(key) ? ReadVector3(object[key]) : fallback;
+        }
+
+        Point3 ReadPoint3(const json& value) {
+            Vector3 v = ReadVector3(value);
+            return Point3(v.x, v.y, v.z);
+        }
+
+        Point3 ReadPoint3(const json& object, const char* key, const Point3& fallback) {
+            return object.contains(key) ? ReadPoint3(object[key]) : fallback;
+        }
+
+        MeshCompression ParseMeshCompression(const std::string& names) {
+            MeshCompression compression;
+            std::stringstream stream(names);
+            std::string name;
+            while (std::getline(stream, name, ',')) {
+                if (name.empty() || name == "none") continue;
+                if (name == "all") compression = MeshCompression{ true, true, true };
+                else if (name == "normals") compression.normals = true;
+                else if (name == "uvs") compression.uvs = true;
+                else if (name == "positions") compression.positions = true;
+                else throw std::runtime_error("unknown mesh compression \"" + name + "\"");
+            }
+            return compression;
+        }
+
+        // 解析场景文件时的状态: 已命名的纹理与材质, 文件所在的目录
+        class SceneParser {
+        public:
+            explicit SceneParser(std::filesystem::path directory) : directory(std::move(directory)) {}
+
+            std::shared_ptr<Scene> Parse(const json& root, RenderSettings* settings);
+
+        private:
+            std::string ResolvePath(const std::string& file) const {
+                std::filesystem::path path(file);
+                return (path.is_relative() ? directory / path : path).string();
+            }
+
+            std::shared_ptr<Texture> ParseTexture(const json& value);
+            std::shared_ptr<Material> ParseMaterial(const json& value);
+            void ParseShape(const json& shape, Aggregate& aggregate, SceneAnimation& animation);
+            std::vector<TransformKeyframe> ParseKeyframes(const json& keyframes) const;
+            Camera ParseCamera(const json& root, SceneAnimation& animation, int& width, int& height) const;
+            void ParseRenderSettings(const json& render, RenderSettings& settings) const;
+
+            std::filesystem::path directory;
+            std::map<std::string, std::shared_ptr<Texture>> textures;
+            std::map<std::string, std::shared_ptr<Material>> materials;
+            MeshCompression mesh_compression;   // "obj" 形状默认的压缩方式
+        };
+
+        std::shared_ptr<Texture> SceneParser::ParseTexture(const json& value) {
+            if (value.is_array()) return std::make_shared<SolidColor>(ReadVector3(value));
+            if (value.is_string()) {
+                auto iter = textures.find(value.get<std::string>());
+                if (iter == textures.end()) throw std::runtime_error("unknown texture \"" + value.get<std::string>() + "\"");
+                return iter->second;
+            }
+
+            const std::string type = value.at("type").get<std::string>();
+            if (type == "solid") return std::make_shared<SolidColor>(ReadVector3(value.at("color")));
+            if (type == "checker") return std::make_shared<CheckerTexture>(ParseTexture(value.at("even")), ParseTexture(value.at("odd")));
+            if (type == "noise") return std::make_shared<NoiseTexture>(value.value("scale", 1.0));
+            if (type == "image") return std::make_shared<ImageTexture>(ResolvePath(value.at("file").get<std::string>()));
+            throw std::runtime_error("unknown texture type \"" + type + "\"");
+        }
+
+        std::shared_ptr<Material> SceneParser::ParseMaterial(const json& value) {
+            if (value.is_string()) {
+                auto iter = materials.find(value.get<std::string>());
+                if (iter == materials.end()) throw std::runtime_error("unknown material \"" + value.get<std::string>() + "\"");
+                return iter->second;
+            }
+
+            const std::string type = value.at("type").get<std::string>();
+            if (type == "lambertian") return std::make_shared<Lambertian>(ParseTexture(value.at("albedo")));
+            if (type == "metal") return std::make_shared<Metal>(ReadVector3(value.at("albedo")), value.value("fuzz", 0.0));
+            if (type == "dielectric") return std::make_shared<Dielectric>(value.value("ior", 1.5));
+            if (type == "diffuse_light") return std::make_shared<DiffuseLight>(ParseTexture(value.at("emit")));
+            throw std::runtime_error("unknown material type \"" + type + "\"");
+        }
+
+        std::vector<TransformKeyframe> SceneParser::ParseKeyframes(const json& keyframes) const {
+            std::vector<TransformKeyframe> result;
+            TransformKeyframe previous;
+            for (const json& key : keyframes) {
+                TransformKeyframe keyframe = previous;
+                keyframe.time = key.at("time").get<double>();
+                keyframe.translation = ReadVector3(key, "translate", previous.translation);
+                keyframe.rotation = ReadVector3(key, "rotate", previous.rotation);
+                keyframe.scale = key.value("scale", previous.scale);
+                if (!result.empty() && keyframe.time <= result.back().time) {
+                    throw std::runtime_error("keyframe times must be increasing");
+                }
+                result.push_back(keyframe);
+                previous = keyframe;
+            }
+            return result;
+        }
+
+        void SceneParser::ParseShape(const json& shape, Aggregate& aggregate, SceneAnimation& animation) {
+            const std::string type = shape.at("type").get<std::string>();
+            std::shared_ptr<Material> material = ParseMaterial(shape.at("material"));
+
+            std::vector<std::shared_ptr<Primitive>> primitives;
+            auto add = [&](const std::shared_ptr<Shape>& s) {
+                primitives.push_back(std::make_shared<GeometricPrimitive>(s, material));
+            };
+            if (type == "sphere") {
+                add(std::make_shared<Sphere>(ReadPoint3(shape.at("center")), shape.at("radius").get<double>()));
+            }
+            else if (type == "moving_sphere") {
+                add(std::make_shared<MovingSphere>(
+                    ReadPoint3(shape.at("center0")), ReadPoint3(shape.at("center1")),
+                    shape.value("time0", 0.0), shape.value("time1", 1.0), shape.at("radius").get<double>()));
+            }
+            else if (type == "triangle") {
+                const json& vertices = shape.at("vertices");
+                if (vertices.size() != 3) throw std::runtime_error("a triangle needs 3 vertices");
+                add(std::make_shared<Triangle>(
+                    ReadPoint3(vertices[0]), ReadPoint3(vertices[1]), ReadPoint3(vertices[2])));
+            }
+            else if (type == "quad") {
+                Point3 corner = ReadPoint3(shape.at("corner"));
+                Vector3 u = ReadVector3(shape.at("u")), v = ReadVector3(shape.at("v"));
+                add(std::make_shared<Triangle>(corner, corner + u, corner + u + v));
+                add(std::make_shared<Triangle>(corner, corner + u + v, corner + v));
+            }
+            else if (type == "obj") {
+                MeshCompression compression = mesh_compression;
+                compression.normals = shape.value("compress_normals", compression.normals);
+                compression.uvs = shape.value("compress_uvs", compression.uvs);
+                compression.positions = shape.value("quantize_positions", compression.positions);
+                Aggregate mesh;
+                mesh.AddObj(ResolvePath(shape.at("file").get<std::string>()), material, shape.value("flip_x", true), compression);
+                primitives = std::move(mesh.primitives);
+            }
+            else if (type == "mesh") {
+                Aggregate mesh;
+                mesh.AddMesh(ResolvePath(shape.at("file").get<std::string>()), material);
+                primitives = std::move(mesh.primitives);
+            }
+            else {
+                throw std::runtime_error("unknown shape type \"" + type + "\"");
+            }
+            if (primitives.empty()) return;
+
+            if (!shape.contains("keyframes")) {
+                aggregate.AddPrimitives(primitives);
+                return;
+            }
+            // 动画图元的所有三角形一起运动, 在物体空间中建立一个 BVH, 每帧只重新拟合顶层
+            std::shared_ptr<Primitive> object = primitives.front();
+            if (primitives.size() > 1) object = std::make_shared<BVHNode>(primitives, 0, primitives.size(), 0.0, 1.0);
+            auto animated = std::make_shared<AnimatedPrimitive>(object, ParseKeyframes(shape["keyframes"]));
+            aggregate.AddPrimitive(animated);
+            animation.primitives.push_back(animated);
+        }
+
+        Camera SceneParser::ParseCamera(const json& root, SceneAnimation& animation, int& width, int& height) const {
+            const json camera = root.value("camera", json::object());
+            CameraKeyframe base;
+            base.look_from = ReadPoint3(camera, "look_from", Point3(13, 2, 3));
+            base.look_at = ReadPoint3(camera, "look_at", Point3(0, 0, 0));
+            base.vfov = camera.value("vfov", 20.0);
+            base.aperture = camera.value("aperture", 0.0);
+            base.focus_distance = camera.value("focus_distance", (base.look_from - base.look_at).Length());
+            animation.camera_up = ReadVector3(camera, "up", Vector3(0, 1, 0));
+
+            width = 800;
+            height = 450;
+            if (camera.contains("resolution")) {
+                width = camera["resolution"].at(0).get<int>();
+                height = camera["resolution"].at(1).get<int>();
+                if (width <= 0 || height <= 0) throw std::runtime_error("resolution must be positive");
+            }
+            animation.aspect_ratio = camera.value("aspect_ratio", static_cast<double>(width) / height);
+            double shutter_open = 0, shutter_close = 1;
+            if (camera.contains("shutter")) {
+                shutter_open = camera["shutter"].at(0).get<double>();
+                shutter_close = camera["shutter"].at(1).get<double>();
+            }
+
+            if (root.contains("animation")) {
+                const json& config = root["animation"];
+                animation.frames_per_second = config.value("fps", animation.frames_per_second);
+                animation.frame_count = config.value("frames", animation.frame_count);
+                CameraKeyframe previous = base;
+                for (const json& key : config.value("camera", json::array())) {
+                    CameraKeyframe keyframe = previous;
+                    keyframe.time = key.at("time").get<double>();
+                    keyframe.look_from = ReadPoint3(key, "look_from", previous.look_from);
+                    keyframe.look_at = ReadPoint3(key, "look_at", previous.look_at);
+                    keyframe.vfov = key.value("vfov", previous.vfov);
+                    keyframe.aperture = key.value("aperture", previous.aperture);
+                    keyframe.focus_distance = key.value("focus_distance", previous.focus_distance);
+                    if (!animation.camera_keyframes.empty() && keyframe.time <= animation.camera_keyframes.back().time) {
+                        throw std::runtime_error("keyframe times must be increasing");
+                    }
+                    animation.camera_keyframes.push_back(keyframe);
+                    previous = keyframe;
+                }
+            }
+
+            return Camera(base.look_from, base.look_at, animation.camera_up, base.vfov, animation.aspect_ratio,
+                base.aperture, base.focus_distance, shutter_open, shutter_close);
+        }
+
+        void SceneParser::ParseRenderSettings(const json& render, RenderSettings& settings) const {
+            settings.samples_per_pixel = render.value("spp", settings.samples_per_pixel);
+            settings.max_depth = render.value("max_depth", settings.max_depth);
+            settings.sampler = render.value("sampler", settings.sampler);
+            settings.filter = render.value("filter", settings.filter);
+            settings.filter_radius = render.value("filter_radius", settings.filter_radius);
+            settings.aovs = render.value("aovs", settings.aovs);
+            settings.denoise = render.value("denoise", settings.denoise);
+            settings.adaptive_threshold = render.value("adaptive_threshold", settings.adaptive_threshold);
+            settings.progressive_spp_per_pass = render.value("progressive", settings.progressive_spp_per_pass);
+            settings.time_budget_seconds = render.value("time_budget", settings.time_budget_seconds);
+            if (render.contains("output")) settings.output = ResolvePath(render["output"].get<std::string>());
+        }
+
+        std::shared_ptr<Scene> SceneParser::Parse(const json& root, RenderSettings* settings) {
+            if (settings != nullptr && root.contains("render")) ParseRenderSettings(root["render"], *settings);
+            // 命令行给出的压缩方式优先于文件中的 render.mesh_compression
+            std::string compression_names = settings != nullptr ? settings->mesh_compression : std::string();
+            if (compression_names.empty() && root.contains("render")) {
+                compression_names = root["render"].value("mesh_compression", std::string());
+            }
+            mesh_compression = ParseMeshCompression(compression_names);
+            if (settings != nullptr) settings->mesh_compression = compression_names.empty() ? "none" : compression_names;
+
+            const json texture_list = root.value("textures", json::object());
+            for (const auto& [name, value] : texture_list.items()) textures[name] = ParseTexture(value);
+            const json material_list = root.value("materials", json::object());
+            for (const auto& [name, value] : material_list.items()) materials[name] = ParseMaterial(value);
+
+            auto animation = std::make_shared<SceneAnimation>();
+            int width, height;
+            Camera camera = ParseCamera(root, *animation, width, height);
+            if (camera.film->image_width != width || camera.film->image_height != height) {
+                camera.film = std::make_shared<Film>(width, height);
+            }
+
+            auto aggregate = std::make_shared<Aggregate>();
+            for (const json& shape : root.at("shapes")) ParseShape(shape, *aggregate, *animation);
+            if (aggregate->primitives.empty()) throw std::runtime_error("the scene has no shapes");
+
+            std::shared_ptr<Primitive> accelerator = aggregate;
+            const std::string accelerator_type = root.value("accelerator", std::string("bvh"));
+            if (accelerator_type == "bvh") accelerator = std::make_shared<BVHNode>(aggregate, camera.ShutterOpen(), camera.ShutterClose());
+            else if (accelerator_type == "compressed_bvh") accelerator = std::make_shared<CompressedBVH>(aggregate, camera.ShutterOpen(), camera.ShutterClose());
+            else if (accelerator_type != "none") throw std::runtime_error("unknown accelerator \"" + accelerator_type + "\"");
+
+            auto scene = std::make_shared<Scene>(accelerator, camera, ReadVector3(root, "background", Color(0, 0, 0)));
+            if (!animation->primitives.empty() || !animation->camera_keyframes.empty()) {
+                scene->animation = animation;
+                // 场景从第 0 帧开始
+                animation->SetTime(*scene, animation->FrameTime(0));
+            }
+            return scene;
+        }
+    }
+
+    std::shared_ptr<Scene> LoadSceneFile(const std::string& path, RenderSettings* settings) {
+        std::ifstream file(path);
+        if (!file) {
+            std::cerr << "[ERROR] Failed to open scene file \"" << path << "\"." << std::endl;
+            return nullptr;
+        }
+        try {
+            json root = json::parse(file, nullptr, true, true);
+            SceneParser parser(std::filesystem::path(path).parent_path());
+            // 与 SampleScene::Create 一样固定随机数, 噪声纹理与 BVH 的划分只取决于场景文件,
+            // 分布式渲染的协调进程与工作进程因此构建出相同的场景
+            SeedRandom(0);
+            std::shared_ptr<Scene> scene = parser.Parse(root, settings);
+            std::cout << "[INFO] Loaded scene \"" << path << "\"." << std::endl;
+            PrintBufferCacheStatistics();
+            return scene;
+        }
+        catch (const std::exception& error) {
+            std::cerr << "[ERROR] Failed to load scene file \"" << path << "\": " << error.what() << std::endl;
+            return nullptr;
+        }
+    }
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include "scene.h"
+
+namespace Aokana {
+
+    // 渲染设置, 可以写在场景文件的 "render" 中, 也可以由命令行给出; 命令行优先
+    struct RenderSettings {
+        int samples_per_pixel = 10;
+        int max_depth = 5;
+        std::string sampler = "independent";
+        std::string filter = "box";
+        double filter_radius = 0;           // 不大于 0 时使用滤波器的默认半径
+        std::string aovs = "none";          // 以逗号分隔的 AOV 名字, 见 ParseAOVFlags
+        bool denoise = false;
+        double adaptive_threshold = 0;      // 大于 0 时启用自适应采样
+        int progressive_spp_per_pass = 0;   // 大于 0 时渐进渲染
+        double time_budget_seconds = 0;
+        std::string output = "./output/result.png";
+        // "obj" 形状默认的顶点压缩, 以逗号分隔的 normals, uvs, positions 或 all / none (见 MeshCompression);
+        // 形状自己的 compress_* 项优先. 加载场景文件之前非空时 (命令行给出) 不被文件中的值覆盖, 加载后为实际使用的值
+        std::string mesh_compression;
+    };
+
+    // 读取 JSON 格式的场景描述文件, 失败时输出错误并返回 nullptr; settings 非空时用文件中 "render" 给出的项覆盖它.
+    // 文件中的相对路径 (纹理, 网格) 相对于场景文件所在的目录. 格式:
+    //
+    // {
+    //   "render":     { "spp": 64, "max_depth": 8, "sampler": "sobol", "filter": "gaussian", "filter_radius": 1.5,
+    //                   "aovs": "depth,normal", "denoise": false, "adaptive_threshold": 0, "progressive": 0,
+    //                   "time_budget": 0, "output": "result.png", "mesh_compression": "none" },
+    //   "camera":     { "look_from": [13, 2, 3], "look_at": [0, 0, 0], "up": [0, 1, 0], "vfov": 20,
+    //                   "resolution": [800, 450], "aperture": 0.1, "focus_distance": 10, "shutter": [0, 1] },
+    //   "background": [0.7, 0.8, 1.0],
+    //   "accelerator": "bvh",                                         // 或 "compressed_bvh" (8 叉, 子节点包围盒量化为 8 位), "none"
+    //   "textures":   { "checker": { "type": "checker", "even": [0.2, 0.3, 0.1], "odd": [0.9, 0.9, 0.9] },
+    //                   "earth":   { "type": "image", "file": "earthmap.jpg" },
+    //                   "marble":  { "type": "noise", "scale": 4 } },
+    //   "materials":  { "ground": { "type": "lambertian", "albedo": "checker" },
+    //                   "gold":   { "type": "metal", "albedo": [0.8, 0.6, 0.2], "fuzz": 0.1 },
+    //                   "glass":  { "type": "dielectric", "ior": 1.5 },
+    //                   "lamp":   { "type": "diffuse_light", "emit": [4, 4, 4] } },
+    //   "shapes": [
+    //     { "type": "sphere", "center": [0, -1000, 0], "radius": 1000, "material": "ground" },
+    //     { "type": "moving_sphere", "center0": [0, 1, 0], "center1": [0, 1.5, 0], "time0": 0, "time1": 1, "radius": 0.5,
+    //       "material": { "type": "lambertian", "albedo": [0.8, 0.3, 0.3] } },
+    //     { "type": "triangle", "vertices": [[3, 3, 2], [5, 1, 2], [3, 1, 2]], "material": "lamp" },
+    //     { "type": "quad", "corner": [3, 1, 2], "u": [2, 0, 0], "v": [0, 2, 0], "material": "lamp" },
+    //     { "type": "obj", "file": "bunny.obj", "flip_x": true, "material": "gold",
+    //       "compress_normals": false, "compress_uvs": false, "quantize_positions": false, // 见 MeshCompression
+    //       "keyframes": [ { "time": 0, "translate": [0, 0, 0], "rotate": [0, 0, 0], "scale": 1 },
+    //                      { "time": 2, "rotate": [0, 360, 0] } ] },
+    //     { "type": "mesh", "file": "dragon.amesh", "material": "gold" }             // 二进制网格, 见 mesh_file.h
+    //   ],
+    //   "animation":  { "fps": 24, "frames": 48,
+    //                   "camera": [ { "time": 0, "look_from": [13, 2, 3], "look_at": [0, 0, 0], "vfov": 20 } ] }
+    // }
+    //
+    // 材质与纹理可以按名字引用, 也可以直接内联; 需要纹理的地方 (albedo, emit, even, odd) 也可以直接给出颜色.
+    // 带 "keyframes" 的形状成为动画图元. 关键帧中没有给出的项沿用上一个关键帧, 第一个相机关键帧沿用 "camera" 中的值
+    std::shared_ptr<Scene> LoadSceneFile(const std::string& path, RenderSettings* settings = nullptr);
+}
@@ -0,0 +1,198 @@
+#include "shared_preview.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <new>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Aokana {
+
+    namespace {
+
+        size_t AlignUp(size_t offset, size_t alignment) {
+            return (offset + alignment - 1) / alignment * alignment;
+        }
+
+#if defined(_WIN32)
+        std::string PlatformName(const std::string& name) { return "Local\\" + name; }
+#else
+        std::string PlatformName(const std::string& name) { return name.front() == '/' ? name : "/" + name; }
+#endif
+    }
+
+    bool SharedMemoryRegion::Create(const std::string& name, size_t size) {
+        Close();
+        this->name = PlatformName(name);
+#if defined(_WIN32)
+        mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+            static_cast<DWORD>(static_cast<uint64_t>(size) >> 32), static_cast<DWORD>(size), this->name.c_str());
+        if (mapping == nullptr) return false;
+        data = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+        if (data == nullptr) {
+            CloseHandle(mapping);
+            mapping = nullptr;
+            return false;
+        }
+#else
+        int fd = shm_open(this->name.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+        if (fd < 0) return false;
+        if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+            close(fd);
+            shm_unlink(this->name.c_str());
+            return false;
+        }
+        void* address = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (address == MAP_FAILED) {
+            shm_unlink(this->name.c_str());
+            return false;
+        }
+        data = address;
+#endif
+        this->size = size;
+        owner = true;
+        return true;
+    }
+
+    bool SharedMemoryRegion::OpenReadOnly(const std::string& name) {
+        Close();
+        this->name = PlatformName(name);
+#if defined(_WIN32)
+        mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, this->name.c_str());
+        if (mapping == nullptr) return false;
+        data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (data == nullptr) {
+            CloseHandle(mapping);
+            mapping = nullptr;
+            return false;
+        }
+        MEMORY_BASIC_INFORMATION info;
+        VirtualQuery(data, &info, sizeof(info));
+        size = info.RegionSize;
+#else
+        int fd = shm_open(this->name.c_str(), O_RDONLY, 0);
+        if (fd < 0) return false;
+        struct stat status;
+        if (fstat(fd, &status) != 0) {
+            close(fd);
+            return false;
+        }
+        void* address = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (address == MAP_FAILED) return false;
+        data = address;
+        size = static_cast<size_t>(status.st_size);
+#endif
+        owner = false;
+        return true;
+    }
+
+    void SharedMemoryRegion::Close() {
+        if (data == nullptr) return;
+#if defined(_WIN32)
+        UnmapViewOfFile(data);
+        CloseHandle(mapping);
+        mapping = nullptr;
+#else
+        munmap(data, size);
+        // 已经映射的查看进程在解除映射前仍可以继续读取
+        if (owner) shm_unlink(name.c_str());
+#endif
+        data = nullptr;
+        size = 0;
+    }
+
+    SharedPreviewWriter::SharedPreviewWriter(const std::string& name, const Film& film, uint32_t ring_capacity) {
+        size_t events_offset = AlignUp(sizeof(SharedPreviewHeader), 64);
+        size_t image_offset = AlignUp(events_offset + sizeof(SharedTileEvent) * ring_capacity, 64);
+        size_t total_size = image_offset + static_cast<size_t>(film.image_width) * film.image_height * 3;
+
+        if (!region.Create(name, total_size)) {
+            std::cerr << "[ERROR] Failed to create shared preview \"" << name << "\"." << std::endl;
+            return;
+        }
+
+        unsigned char* base = static_cast<unsigned char*>(region.Data());
+        header = new (base) SharedPreviewHeader{};
+        events = reinterpret_cast<SharedTileEvent*>(base + events_offset);
+        for (uint32_t i = 0; i < ring_capacity; ++i) new (events + i) SharedTileEvent{};
+        image = base + image_offset;
+
+        header->version = SHARED_PREVIEW_VERSION;
+        header->image_width = film.image_width;
+        header->image_height = film.image_height;
+        header->tile_count = static_cast<uint32_t>(film.tiles.size());
+        header->ring_capacity = ring_capacity;
+        header->image_offset = static_cast<uint32_t>(image_offset);
+        PublishImage(film);
+        // magic 最后写入, 查看进程看到 magic 时其余字段都已初始化
+        std::atomic_thread_fence(std::memory_order_release);
+        std::memcpy(header->magic, SHARED_PREVIEW_MAGIC, sizeof(SHARED_PREVIEW_MAGIC));
+
+        std::cout << "[INFO] Publishing preview to shared memory \"" << name << "\"." << std::endl;
+    }
+
+    void SharedPreviewWriter::PublishImage(const Film& film) {
+        if (!IsOpen()) return;
+        std::memcpy(image, film.data.data(), film.data.size());
+        // 让查看进程重新读取整幅图像
+        header->event_count.fetch_add(header->ring_capacity, std::memory_order_release);
+    }
+
+    void SharedPreviewWriter::PublishTile(int tile_index, const Film& film) {
+        if (!IsOpen()) return;
+        int x_min, y_min, x_max, y_max;
+        film.GetImageRect(film.tiles[tile_index], x_min, y_min, x_max, y_max, film.filter_padding);
+
+        // 相邻的 tile 可能正在合并滤波器覆盖的边界像素, 在胶片的合并锁内复制
+        const size_t row_stride = static_cast<size_t>(film.image_width) * 3;
+        film.CopyImageRect(x_min, y_min, x_max, y_max, image + y_min * row_stride + static_cast<size_t>(x_min) * 3, row_stride);
+
+        uint64_t event_index = header->event_count.fetch_add(1, std::memory_order_acq_rel);
+        SharedTileEvent& event = events[event_index % header->ring_capacity];
+        event.tile_index.store(tile_index, std::memory_order_relaxed);
+        event.x_min.store(x_min, std::memory_order_relaxed);
+        event.y_min.store(y_min, std::memory_order_relaxed);
+        event.x_max.store(x_max, std::memory_order_relaxed);
+        event.y_max.store(y_max, std::memory_order_relaxed);
+        event.sequence.store(event_index + 1, std::memory_order_release);
+    }
+
+    void SharedPreviewWriter::PublishProgress(int rendered_spp, bool finished) {
+        if (!IsOpen()) return;
+        header->rendered_spp.store(rendered_spp, std::memory_order_relaxed);
+        header->finished.store(finished ? 1 : 0, std::memory_order_release);
+    }
+
+    bool SharedPreviewReader::Open(const std::string& name) {
+        if (!region.OpenReadOnly(name)) return false;
+        const unsigned char* base = static_cast<const unsigned char*>(region.Data());
+        const SharedPreviewHeader* candidate = reinterpret_cast<const SharedPreviewHeader*>(base);
+        if (region.Size() < sizeof(SharedPreviewHeader) ||
+            std::memcmp(candidate->magic, SHARED_PREVIEW_MAGIC, sizeof(SHARED_PREVIEW_MAGIC)) != 0 ||
+            candidate->version != SHARED_PREVIEW_VERSION) {
+            region.Close();
+            return false;
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        header = candidate;
+        events = reinterpret_cast<const SharedTileEvent*>(base + AlignUp(sizeof(SharedPreviewHeader), 64));
+        image = base + header->image_offset;
+        return true;
+    }
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include "film.h"
+
+namespace Aokana {
+
+    // 无显示器环境下的渲染预览
+    // 渲染进程把输出图像与 tile 完成事件发布到一块命名共享内存中 (POSIX shm_open, Windows 上为命名文件映射),
+    // 独立的查看进程以只读方式映射同一块内存. 每个 tile 完成时渲染线程只做一次 tile 大小的 memcpy 并写入一个事件
+    //
+    // 共享内存布局: SharedPreviewHeader | SharedTileEvent[ring_capacity] | 图像数据 (RGB8, 第 0 行在最上面)
+    // 事件组成一个环形缓冲区, 第 e 个事件写在 e % ring_capacity 处, 写完后把 sequence 设为 e + 1;
+    // 查看进程落后超过 ring_capacity 个事件时, 应直接重新读取整幅图像
+
+    constexpr char SHARED_PREVIEW_MAGIC[8] = { 'A', 'O', 'K', 'P', 'R', 'E', 'V', '\0' };
+    constexpr uint32_t SHARED_PREVIEW_VERSION = 1;
+
+    struct SharedPreviewHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t image_width;
+        uint32_t image_height;
+        uint32_t tile_count;
+        uint32_t ring_capacity;
+        uint32_t image_offset;          // 图像数据相对于共享内存起始处的偏移
+        std::atomic<uint64_t> event_count;
+        std::atomic<uint32_t> rendered_spp;
+        std::atomic<uint32_t> finished;
+    };
+
+    struct SharedTileEvent {
+        std::atomic<uint64_t> sequence;
+        std::atomic<uint32_t> tile_index;
+        std::atomic<int32_t> x_min, y_min, x_max, y_max;   // 输出图像中的范围, 边界包含在内
+    };
+
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "Shared preview requires address-free 64-bit atomics.");
+
+    // 平台相关的命名共享内存
+    class SharedMemoryRegion {
+    public:
+        SharedMemoryRegion() = default;
+        SharedMemoryRegion(const SharedMemoryRegion&) = delete;
+        SharedMemoryRegion& operator=(const SharedMemoryRegion&) = delete;
+        ~SharedMemoryRegion() { Close(); }
+
+        bool Create(const std::string& name, size_t size);
+        bool OpenReadOnly(const std::string& name);
+        void Close();
+
+        void* Data() const { return data; }
+        size_t Size() const { return size; }
+
+    private:
+        std::string name;
+        void* data = nullptr;
+        size_t size = 0;
+        bool owner = false;
+#if defined(_WIN32)
+        void* mapping = nullptr;
+#endif
+    };
+
+    // 渲染进程一侧
+    class SharedPreviewWriter {
+    public:
+        SharedPreviewWriter(const std::string& name, const Film& film, uint32_t ring_capacity = 4096);
+
+        bool IsOpen() const { return header != nullptr; }
+
+        // 复制整幅图像, 用于开始渲染或从检查点恢复时
+        void PublishImage(const Film& film);
+        // 由完成 tile 的渲染线程调用, 可以并发调用
+        void PublishTile(int tile_index, const Film& film);
+        void PublishProgress(int rendered_spp, bool finished);
+
+    private:
+        SharedMemoryRegion region;
+        SharedPreviewHeader* header = nullptr;
+        SharedTileEvent* events = nullptr;
+        unsigned char* image = nullptr;
+    };
+
+    // 查看进程一侧
+    class SharedPreviewReader {
+    public:
+        bool Open(const std::string& name);
+
+        const SharedPreviewHeader* header = nullptr;
+        const SharedTileEvent* events = nullptr;
+        const unsigned char* image = nullptr;
+
+    private:
+        SharedMemoryRegion region;
+    };
+}
@@ -139,6 +139,7 @@ namespace Aokana::SphericalGeometry {
     // 球面八面体映射, 存储单位球面上的方向向量仅需 4 个 byte，而球面坐标系需要 16 个 byte (theta, phi)
     class OctahedralVector {
     public:
+        OctahedralVector() = default;
         // 要求传入的 v 是单位球面上的单位向量
         OctahedralVector(Vector3 v) {
             v /= std::abs(v.x) + std::abs(v.y) + std::abs(v.z); // v 除以自身的 L1 范数，将 v 变换到内切于单位球面的八面体内
@@ -175,7 +176,7 @@ namespace Aokana::SphericalGeometry {
             return std::round(Clamp((f + 1) / 2, 0.0, 1.0) * 65535);
         }
 
-        uint16_t x, y;
+        uint16_t x = 0, y = 0;
     };
 
 
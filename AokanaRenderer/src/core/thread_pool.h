@@ -7,19 +7,23 @@
  * @date 2023-05-25
  * @copyright Copyright (c) 2023 Barak Shoshany. Licensed under the MIT license. If you found this project useful, please consider starring it on GitHub! If you use this library in software of any kind, please provide a link to the GitHub repository https://github.com/bshoshany/thread-pool in the source code and documentation. If you use this library in published research, please cite it as follows: Barak Shoshany, "A C++17 Thread Pool for High-Performance Scientific Computing", doi:10.5281/zenodo.4742687, arXiv:2105.00613 (May 2021)
  *
- * @brief BS::thread_pool: a fast, lightweight, and easy-to-use C++17 thread pool library. This header file contains the entire library, including the main BS::thread_pool class and the helper classes BS::multi_future, BS::blocks, BS:synced_stream, and BS::timer.
+ * @brief BS::thread_pool: a fast, lightweight, and easy-to-use C++17 thread pool library. This header file contains the entire library, including the main BS::thread_pool class and the helper classes BS::multi_future, BS::blocks, BS:synced_stream, and BS::timer. Extended with BS::work_stealing_deque and BS::work_stealing_pool for fine-grained nested parallelism.
  */
 
 #define BS_THREAD_POOL_VERSION "v3.5.0 (2023-05-25)"
 
+#include <algorithm>          // std::max
+#include <atomic>             // std::atomic, std::atomic_thread_fence
 #include <chrono>             // std::chrono
 #include <condition_variable> // std::condition_variable
+#include <cstdint>            // std::int64_t, std::uint32_t
 #include <exception>          // std::current_exception
 #include <functional>         // std::bind, std::function, std::invoke
 #include <future>             // std::future, std::promise
 #include <iostream>           // std::cout, std::endl, std::flush, std::ostream
 #include <memory>             // std::make_shared, std::make_unique, std::shared_ptr, std::unique_ptr
 #include <mutex>              // std::mutex, std::scoped_lock, std::unique_lock
+#include <optional>           // std::optional, std::nullopt
 #include <queue>              // std::queue
 #include <thread>             // std::thread
 #include <type_traits>        // std::common_type_t, std::conditional_t, std::decay_t, std::invoke_result_t, std::is_void_v
@@ -646,6 +650,617 @@ namespace BS {
     //                                     End class thread_pool                                     //
     // ============================================================================================= //
 
+    // ============================================================================================= //
+    //                                Begin class work_stealing_deque                                //
+
+    /**
+     * @brief A lock-free work-stealing deque (Chase and Lev, "Dynamic Circular Work-Stealing Deque", 2005, with the memory orderings of Le et al., "Correct and Efficient Work-Stealing for Weak Memory Models", 2013). Only the owner thread may call push() and pop(), which operate on the bottom end in LIFO order. Any thread may call steal(), which takes from the top end in FIFO order.
+     *
+     * @tparam T The type of the stored items. Must be trivially copyable, typically a pointer.
+     */
+    template <typename T>
+    class [[nodiscard]] work_stealing_deque {
+    public:
+        /**
+         * @brief Construct an empty deque.
+         *
+         * @param capacity_ The initial capacity. Will be rounded up to a power of two. The deque grows automatically when full.
+         */
+        work_stealing_deque(const size_t capacity_ = 1024) {
+            size_t capacity = 1;
+            while (capacity < capacity_)
+                capacity *= 2;
+            array.store(new circular_array(capacity), std::memory_order_relaxed);
+        }
+
+        work_stealing_deque(const work_stealing_deque&) = delete;
+        work_stealing_deque& operator=(const work_stealing_deque&) = delete;
+
+        /**
+         * @brief Destruct the deque. Any items still in the deque are not destroyed.
+         */
+        ~work_stealing_deque() {
+            delete array.load(std::memory_order_relaxed);
+        }
+
+        /**
+         * @brief Push an item onto the bottom of the deque. May only be called by the owner thread.
+         *
+         * @param item The item to push.
+         */
+        void push(const T item) {
+            const int64_t b = bottom.load(std::memory_order_relaxed);
+            const int64_t t = top.load(std::memory_order_acquire);
+            circular_array* a = array.load(std::memory_order_relaxed);
+            if (b - t > static_cast<int64_t>(a->capacity) - 1) {
+                // The old array is retired rather than deleted, since a concurrent steal() may still be reading from it.
+                circular_array* grown = a->grow(b, t);
+                retired_arrays.emplace_back(a);
+                a = grown;
+                array.store(a, std::memory_order_release);
+            }
+            a->put(b, item);
+            std::atomic_thread_fence(std::memory_order_release);
+            bottom.store(b + 1, std::memory_order_relaxed);
+        }
+
+        /**
+         * @brief Pop the most recently pushed item from the bottom of the deque. May only be called by the owner thread.
+         *
+         * @param item A reference to store the popped item in.
+         * @return true if an item was popped, false if the deque was empty.
+         */
+        [[nodiscard]] bool pop(T& item) {
+            const int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+            circular_array* a = array.load(std::memory_order_relaxed);
+            bottom.store(b, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t t = top.load(std::memory_order_relaxed);
+            bool success = false;
+            if (t <= b) {
+                item = a->get(b);
+                success = true;
+                if (t == b) {
+                    // Last item: race against thieves for it.
+                    if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                        success = false;
+                    bottom.store(b + 1, std::memory_order_relaxed);
+                }
+            }
+            else {
+                bottom.store(b + 1, std::memory_order_relaxed);
+            }
+            return success;
+        }
+
+        /**
+         * @brief Steal the oldest item from the top of the deque. May be called by any thread. May fail spuriously if another thread takes an item at the same time.
+         *
+         * @param item A reference to store the stolen item in.
+         * @return true if an item was stolen, false if the deque was empty or the steal lost a race.
+         */
+        [[nodiscard]] bool steal(T& item) {
+            int64_t t = top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            const int64_t b = bottom.load(std::memory_order_acquire);
+            if (t < b) {
+                circular_array* a = array.load(std::memory_order_acquire);
+                T stolen = a->get(t);
+                if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                    return false;
+                item = stolen;
+                return true;
+            }
+            return false;
+        }
+
+        /**
+         * @brief Get an estimate of the number of items in the deque. The result may be stale if other threads are accessing the deque.
+         *
+         * @return The estimated number of items.
+         */
+        [[nodiscard]] size_t size() const {
+            const int64_t b = bottom.load(std::memory_order_relaxed);
+            const int64_t t = top.load(std::memory_order_relaxed);
+            return b > t ? static_cast<size_t>(b - t) : 0;
+        }
+
+    private:
+        /**
+         * @brief A fixed-capacity circular array of atomic items, indexed by the unbounded top and bottom positions.
+         */
+        struct circular_array {
+            explicit circular_array(const size_t capacity_) : capacity(capacity_), mask(capacity_ - 1), items(std::make_unique<std::atomic<T>[]>(capacity_)) {}
+
+            [[nodiscard]] T get(const int64_t index) const {
+                return items[static_cast<size_t>(index) & mask].load(std::memory_order_relaxed);
+            }
+
+            void put(const int64_t index, const T item) {
+                items[static_cast<size_t>(index) & mask].store(item, std::memory_order_relaxed);
+            }
+
+            [[nodiscard]] circular_array* grow(const int64_t b, const int64_t t) const {
+                circular_array* grown = new circular_array(capacity * 2);
+                for (int64_t i = t; i < b; ++i)
+                    grown->put(i, get(i));
+                return grown;
+            }
+
+            size_t capacity;
+            size_t mask;
+            std::unique_ptr<std::atomic<T>[]> items;
+        };
+
+        /**
+         * @brief The position of the next item to steal. Only ever increases.
+         */
+        alignas(64) std::atomic<int64_t> top = 0;
+
+        /**
+         * @brief The position one past the most recently pushed item. Kept on a separate cache line from top, since the owner writes bottom and thieves write top.
+         */
+        alignas(64) std::atomic<int64_t> bottom = 0;
+
+        /**
+         * @brief The current circular array.
+         */
+        std::atomic<circular_array*> array = nullptr;
+
+        /**
+         * @brief Arrays replaced by grow(). Only accessed by the owner thread, and freed when the deque is destroyed.
+         */
+        std::vector<std::unique_ptr<circular_array>> retired_arrays = {};
+    };
+
+    //                                 End class work_stealing_deque                                 //
+    // ============================================================================================= //
+
+    // ============================================================================================= //
+    //                                Begin class work_stealing_pool                                 //
+
+    /**
+     * @brief A thread pool in which every worker owns a lock-free work-stealing deque. Tasks pushed from inside a task go to the worker's own deque and are executed in LIFO order, which keeps nested parallelism (recursive splitting, subtree builds) cache-friendly and free of any shared lock. Idle workers steal the oldest task from a random victim. Tasks pushed from outside the pool go to a shared injection queue. Offers the same push_task() / submit() / wait_for_tasks() interface as thread_pool, plus task_group and parallel_for() for nested fork-join parallelism.
+     */
+    class [[nodiscard]] work_stealing_pool {
+    public:
+        class task_group;
+
+        // ============================
+        // Constructors and destructors
+        // ============================
+
+        /**
+         * @brief Construct a new work-stealing pool.
+         *
+         * @param thread_count_ The number of threads to use. The default value is the total number of hardware threads available.
+         */
+        work_stealing_pool(const concurrency_t thread_count_ = 0) : thread_count(determine_thread_count(thread_count_)), threads(std::make_unique<std::thread[]>(thread_count)), deques(std::make_unique<work_stealing_deque<task_t*>[]>(thread_count)), worker_groups(thread_count, 0) {
+            create_threads();
+        }
+
+        /**
+         * @brief Construct a work-stealing pool with one worker per entry of worker_groups_. Idle workers steal from workers of their own group (e.g. the same NUMA node) before trying other groups.
+         *
+         * @param worker_groups_ The group of each worker.
+         * @param worker_init_ An optional function called on each worker thread with the worker's index before it runs any task, e.g. to pin the thread to a core. State allocated here is first touched by the worker itself.
+         */
+        work_stealing_pool(const std::vector<concurrency_t>& worker_groups_, std::function<void(concurrency_t)> worker_init_ = {}) : thread_count(determine_thread_count(static_cast<concurrency_t>(worker_groups_.size()))), threads(std::make_unique<std::thread[]>(thread_count)), deques(std::make_unique<work_stealing_deque<task_t*>[]>(thread_count)), worker_groups(worker_groups_), worker_init(std::move(worker_init_)) {
+            worker_groups.resize(thread_count, 0);
+            create_threads();
+        }
+
+        work_stealing_pool(const work_stealing_pool&) = delete;
+        work_stealing_pool& operator=(const work_stealing_pool&) = delete;
+
+        /**
+         * @brief Destruct the pool. Waits for all tasks to complete, then destroys all threads.
+         */
+        ~work_stealing_pool() {
+            wait_for_tasks();
+            {
+                const std::scoped_lock sleep_lock(sleep_mutex);
+                workers_running = false;
+            }
+            task_available_cv.notify_all();
+            for (concurrency_t i = 0; i < thread_count; ++i)
+                threads[i].join();
+        }
+
+        // =======================
+        // Public member functions
+        // =======================
+
+        /**
+         * @brief Get the number of threads in the pool.
+         *
+         * @return The number of threads.
+         */
+        [[nodiscard]] concurrency_t get_thread_count() const {
+            return thread_count;
+        }
+
+        /**
+         * @brief Get the group of a worker.
+         *
+         * @param index The index of the worker.
+         * @return The group the worker was assigned to in the constructor (0 if no groups were given).
+         */
+        [[nodiscard]] concurrency_t get_worker_group(const concurrency_t index) const {
+            return worker_groups[index];
+        }
+
+        /**
+         * @brief Get the index of the calling thread in this pool.
+         *
+         * @return The index of the worker, or an empty optional if the calling thread is not a worker of this pool.
+         */
+        [[nodiscard]] std::optional<concurrency_t> get_current_worker_index() const {
+            if (current_pool == this)
+                return current_index;
+            return std::nullopt;
+        }
+
+        /**
+         * @brief Get the total number of unfinished tasks: either still waiting in a queue, or running in a thread.
+         *
+         * @return The total number of tasks.
+         */
+        [[nodiscard]] size_t get_tasks_total() const {
+            return tasks_total.load();
+        }
+
+        /**
+         * @brief Push a function with zero or more arguments, but no return value, into the pool. When called from inside a task running in this pool, the new task goes to the calling worker's own deque, otherwise it goes to the shared injection queue.
+         *
+         * @tparam F The type of the function.
+         * @tparam A The types of the arguments.
+         * @param task The function to push.
+         * @param args The zero or more arguments to pass to the function. Note that if the task is a class member function, the first argument must be a pointer to the object, i.e. &object (or this), followed by the actual arguments.
+         */
+        template <typename F, typename... A>
+        void push_task(F&& task, A&&... args) {
+            task_t* new_task = new task_t(std::bind(std::forward<F>(task), std::forward<A>(args)...));
+            tasks_total.fetch_add(1);
+            if (current_pool == this) {
+                deques[current_index].push(new_task);
+            }
+            else {
+                const std::scoped_lock injection_lock(injection_mutex);
+                injection_queue.push(new_task);
+                injection_size.fetch_add(1);
+            }
+            tasks_queued.fetch_add(1);
+            // Only take the lock if some worker may be sleeping. The seq_cst counters guarantee that either this thread sees the sleeper, or the sleeper sees the new task.
+            if (workers_sleeping.load() > 0) {
+                const std::scoped_lock sleep_lock(sleep_mutex);
+                task_available_cv.notify_one();
+            }
+        }
+
+        /**
+         * @brief Submit a function with zero or more arguments into the pool. Returns a future which can be used to wait for the task to finish and obtain its return value or exception.
+         *
+         * @tparam F The type of the function.
+         * @tparam A The types of the arguments.
+         * @tparam R The return type of the function (can be void).
+         * @param task The function to submit.
+         * @param args The zero or more arguments to pass to the function.
+         * @return A future to be used later to wait for the function to finish executing and/or obtain its returned value if it has one.
+         */
+        template <typename F, typename... A, typename R = std::invoke_result_t<std::decay_t<F>, std::decay_t<A>...>>
+        [[nodiscard]] std::future<R> submit(F&& task, A&&... args) {
+            std::function<R()> task_function = std::bind(std::forward<F>(task), std::forward<A>(args)...);
+            std::shared_ptr<std::promise<R>> task_promise = std::make_shared<std::promise<R>>();
+            push_task(
+                [task_function, task_promise] {
+                    try {
+                        if constexpr (std::is_void_v<R>) {
+                            std::invoke(task_function);
+                            task_promise->set_value();
+                        }
+                        else {
+                            task_promise->set_value(std::invoke(task_function));
+                        }
+                    }
+                    catch (...) {
+                        try {
+                            task_promise->set_exception(std::current_exception());
+                        }
+                        catch (...) {
+                        }
+                    }
+                });
+            return task_promise->get_future();
+        }
+
+        /**
+         * @brief Run a parallel loop and wait for it to finish. The range is split recursively into halves: the upper half of each split is spawned as a task and the lower half is processed by the current thread, so idle workers steal large chunks first. May be called both from outside the pool and from inside a task (nested parallelism); while waiting, the calling thread executes other tasks.
+         *
+         * @tparam F The type of the function to loop through.
+         * @tparam T1 The type of the first index in the loop.
+         * @tparam T2 The type of the index after the last index in the loop.
+         * @tparam T The common type of T1 and T2.
+         * @param first_index The first index in the loop.
+         * @param index_after_last The index after the last index in the loop.
+         * @param loop The function to loop through. Should take exactly two arguments: the first index in the block and the index after the last index in the block.
+         * @param grain_size The size below which a block is no longer split. The default is to aim for about 8 blocks per thread.
+         */
+        template <typename F, typename T1, typename T2, typename T = std::common_type_t<T1, T2>>
+        void parallel_for(const T1 first_index, const T2 index_after_last, F&& loop, size_t grain_size = 0) {
+            const T first = static_cast<T>(first_index);
+            const T last = static_cast<T>(index_after_last);
+            if (last <= first)
+                return;
+            if (grain_size == 0)
+                grain_size = std::max<size_t>(1, static_cast<size_t>(last - first) / (static_cast<size_t>(thread_count) * 8));
+            task_group group(*this);
+            split_loop(group, first, last, loop, grain_size);
+            group.wait();
+        }
+
+        /**
+         * @brief Wait for all tasks in the pool to complete. Must not be called from inside a task; use a task_group to wait for nested tasks instead.
+         */
+        void wait_for_tasks() {
+            std::unique_lock done_lock(done_mutex);
+            tasks_done_cv.wait(done_lock, [this] { return tasks_total.load() == 0; });
+        }
+
+        /**
+         * @brief Wait for all tasks to complete, but stop waiting after the specified duration has passed.
+         *
+         * @tparam R An arithmetic type representing the number of ticks to wait.
+         * @tparam P An std::ratio representing the length of each tick in seconds.
+         * @param duration The time duration to wait.
+         * @return true if all tasks finished running, false if the duration expired but some tasks are still running.
+         */
+        template <typename R, typename P>
+        bool wait_for_tasks_duration(const std::chrono::duration<R, P>& duration) {
+            std::unique_lock done_lock(done_mutex);
+            return tasks_done_cv.wait_for(done_lock, duration, [this] { return tasks_total.load() == 0; });
+        }
+
+        /**
+         * @brief Execute one queued task on the calling thread, if one is available. Used to help instead of blocking while waiting for nested tasks.
+         *
+         * @return true if a task was executed, false if no task could be found.
+         */
+        bool run_pending_task() {
+            task_t* task = nullptr;
+            if (!take_task(task))
+                return false;
+            tasks_queued.fetch_sub(1);
+            (*task)();
+            delete task;
+            if (tasks_total.fetch_sub(1) == 1) {
+                const std::scoped_lock done_lock(done_mutex);
+                tasks_done_cv.notify_all();
+            }
+            return true;
+        }
+
+        /**
+         * @brief A group of tasks that can be waited for together. Tasks may spawn further tasks into the same group. wait() executes other tasks while the group is unfinished, so it may be called from inside a task without blocking a worker. The first exception thrown by a task in the group is rethrown by wait().
+         */
+        class [[nodiscard]] task_group {
+        public:
+            explicit task_group(work_stealing_pool& pool_) : pool(pool_) {}
+
+            task_group(const task_group&) = delete;
+            task_group& operator=(const task_group&) = delete;
+
+            ~task_group() {
+                while (pending.load(std::memory_order_acquire) > 0) {
+                    if (!pool.run_pending_task())
+                        std::this_thread::yield();
+                }
+            }
+
+            /**
+             * @brief Spawn a task in this group.
+             *
+             * @tparam F The type of the function.
+             * @param task The function to run. Should take no arguments.
+             */
+            template <typename F>
+            void run(F&& task) {
+                pending.fetch_add(1, std::memory_order_relaxed);
+                pool.push_task(
+                    [this, task = std::forward<F>(task)]() mutable {
+                        try {
+                            task();
+                        }
+                        catch (...) {
+                            const std::scoped_lock exception_lock(exception_mutex);
+                            if (!exception)
+                                exception = std::current_exception();
+                        }
+                        pending.fetch_sub(1, std::memory_order_release);
+                    });
+            }
+
+            /**
+             * @brief Wait for all tasks in the group, executing other tasks in the meantime.
+             */
+            void wait() {
+                while (pending.load(std::memory_order_acquire) > 0) {
+                    if (!pool.run_pending_task())
+                        std::this_thread::yield();
+                }
+                if (exception) {
+                    std::exception_ptr e = exception;
+                    exception = nullptr;
+                    std::rethrow_exception(e);
+                }
+            }
+
+        private:
+            work_stealing_pool& pool;
+            std::atomic<size_t> pending = 0;
+            std::mutex exception_mutex = {};
+            std::exception_ptr exception = nullptr;
+        };
+
+    private:
+        using task_t = std::function<void()>;
+
+        // ========================
+        // Private member functions
+        // ========================
+
+        void create_threads() {
+            workers_running = true;
+            for (concurrency_t i = 0; i < thread_count; ++i)
+                threads[i] = std::thread(&work_stealing_pool::worker, this, i);
+        }
+
+        [[nodiscard]] static concurrency_t determine_thread_count(const concurrency_t thread_count_) {
+            if (thread_count_ > 0)
+                return thread_count_;
+            return std::thread::hardware_concurrency() > 0 ? std::thread::hardware_concurrency() : 1;
+        }
+
+        /**
+         * @brief Recursively split [first, last) into halves, spawning the upper halves into the group.
+         */
+        template <typename F, typename T>
+        void split_loop(task_group& group, T first, T last, F& loop, const size_t grain_size) {
+            while (static_cast<size_t>(last - first) > grain_size) {
+                const T mid = first + (last - first) / 2;
+                group.run([this, &group, &loop, mid, last, grain_size] { split_loop(group, mid, last, loop, grain_size); });
+                last = mid;
+            }
+            loop(first, last);
+        }
+
+        /**
+         * @brief Find a task: first the calling worker's own deque, then the injection queue, then the deques of the other workers starting from a random victim.
+         */
+        [[nodiscard]] bool take_task(task_t*& task) {
+            const bool is_worker = current_pool == this;
+            if (is_worker && deques[current_index].pop(task))
+                return true;
+            if (injection_size.load() > 0) {
+                const std::scoped_lock injection_lock(injection_mutex);
+                if (!injection_queue.empty()) {
+                    task = injection_queue.front();
+                    injection_queue.pop();
+                    injection_size.fetch_sub(1);
+                    return true;
+                }
+            }
+            // xorshift: a cheap per-thread random victim
+            thread_local uint32_t random_state = 0x9e3779b9u ^ static_cast<uint32_t>(std::hash<std::thread::id>()(std::this_thread::get_id()));
+            random_state ^= random_state << 13;
+            random_state ^= random_state >> 17;
+            random_state ^= random_state << 5;
+            const concurrency_t start = random_state % thread_count;
+            // Workers first steal inside their own group, then from any other worker.
+            for (int same_group = is_worker ? 1 : 0; same_group >= 0; --same_group) {
+                for (concurrency_t i = 0; i < thread_count; ++i) {
+                    const concurrency_t victim = (start + i) % thread_count;
+                    if (is_worker && victim == current_index)
+                        continue;
+                    if (is_worker && (worker_groups[victim] == worker_groups[current_index]) != (same_group == 1))
+                        continue;
+                    if (deques[victim].steal(task))
+                        return true;
+                }
+            }
+            return false;
+        }
+
+        /**
+         * @brief The worker function. Executes tasks while any can be found, spins briefly when idle, then sleeps until push_task() signals a new task.
+         */
+        void worker(const concurrency_t index) {
+            current_pool = this;
+            current_index = index;
+            if (worker_init)
+                worker_init(index);
+            while (true) {
+                if (run_pending_task())
+                    continue;
+                bool found = false;
+                for (int spin = 0; spin < 64 && !found; ++spin) {
+                    std::this_thread::yield();
+                    found = run_pending_task();
+                }
+                if (found)
+                    continue;
+
+                std::unique_lock sleep_lock(sleep_mutex);
+                workers_sleeping.fetch_add(1);
+                task_available_cv.wait(sleep_lock, [this] { return tasks_queued.load() > 0 || !workers_running; });
+                workers_sleeping.fetch_sub(1);
+                if (!workers_running)
+                    break;
+            }
+            current_pool = nullptr;
+        }
+
+        // ============
+        // Private data
+        // ============
+
+        /**
+         * @brief The pool that owns the current thread, or nullptr if the current thread is not a worker.
+         */
+        inline static thread_local work_stealing_pool* current_pool = nullptr;
+
+        /**
+         * @brief The index of the current worker thread in its pool.
+         */
+        inline static thread_local concurrency_t current_index = 0;
+
+        concurrency_t thread_count = 0;
+        std::unique_ptr<std::thread[]> threads = nullptr;
+
+        /**
+         * @brief One deque per worker thread.
+         */
+        std::unique_ptr<work_stealing_deque<task_t*>[]> deques = nullptr;
+
+        /**
+         * @brief The group of each worker, used to prefer stealing from nearby workers.
+         */
+        std::vector<concurrency_t> worker_groups = {};
+
+        /**
+         * @brief A function called on each worker thread when it starts.
+         */
+        std::function<void(concurrency_t)> worker_init = {};
+
+        /**
+         * @brief Tasks pushed from threads outside the pool.
+         */
+        std::queue<task_t*> injection_queue = {};
+        std::mutex injection_mutex = {};
+        std::atomic<size_t> injection_size = 0;
+
+        /**
+         * @brief The number of tasks waiting in a deque or in the injection queue.
+         */
+        std::atomic<size_t> tasks_queued = 0;
+
+        /**
+         * @brief The number of unfinished tasks, queued or running.
+         */
+        std::atomic<size_t> tasks_total = 0;
+
+        std::atomic<size_t> workers_sleeping = 0;
+        std::mutex sleep_mutex = {};
+        std::condition_variable task_available_cv = {};
+        bool workers_running = false;
+
+        std::mutex done_mutex = {};
+        std::condition_variable tasks_done_cv = {};
+    };
+
+    //                                 End class work_stealing_pool                                  //
+    // ============================================================================================= //
+
     // ============================================================================================= //
     //                                   Begin class synced_stream                                   //
 
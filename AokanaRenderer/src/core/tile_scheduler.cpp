@@ -0,0 +1,128 @@
+#include "tile_scheduler.h"
+
+#include <algorithm>
+
+namespace Aokana {
+
+    TileScheduler::TileScheduler(const Film& film, int node_count, bool split_tiles) :
+        tile_costs(film.tiles.size(), 0.0),
+        film(film),
+        node_count(std::max(1, node_count)),
+        split_tiles(split_tiles),
+        pending(std::max(1, node_count)),
+        rows_remaining(film.tiles.size(), 0),
+        pass_costs(film.tiles.size(), 0.0) {}
+
+    bool TileScheduler::HasCostEstimate() const {
+        return std::any_of(tile_costs.begin(), tile_costs.end(), [](double cost) { return cost > 0; });
+    }
+
+    void TileScheduler::BeginPass(const std::vector<int>& tile_indices) {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        // 按行优先的空间顺序把 tile 均分给各个节点, 每一遍的划分都相同, 节点访问的场景与胶片数据保持不变
+        std::vector<int> spatial_order = tile_indices;
+        std::stable_sort(spatial_order.begin(), spatial_order.end(), [&](int a, int b) {
+            const FilmTile& ta = film.tiles[a];
+            const FilmTile& tb = film.tiles[b];
+            return ta.v_min != tb.v_min ? ta.v_min < tb.v_min : ta.u_min < tb.u_min;
+        });
+        for (int node = 0; node < node_count; ++node) {
+            size_t begin = spatial_order.size() * node / node_count;
+            size_t end = spatial_order.size() * (node + 1) / node_count;
+            std::vector<int> order(spatial_order.begin() + begin, spatial_order.begin() + end);
+            // 同一节点内按代价从高到低; 没有代价估计时保持 tile 的原有编号顺序
+            std::sort(order.begin(), order.end());
+            std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return tile_costs[a] > tile_costs[b]; });
+            pending[node].assign(order.begin(), order.end());
+        }
+        ranges.clear();
+
+        for (int index : tile_indices) {
+            const FilmTile& tile = film.tiles[index];
+            rows_remaining[index] = static_cast<int>(tile.v_max) - static_cast<int>(tile.v_min) + 1;
+            pass_costs[index] = 0;
+        }
+        worker_finish_times.clear();
+        pass_start = std::chrono::steady_clock::now();
+    }
+
+    bool TileScheduler::Acquire(TileRange*& range, int node) {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        // 先取本节点的 tile, 再取其他节点的
+        std::deque<int>* queue = nullptr;
+        for (int i = 0; i < node_count && queue == nullptr; ++i) {
+            std::deque<int>& candidate = pending[(node + i) % node_count];
+            if (!candidate.empty()) queue = &candidate;
+        }
+        if (queue != nullptr) {
+            int index = queue->front();
+            queue->pop_front();
+            const FilmTile& tile = film.tiles[index];
+            ranges.push_back(TileRange{ index, static_cast<int>(tile.v_min), static_cast<int>(tile.v_max) + 1 });
+            range = &ranges.back();
+            return true;
+        }
+
+        if (!split_tiles) return false;
+
+        // 没有未开始的 tile, 从剩余行最多的区间中分出后一半
+        TileRange* victim = nullptr;
+        for (auto& r : ranges) {
+            if (r.end_row - r.next_row > 0 && (victim == nullptr || r.end_row - r.next_row > victim->end_row - victim->next_row)) {
+                victim = &r;
+            }
+        }
+        if (victim == nullptr) return false;
+
+        int remaining = victim->end_row - victim->next_row;
+        int split = victim->next_row + remaining / 2;
+        ranges.push_back(TileRange{ victim->tile_index, split, victim->end_row });
+        victim->end_row = split;
+        range = &ranges.back();
+        return true;
+    }
+
+    bool TileScheduler::NextRows(TileRange& range, int& row_begin, int& row_end) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (range.next_row >= range.end_row) return false;
+        row_begin = range.next_row;
+        range.next_row = split_tiles ? range.next_row + 1 : range.end_row;
+        row_end = range.next_row;
+        return true;
+    }
+
+    bool TileScheduler::FinishRows(int tile_index, int row_count, double milliseconds) {
+        std::lock_guard<std::mutex> lock(mutex);
+        pass_costs[tile_index] += milliseconds;
+        rows_remaining[tile_index] -= row_count;
+        return rows_remaining[tile_index] == 0;
+    }
+
+    void TileScheduler::WorkerFinished() {
+        std::lock_guard<std::mutex> lock(mutex);
+        worker_finish_times.push_back(std::chrono::steady_clock::now());
+    }
+
+    double TileScheduler::EndPass() {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        // 这一遍的实测代价作为下一遍的估计
+        for (size_t i = 0; i < pass_costs.size(); ++i) {
+            if (pass_costs[i] > 0) tile_costs[i] = pass_costs[i];
+            pass_costs[i] = 0;
+        }
+
+        if (worker_finish_times.empty()) return 0;
+        auto pass_end = *std::max_element(worker_finish_times.begin(), worker_finish_times.end());
+        double pass_duration = std::chrono::duration<double>(pass_end - pass_start).count();
+        if (pass_duration <= 0) return 0;
+
+        double idle = 0;
+        for (const auto& t : worker_finish_times) {
+            idle += std::chrono::duration<double>(pass_end - t).count();
+        }
+        return idle / (pass_duration * worker_finish_times.size());
+    }
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include "film.h"
+
+namespace Aokana {
+
+    // 按代价调度 tile
+    // 每一遍开始时, 待渲染的 tile 按估计代价 (来自预渲染或上一遍的实测时间) 从高到低排列, 代价高的 tile 先被取走;
+    // 工作线程以行为单位渲染自己的区间, 队列取空后, 空闲线程从剩余行最多的区间中分走后一半, 尽量不让线程在最后空等
+    // 自适应采样在整个 tile 内分配样本预算, 这时 tile 不按行分割, 每个 tile 整个交给一个线程
+    // 有多个 NUMA 节点时, tile 按行优先顺序分成连续的若干块, 每个节点一块, 相邻的 tile 由同一节点渲染; 节点自己的 tile 取完后再取其他节点的
+    class TileScheduler {
+    public:
+        // 一个 tile 中尚未渲染的连续若干行 [next_row, end_row)
+        struct TileRange {
+            int tile_index;
+            int next_row;
+            int end_row;
+        };
+
+        explicit TileScheduler(const Film& film, int node_count = 1, bool split_tiles = true);
+
+        std::vector<double> tile_costs;     // 每个 tile 的估计代价 (毫秒), 全为 0 时按原有顺序渲染
+
+        bool HasCostEstimate() const;
+
+        void BeginPass(const std::vector<int>& tile_indices);
+        // 为 node 上的工作线程取得一个区间; 没有可以分配的工作时返回 false
+        bool Acquire(TileRange*& range, int node = 0);
+        // 从区间中取出接下来要渲染的行 [row_begin, row_end), 按行分割时每次一行, 否则为区间中剩余的所有行;
+        // 区间已取完 (或被其他线程分走) 时返回 false
+        bool NextRows(TileRange& range, int& row_begin, int& row_end);
+        // 报告 row_count 行渲染完成及其耗时; 返回 true 表示整个 tile 已经完成
+        bool FinishRows(int tile_index, int row_count, double milliseconds);
+        // 工作线程没有更多工作时调用
+        void WorkerFinished();
+        // 结束这一遍, 返回尾部空闲比例: 线程在最后一个线程完成前的空闲时间占总线程时间的比例
+        double EndPass();
+
+    private:
+        const Film& film;
+        std::mutex mutex;
+        int node_count;
+        bool split_tiles;
+        std::vector<std::deque<int>> pending;   // 每个节点尚未开始的 tile
+        std::deque<TileRange> ranges;           // deque 的 push_back 不会使已有元素的引用失效
+        std::vector<int> rows_remaining;
+        std::vector<double> pass_costs;
+        std::vector<std::chrono::steady_clock::time_point> worker_finish_times;
+        std::chrono::steady_clock::time_point pass_start;
+    };
+}
@@ -0,0 +1,126 @@
+#include "topology.h"
+
+#include <algorithm>
+#include <thread>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <Windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#endif
+
+namespace Aokana {
+
+    int CpuTopology::CpuCount() const {
+        int count = 0;
+        for (const auto& cpus : node_cpus) count += static_cast<int>(cpus.size());
+        return count;
+    }
+
+    namespace {
+
+        CpuTopology SingleNodeTopology() {
+            CpuTopology topology;
+            topology.node_cpus.emplace_back();
+#if defined(__linux__)
+            // 没有 NUMA 信息时 (例如容器中没有 /sys/devices/system/node) 同样只使用进程允许运行的处理器,
+            // 处理器编号不一定从 0 开始连续
+            cpu_set_t allowed;
+            CPU_ZERO(&allowed);
+            if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+                for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+                    if (CPU_ISSET(cpu, &allowed)) topology.node_cpus[0].push_back(cpu);
+                }
+                if (!topology.node_cpus[0].empty()) return topology;
+            }
+#endif
+            int cpu_count = std::max(1u, std::thread::hardware_concurrency());
+            for (int cpu = 0; cpu < cpu_count; ++cpu) topology.node_cpus[0].push_back(cpu);
+            return topology;
+        }
+
+#if defined(__linux__)
+        // 解析形如 "0-3,8-11" 的处理器列表
+        std::vector<int> ParseCpuList(const std::string& list) {
+            std::vector<int> cpus;
+            std::stringstream stream(list);
+            std::string range;
+            while (std::getline(stream, range, ',')) {
+                if (range.empty() || range == "\n") continue;
+                size_t dash = range.find('-');
+                int first = std::stoi(range.substr(0, dash));
+                int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+                for (int cpu = first; cpu <= last; ++cpu) cpus.push_back(cpu);
+            }
+            return cpus;
+        }
+#endif
+    }
+
+    CpuTopology DetectCpuTopology() {
+        CpuTopology topology;
+
+#if defined(_WIN32)
+        ULONG highest_node = 0;
+        if (!GetNumaHighestNodeNumber(&highest_node)) return SingleNodeTopology();
+        for (ULONG node = 0; node <= highest_node; ++node) {
+            GROUP_AFFINITY affinity = {};
+            if (!GetNumaNodeProcessorMaskEx(static_cast<USHORT>(node), &affinity)) continue;
+            std::vector<int> cpus;
+            for (int bit = 0; bit < 64; ++bit) {
+                if (affinity.Mask & (KAFFINITY(1) << bit)) cpus.push_back(affinity.Group * 64 + bit);
+            }
+            if (!cpus.empty()) topology.node_cpus.push_back(cpus);
+        }
+#elif defined(__linux__)
+        // 只使用进程允许运行的处理器
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        bool has_affinity = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+
+        for (int node = 0;; ++node) {
+            std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+            if (!file) break;
+            std::string list;
+            std::getline(file, list);
+            std::vector<int> cpus;
+            for (int cpu : ParseCpuList(list)) {
+                if (cpu >= CPU_SETSIZE) continue;
+                if (!has_affinity || CPU_ISSET(cpu, &allowed)) cpus.push_back(cpu);
+            }
+            if (!cpus.empty()) topology.node_cpus.push_back(cpus);
+        }
+#endif
+
+        if (topology.node_cpus.empty()) return SingleNodeTopology();
+        return topology;
+    }
+
+    bool PinCurrentThreadToCpu(int cpu) {
+#if defined(_WIN32)
+        GROUP_AFFINITY affinity = {};
+        affinity.Group = static_cast<WORD>(cpu / 64);
+        affinity.Mask = KAFFINITY(1) << (cpu % 64);
+        return SetThreadGroupAffinity(GetCurrentThread(), &affinity, nullptr) != 0;
+#elif defined(__linux__)
+        if (cpu < 0 || cpu >= CPU_SETSIZE) return false;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+        (void)cpu;
+        return false;
+#endif
+    }
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <vector>
+
+namespace Aokana {
+
+    // 处理器拓扑: 每个 NUMA 节点包含的逻辑处理器编号
+    // Windows 上通过 GetNumaNodeProcessorMaskEx 获得, Linux 上读取 /sys/devices/system/node 并只保留进程的亲和性掩码允许的处理器,
+    // 其他平台视为单个节点
+    struct CpuTopology {
+        std::vector<std::vector<int>> node_cpus;
+
+        int NodeCount() const { return static_cast<int>(node_cpus.size()); }
+        int CpuCount() const;
+    };
+
+    CpuTopology DetectCpuTopology();
+
+    // 把当前线程绑定到逻辑处理器 cpu 上, 失败或平台不支持时返回 false
+    bool PinCurrentThreadToCpu(int cpu);
+}
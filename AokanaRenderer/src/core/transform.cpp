@@ -29,6 +29,22 @@ namespace Aokana {
 		return Point3(px, py, pz) / pw;
 	}
 
+	Normal3 Transform::Apply(const Normal3& n) const {
+		double x = n.x, y = n.y, z = n.z;
+		return Normal3(
+			inv_matrix(0, 0) * x + inv_matrix(1, 0) * y + inv_matrix(2, 0) * z,
+			inv_matrix(0, 1) * x + inv_matrix(1, 1) * y + inv_matrix(2, 1) * z,
+			inv_matrix(0, 2) * x + inv_matrix(1, 2) * y + inv_matrix(2, 2) * z);
+	}
+
+	Bounds3 Transform::Apply(const Bounds3& b) const {
+		Bounds3 result;
+		for (int i = 0; i < 8; ++i) {
+			result = Bounds3::Merge(result, Apply(b.Corner(i)));
+		}
+		return result;
+	}
+
 	Transform Aokana::Transform::Inverse(const Transform& transform) {
 		return Transform(transform.GetInverseMatrix(), transform.GetMatrix());
 	}
@@ -23,13 +23,22 @@ namespace Aokana {
 
 		Vector3 Apply(const Vector3& v) const;
 		Point3 Apply(const Point3& p) const;
+		// 法线按逆矩阵的转置变换, 结果没有归一化
+		Normal3 Apply(const Normal3& n) const;
+		// 变换后的包围盒的 8 个顶点的包围盒
+		Bounds3 Apply(const Bounds3& b) const;
+
+		// 先应用 rhs, 再应用 *this
+		Transform operator*(const Transform& rhs) const {
+			return Transform(matrix * rhs.matrix, rhs.inv_matrix * inv_matrix);
+		}
 
 		static Transform Inverse(const Transform& transform);
 		static Transform Transpose(const Transform& transform);
 		static Transform Translate(Vector3 delta);
 		static Transform Translate(double x, double y, double z) { return Translate(Vector3(x, y, z)); }
 		static Transform Scale(Vector3 scale);
-		static Transform Scale(double x, double y, double z) { return Scale(x, y, z); }
+		static Transform Scale(double x, double y, double z) { return Scale(Vector3(x, y, z)); }
 		static Transform RotateX(double degree);
 		static Transform RotateY(double degree);
 		static Transform RotateZ(double degree);
@@ -1,50 +1,190 @@
 #include "triangle.h"
 
+#include <algorithm>
+
 namespace Aokana {
 
-	TriangleMesh::TriangleMesh(const Transform& render_from_object, bool reverse_orientation, std::vector<int> indices, std::vector<Point3> p, std::vector<Vector3> s, std::vector<Normal3> n, std::vector<Point2> uv, std::vector<int> face_indices) :
+	TriangleMesh::TriangleMesh(const Transform& render_from_object, bool reverse_orientation, std::vector<int> indices, std::vector<Point3> p, std::vector<Vector3> s, std::vector<Normal3> n, std::vector<Point2> uv, std::vector<int> face_indices, const MeshCompression& compression) :
 		triangle_count(indices.size() / 3), vertex_count(p.size()) {
-		this->indices = g_int_buffer_cache->LookupOrAdd(indices);
 		for (Point3& point : p) {
 			point = render_from_object.Apply(point);
 		}
-		this->p = g_point3_buffer_cache->LookupOrAdd(p);
 		this->reverse_orientation = reverse_orientation;
 		this->transform_swaps_handedness = render_from_object.SwapsHandedness();
 
-		// TODO:
-		// 
-		//if (!uv.empty()) {
-		//	CHECK_EQ(nVertices, uv.size());
-		//	this->uv = point2BufferCache->LookupOrAdd(uv, alloc);
-		//}
-		//if (!n.empty()) {
-		//	CHECK_EQ(nVertices, n.size());
-		//	for (Normal3f& nn : n) {
-		//		nn = renderFromObject(nn);
-		//		if (reverseOrientation)
-		//			nn = -nn;
-		//	}
-		//	this->n = normal3BufferCache->LookupOrAdd(n, alloc);
-		//}
-		//if (!s.empty()) {
-		//	CHECK_EQ(nVertices, s.size());
-		//	for (Vector3f& ss : s)
-		//		ss = renderFromObject(ss);
-		//	this->s = vector3BufferCache->LookupOrAdd(s, alloc);
-		//}
-
-		//if (!faceIndices.empty()) {
-		//	CHECK_EQ(nTriangles, faceIndices.size());
-		//	this->faceIndices = intBufferCache->LookupOrAdd(faceIndices, alloc);
-		//}
-
-		//// Make sure that we don't have too much stuff to be using integers to
-		//// index into things.
-		//CHECK_LE(p.size(), std::numeric_limits<int>::max());
-		//// We could be clever and check indices.size() / 3 if we were careful
-		//// to promote to a 64-bit int before multiplying by 3 when we look up
-		//// in the indices array...
-		//CHECK_LE(indices.size(), std::numeric_limits<int>::max());
-	}
-}
\ No newline at end of file
+		this->indices = g_int_buffer_cache->LookupOrAdd(std::move(indices));
+		if (compression.positions && !p.empty()) {
+			Bounds3 bounds;
+			for (const Point3& point : p) bounds = Bounds3::Merge(bounds, Bounds3(point));
+			p_min = bounds.p_min;
+			p_extent = bounds.p_max - bounds.p_min;
+			std::vector<QuantizedPoint3> packed(p.size());
+			for (size_t i = 0; i < p.size(); ++i) {
+				packed[i] = QuantizedPoint3{
+					QuantizeUnorm16(p[i].x, p_min.x, p_extent.x),
+					QuantizeUnorm16(p[i].y, p_min.y, p_extent.y),
+					QuantizeUnorm16(p[i].z, p_min.z, p_extent.z) };
+			}
+			this->packed_p = g_quantized_point3_buffer_cache->LookupOrAdd(std::move(packed));
+		}
+		else {
+			this->p = g_point3_buffer_cache->LookupOrAdd(std::move(p));
+		}
+
+		if (uv.size() == static_cast<size_t>(vertex_count)) {
+			if (compression.uvs) {
+				Point2 uv_max = uv_min = uv.front();
+				for (const Point2& t : uv) {
+					uv_min = Point2(std::min(uv_min.x, t.x), std::min(uv_min.y, t.y));
+					uv_max = Point2(std::max(uv_max.x, t.x), std::max(uv_max.y, t.y));
+				}
+				uv_extent = uv_max - uv_min;
+				std::vector<QuantizedPoint2> packed(uv.size());
+				for (size_t i = 0; i < uv.size(); ++i) {
+					packed[i] = QuantizedPoint2{
+						QuantizeUnorm16(uv[i].x, uv_min.x, uv_extent.x),
+						QuantizeUnorm16(uv[i].y, uv_min.y, uv_extent.y) };
+				}
+				this->packed_uv = g_quantized_point2_buffer_cache->LookupOrAdd(std::move(packed));
+			}
+			else {
+				this->uv = g_point2_buffer_cache->LookupOrAdd(std::move(uv));
+			}
+		}
+		if (n.size() == static_cast<size_t>(vertex_count)) {
+			for (Normal3& nn : n) {
+				nn = render_from_object.Apply(nn);
+				if (reverse_orientation)
+					nn = -nn;
+			}
+			if (compression.normals) {
+				// 八面体映射要求单位向量, 长度为 0 的法线 (没有被任何面引用的顶点) 编码为 +z
+				std::vector<SphericalGeometry::OctahedralVector> packed(n.size());
+				for (size_t i = 0; i < n.size(); ++i) {
+					Vector3 v(n[i]);
+					packed[i] = SphericalGeometry::OctahedralVector(v.LengthSquare() > 0 ? Normalize(v) : Vector3(0, 0, 1));
+				}
+				this->packed_n = g_octahedral_vector_buffer_cache->LookupOrAdd(std::move(packed));
+			}
+			else {
+				this->n = g_normal3_buffer_cache->LookupOrAdd(std::move(n));
+			}
+		}
+		if (s.size() == static_cast<size_t>(vertex_count)) {
+			for (Vector3& ss : s)
+				ss = render_from_object.Apply(ss);
+			this->s = g_vector3_buffer_cache->LookupOrAdd(std::move(s));
+		}
+		if (face_indices.size() == static_cast<size_t>(triangle_count)) {
+			this->face_indices = g_int_buffer_cache->LookupOrAdd(std::move(face_indices));
+		}
+	}
+
+	TriangleMesh::TriangleMesh(int triangle_count, int vertex_count, const int* indices, const Point3* p, const Normal3* n, const Point2* uv, bool reverse_orientation, bool transform_swaps_handedness, std::shared_ptr<const void> storage) :
+		triangle_count(triangle_count), vertex_count(vertex_count), indices(indices), p(p), n(n), uv(uv),
+		reverse_orientation(reverse_orientation), transform_swaps_handedness(transform_swaps_handedness),
+		external_storage(std::move(storage)) {}
+
+	size_t TriangleMesh::BytesUsed() const {
+		size_t vertices = static_cast<size_t>(vertex_count);
+		size_t bytes = static_cast<size_t>(triangle_count) * 3 * sizeof(int);
+		if (p) bytes += vertices * sizeof(Point3);
+		if (packed_p) bytes += vertices * sizeof(QuantizedPoint3);
+		if (n) bytes += vertices * sizeof(Normal3);
+		if (packed_n) bytes += vertices * sizeof(SphericalGeometry::OctahedralVector);
+		if (s) bytes += vertices * sizeof(Vector3);
+		if (uv) bytes += vertices * sizeof(Point2);
+		if (packed_uv) bytes += vertices * sizeof(QuantizedPoint2);
+		if (face_indices) bytes += static_cast<size_t>(triangle_count) * sizeof(int);
+		return bytes;
+	}
+
+	bool MeshTriangle::Intersect(const Ray& ray, double t_min, double t_max) const {
+		SurfaceInteraction hit_point;
+		return IntersectP(ray, hit_point, t_min, t_max);
+	}
+
+	bool MeshTriangle::IntersectP(const Ray& ray, SurfaceInteraction& hit_point, double t_min, double t_max) const {
+		return IntersectMeshTriangle(*mesh, triangle_index, ray, hit_point, t_min, t_max);
+	}
+
+	bool IntersectMeshTriangle(const TriangleMesh& mesh, int triangle_index, const Ray& ray, SurfaceInteraction& hit_point, double t_min, double t_max) {
+		// 与 Triangle 相同的 Moller Trumbore 算法, p0 -> p1 -> p2 顺时针为正面
+		const int* v = &mesh.indices[3 * triangle_index];
+		const Point3 a = mesh.Position(v[0]);
+		const Point3 b = mesh.Position(v[1]);
+		const Point3 c = mesh.Position(v[2]);
+
+		auto e1 = b - a;
+		auto e2 = c - a;
+		auto s = ray.origin - a;
+		auto s1 = Cross(ray.direction, e2);
+		auto s2 = Cross(s, e1);
+		auto div = 1.0 / Dot(s1, e1);
+		auto t = div * Dot(s2, e2);
+		auto p1 = div * Dot(s1, s);
+		auto p2 = div * Dot(s2, ray.direction);
+		auto p0 = 1.0 - p1 - p2;
+
+		if (t < t_min || t > t_max) return false;
+		if (p0 < 0 || p0 > 1 || p1 < 0 || p1 > 1 || p2 < 0 || p2 > 1) return false;
+
+		hit_point.time = t;
+		hit_point.p = ray.At(t);
+		// 纹理坐标与着色法线只在击中时解码
+		if (mesh.HasUVs()) {
+			Point2 uv0 = mesh.UV(v[0]), uv1 = mesh.UV(v[1]), uv2 = mesh.UV(v[2]);
+			hit_point.uv.x = p0 * uv0.x + p1 * uv1.x + p2 * uv2.x;
+			hit_point.uv.y = p0 * uv0.y + p1 * uv1.y + p2 * uv2.y;
+		}
+		else {
+			hit_point.uv.x = hit_point.uv.y = 0;
+		}
+
+		Normal3 outward_normal = Normal3(Normalize(Cross(e1, e2)));
+		if (mesh.reverse_orientation) outward_normal = -outward_normal;
+		hit_point.SetFaceNormal(ray, outward_normal);
+
+		// 有顶点法线时使用插值的着色法线, 并翻转到几何法线所在的半球
+		if (mesh.HasNormals()) {
+			Vector3 shading_normal =
+				p0 * Vector3(mesh.Normal(v[0])) + p1 * Vector3(mesh.Normal(v[1])) + p2 * Vector3(mesh.Normal(v[2]));
+			if (shading_normal.LengthSquare() > 0) {
+				hit_point.normal = FaceForward(Normal3(Normalize(shading_normal)), Vector3(hit_point.normal));
+			}
+		}
+
+		return true;
+	}
+
+	bool MeshTriangle::bounding_box(double time0, double time1, Bounds3& output_box) const {
+		output_box = WorldBound(time0, time1);
+		return true;
+	}
+
+	Bounds3 MeshTriangle::WorldBound(double, double) const {
+		// 加一个偏移, 避免边界框退化为平面
+		const int* v = Vertices();
+		const Point3 a = mesh->Position(v[0]);
+		const Point3 b = mesh->Position(v[1]);
+		const Point3 c = mesh->Position(v[2]);
+		Point3 p_min(
+			std::min({ a.x, b.x, c.x }) - 0.0001,
+			std::min({ a.y, b.y, c.y }) - 0.0001,
+			std::min({ a.z, b.z, c.z }) - 0.0001);
+		Point3 p_max(
+			std::max({ a.x, b.x, c.x }) + 0.0001,
+			std::max({ a.y, b.y, c.y }) + 0.0001,
+			std::max({ a.z, b.z, c.z }) + 0.0001);
+		return Bounds3(p_min, p_max);
+	}
+
+	std::vector<std::shared_ptr<Shape>> CreateTriangles(const std::shared_ptr<const TriangleMesh>& mesh) {
+		std::vector<std::shared_ptr<Shape>> triangles;
+		triangles.reserve(mesh->triangle_count);
+		for (int i = 0; i < mesh->triangle_count; ++i) {
+			triangles.push_back(std::make_shared<MeshTriangle>(mesh, i));
+		}
+		return triangles;
+	}
+}
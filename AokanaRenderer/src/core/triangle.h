@@ -1,17 +1,30 @@
 #pragma once
+#include <memory>
+#include <vector>
+
 #include "vec.h"
 #include "transform.h"
 #include "buffer_cache.h"
+#include "quantized.h"
+#include "shape.h"
 
 namespace Aokana {
 
+	// 顶点与索引数据保存在全局的 BufferCache 中, 内容完全相同的数据 (同一模型的多个实例, 重复的文件) 只保存一份.
+	// 按 compression 压缩的属性只保存压缩后的形式 (packed_*), 对应的未压缩指针为 nullptr; 应通过 Position / Normal / UV 读取顶点属性
 	class TriangleMesh {
 	public:
 		TriangleMesh(
 			const Transform& render_from_object, bool reverse_orientation,
 			std::vector<int> indices, std::vector<Point3> p,
 			std::vector<Vector3> s, std::vector<Normal3> n,
-			std::vector<Point2> uv, std::vector<int> face_indices);
+			std::vector<Point2> uv, std::vector<int> face_indices,
+			const MeshCompression& compression = MeshCompression());
+		// 直接使用给出的顶点数据而不拷贝 (例如已经加入 BufferCache 的内存映射文件), storage 保证数据在网格的生命周期内有效
+		TriangleMesh(
+			int triangle_count, int vertex_count, const int* indices, const Point3* p,
+			const Normal3* n, const Point2* uv, bool reverse_orientation, bool transform_swaps_handedness,
+			std::shared_ptr<const void> storage);
 
 
 	public:
@@ -22,7 +35,67 @@ namespace Aokana {
 		const Normal3* n{ nullptr };	// Normal
 		const Vector3* s{ nullptr };	// Tangent
 		const Point2* uv{ nullptr };	// Tex Coord
+		const int* face_indices{ nullptr };
 		bool reverse_orientation;
 		bool transform_swaps_handedness;
+
+		const QuantizedPoint3* packed_p{ nullptr };
+		const SphericalGeometry::OctahedralVector* packed_n{ nullptr };
+		const QuantizedPoint2* packed_uv{ nullptr };
+		Point3 p_min;			// packed_p 的范围
+		Vector3 p_extent;
+		Point2 uv_min;			// packed_uv 的范围
+		Vector2 uv_extent;
+
+		Point3 Position(int v) const {
+			if (p) return p[v];
+			return Point3(
+				DequantizeUnorm16(packed_p[v].x, p_min.x, p_extent.x),
+				DequantizeUnorm16(packed_p[v].y, p_min.y, p_extent.y),
+				DequantizeUnorm16(packed_p[v].z, p_min.z, p_extent.z));
+		}
+		bool HasNormals() const { return n || packed_n; }
+		Normal3 Normal(int v) const {
+			if (n) return n[v];
+			return Normal3(Vector3(packed_n[v]));
+		}
+		bool HasUVs() const { return uv || packed_uv; }
+		Point2 UV(int v) const {
+			if (uv) return uv[v];
+			return Point2(
+				DequantizeUnorm16(packed_uv[v].x, uv_min.x, uv_extent.x),
+				DequantizeUnorm16(packed_uv[v].y, uv_min.y, uv_extent.y));
+		}
+		// 所有顶点数据与索引占用的字节数
+		size_t BytesUsed() const;
+
+	private:
+		std::shared_ptr<const void> external_storage;
+	};
+
+	// 引用 TriangleMesh 中一个三角形的形状, 只保存网格指针与三角形编号
+	class MeshTriangle : public Shape {
+	public:
+		MeshTriangle(const std::shared_ptr<const TriangleMesh>& mesh, int triangle_index) :
+			mesh(mesh), triangle_index(triangle_index) {}
+
+		virtual bool Intersect(const Ray& ray, double t_min = 0.0001, double t_max = 1.0) const override;
+		virtual bool IntersectP(const Ray& ray, SurfaceInteraction& hit_point, double t_min = 0.0001, double t_max = 1.0) const override;
+		virtual bool bounding_box(double time0, double time1, Bounds3& output_box) const override;
+		virtual Bounds3 WorldBound(double time0 = 0.0001, double time1 = 1.0) const override;
+
+	private:
+		const int* Vertices() const { return &mesh->indices[3 * triangle_index]; }
+
+	public:
+		std::shared_ptr<const TriangleMesh> mesh;
+		int triangle_index;
 	};
-}
\ No newline at end of file
+
+	// 光线与网格的第 triangle_index 个三角形求交, 击中时填写 hit_point 中除图元与材质以外的部分.
+	// MeshTriangle 与直接遍历网格数据的加速结构 (MeshFileBVH) 共用
+	bool IntersectMeshTriangle(const TriangleMesh& mesh, int triangle_index, const Ray& ray, SurfaceInteraction& hit_point, double t_min, double t_max);
+
+	// 为网格的每个三角形创建一个 MeshTriangle
+	std::vector<std::shared_ptr<Shape>> CreateTriangles(const std::shared_ptr<const TriangleMesh>& mesh);
+}
@@ -4,6 +4,9 @@
 #include <limits>
 #include <random>
 #include <cassert>
+#include <cstdint>
+
+#include "rng.h"
 
 namespace Aokana {
     const double INF = std::numeric_limits<double>::max();
@@ -41,22 +44,27 @@ namespace Aokana {
     inline double SafeACos(double x) { return std::acos(Clamp(x, -1.0, 1.0)); }
     inline double SafeSqrt(double x) { return std::sqrt(std::max(0.0, x)); }
 
-    inline double RandomDoubleInRange(double min, double max) {
-        static std::uniform_real_distribution<double> distribution(min, max);
-        static std::mt19937 generator;
-        return distribution(generator);
+    // 每个线程一个 PCG32 生成器, 用于构建场景 (随机场景, Perlin 噪声等). 构建前调用 SeedRandom(0), 场景与之前的随机数使用无关.
+    // 渲染时的随机数都取自采样器 (见 Sampler), 与线程数和调度无关
+    inline RNG& ThreadRNG() {
+        thread_local RNG rng;
+        return rng;
+    }
+
+    inline void SeedRandom(uint64_t seed) {
+        ThreadRNG().SetSequence(seed);
     }
 
     inline double RandomDoubleIn01() {
-        static std::uniform_real_distribution<double> distribution(0.0, 1.0);
-        static std::mt19937 generator;
-        return distribution(generator);
+        return ThreadRNG().UniformDouble();
+    }
+
+    inline double RandomDoubleInRange(double min, double max) {
+        return min + (max - min) * RandomDoubleIn01();
     }
 
     inline int RandomIntInRange(int min, int max) {
-        static std::uniform_int_distribution<int> distribution(min, max);
-        static std::mt19937 generator;
-        return distribution(generator);
+        return min + static_cast<int>(ThreadRNG().UniformBounded(static_cast<uint32_t>(max - min + 1)));
     }
 
     // 在长为 length 的数组中寻找一段区间, 使得 pred(arr[i]) 为 true, pred(arr[i + 1]) 为 false, 返回 i 
@@ -0,0 +1,10 @@
+#include "worker_pool.h"
+#include "thread_pool.h"
+
+namespace Aokana {
+
+    BS::work_stealing_pool& SharedWorkerPool() {
+        static BS::work_stealing_pool pool;
+        return pool;
+    }
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+namespace BS {
+    class work_stealing_pool;
+}
+
+namespace Aokana {
+
+    // 进程内共享的工作窃取线程池, 第一次使用时创建, 线程数等于硬件线程数.
+    // 场景加载与后处理 (OBJ 解析, 网格文件, 降噪) 都在其中并行, 不必每次调用都创建和销毁一组线程;
+    // 多个线程可以同时在其中调用 parallel_for, 也可以在它的任务中嵌套调用
+    BS::work_stealing_pool& SharedWorkerPool();
+}
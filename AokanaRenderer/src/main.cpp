@@ -1,10 +1,36 @@
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
 #include <iostream>
+#include <optional>
 #include <string>
 #include "core/integrator.h"
 #include "core/matrix.h"
+#include "core/convergence.h"
+#include "core/denoiser.h"
+#include "core/distributed.h"
+#include "core/mesh_file.h"
+#include "core/obj_loader.h"
+#include "core/scene_loader.h"
+#include "external/argparse/argparse.hpp"
+#include "ui/ui.h"
 
 using namespace std;
 
+// 保存渲染结果: 输出图像, 同名的 .exr (未经色调映射的线性辐射度, 用于后期合成), AOV 以及降噪后的图像
+void SaveResults(Aokana::Film& film, const std::string& output, bool denoise) {
+    const std::filesystem::path output_path(output);
+    const std::string stem = std::filesystem::path(output_path).replace_extension().string();
+    film.SaveImage(output);
+    if (output_path.extension() != ".exr") film.SaveImage(stem + ".exr");
+    if (film.aovs) film.aovs->Save(stem, film);
+    if (denoise) {
+        Aokana::DenoiseFilm(film);
+        film.SaveImage(stem + "_denoised.png");
+        film.SaveImage(stem + "_denoised.exr");
+    }
+}
+
 void Render() {
     using namespace Aokana;
 
@@ -25,7 +51,8 @@ void Render() {
         "4: simple_light_scene\n" <<
         "5: bunny_scene\n" <<
         // "6: coffee_maker_scene\n" <<
-        "6: cornell_box_scene\n";
+        "6: cornell_box_scene\n" <<
+        "7: animated_spheres_scene\n";
 
 
     std::cin >> scene_id;
@@ -36,19 +63,117 @@ void Render() {
     std::cout << "[INFO] please input samples per pixel (default = 10):" << std::endl;
     std::cin >> integrator.sampler->samples_per_pixel;
 
+    std::cout << "[INFO] please input sampler (independent / halton / sobol / pmj02), or \"compare\" to compare their convergence:" << std::endl;
+    std::string sampler_name;
+    std::cin >> sampler_name;
+    bool compare_samplers = sampler_name == "compare";
+    if (!compare_samplers) {
+        std::shared_ptr<Sampler> sampler = CreateSampler(sampler_name, integrator.sampler->samples_per_pixel);
+        if (sampler == nullptr) {
+            std::cerr << "[ERROR] Unknown sampler \"" << sampler_name << "\", using independent sampler." << std::endl;
+        }
+        else {
+            integrator.sampler = sampler;
+        }
+    }
+
+    std::cout << "[INFO] please input reconstruction filter (box / tent / gaussian / mitchell):" << std::endl;
+    std::string filter_name;
+    std::cin >> filter_name;
+    std::shared_ptr<Filter> filter = CreateFilter(filter_name);
+    if (filter == nullptr) {
+        std::cerr << "[ERROR] Unknown filter \"" << filter_name << "\", using box filter." << std::endl;
+    }
+
+    std::cout << "[INFO] please input AOVs to output, separated by commas (depth,normal,albedo,material_id,primitive_id,sample_count,time / all / none):" << std::endl;
+    std::string aov_names;
+    std::cin >> aov_names;
+    uint32_t aov_flags = ParseAOVFlags(aov_names);
+
+    std::cout << "[INFO] Denoise after rendering? (0/1)" << std::endl;
+    int denoise = 0;
+    std::cin >> denoise;
+    // 降噪以反照率, 法线与深度为引导
+    if (denoise) aov_flags |= AOV_ALBEDO | AOV_NORMAL | AOV_DEPTH;
+
+    std::cout << "[INFO] Adaptive sampling? (0/1)" << std::endl;
+    std::cin >> integrator.adaptive_sampling;
+    if (integrator.adaptive_sampling) {
+        std::cout << "[INFO] please input relative error threshold (default = 0.02):" << std::endl;
+        std::cin >> integrator.adaptive_threshold;
+    }
+
+    std::cout << "[INFO] Progressive rendering? (0/1)" << std::endl;
+    std::cin >> integrator.progressive;
+    if (integrator.progressive) {
+        std::cout << "[INFO] please input samples per pixel of each pass (default = 1):" << std::endl;
+        std::cin >> integrator.progressive_spp_per_pass;
+        integrator.progressive_preview_path = "./output/preview.png";
+    }
+
+    std::cout << "[INFO] please input time budget in seconds (0 = render the given samples per pixel):" << std::endl;
+    std::cin >> integrator.time_budget_seconds;
+    if (integrator.time_budget_seconds > 0 && integrator.progressive_preview_path.empty()) {
+        integrator.progressive_preview_path = "./output/result.png";
+    }
+
+    std::cout << "[INFO] Checkpoint interval in seconds (0 = no checkpoint):" << std::endl;
+    std::cin >> integrator.checkpoint_interval_seconds;
+    if (integrator.checkpoint_interval_seconds > 0) {
+        integrator.checkpoint_path = "./output/checkpoint.bin";
+        std::cout << "[INFO] Resume from \"" << integrator.checkpoint_path << "\" if it exists? (0/1)" << std::endl;
+        std::cin >> integrator.resume_from_checkpoint;
+    }
+
+    std::cout << "[INFO] Pin worker threads / NUMA-aware placement? (0 = off, 1 = pin, 2 = pin + NUMA)" << std::endl;
+    int placement = 0;
+    std::cin >> placement;
+    integrator.pin_threads = placement >= 1;
+    integrator.numa_aware = placement >= 2;
+
+    std::cout << "[INFO] Stream a large image to ./output/result_stream.exr? Input its width (0 = render normally):" << std::endl;
+    int stream_width = 0;
+    std::cin >> stream_width;
+
+    std::cout << "[INFO] Render an animation? Input the first and last frame (e.g. \"0 47\", \"-1 -1\" = single frame):" << std::endl;
+    int first_frame = -1, last_frame = -1;
+    std::cin >> first_frame >> last_frame;
+
+    std::cout << "[INFO] Distribute the rendering to workers (\"AokanaRenderer --worker <host>:<port>\")? Input the port to listen on (0 = render locally):" << std::endl;
+    int coordinator_port = 0;
+    std::cin >> coordinator_port;
+    if (coordinator_port > 0) {
+        DistributedJob job;
+        job.scene_id = scene_id;
+        job.max_depth = integrator.max_depth;
+        job.samples_per_pixel = integrator.sampler->samples_per_pixel;
+        std::cout << "[INFO] please input samples per pixel of each task (0 = all samples in one task):" << std::endl;
+        std::cin >> job.samples_per_task;
+        if (!compare_samplers && CreateSampler(sampler_name, 1) != nullptr) {
+            std::snprintf(job.sampler, sizeof(job.sampler), "%s", sampler_name.c_str());
+        }
+        if (filter != nullptr) std::snprintf(job.filter, sizeof(job.filter), "%s", filter_name.c_str());
+        RunDistributedCoordinator(job, static_cast<uint16_t>(coordinator_port), "./output/result.png");
+        return;
+    }
+
     std::cout << "[INFO] Display GUI? (0/1)" << std::endl;
     int use_gui;
     std::cin >> use_gui;
+    if (!use_gui) {
+        std::cout << "[INFO] Publish preview to shared memory for \"AokanaRenderer --preview aokana_preview\"? (0/1)" << std::endl;
+        int publish_preview = 0;
+        std::cin >> publish_preview;
+        if (publish_preview) integrator.shared_preview_name = "aokana_preview";
+    }
 
-    switch (scene_id) {
-    case 0: integrator.scene = std::make_shared<Scene>(SampleScene::RandomBallScene()); break;
-    case 1: integrator.scene = std::make_shared<Scene>(SampleScene::TwoSpheresScene()); break;
-    case 2: integrator.scene = std::make_shared<Scene>(SampleScene::TwoPerlinSpheresScene()); break;
-    case 3: integrator.scene = std::make_shared<Scene>(SampleScene::EarthScene()); break;
-    case 4: integrator.scene = std::make_shared<Scene>(SampleScene::SimpleLightScene()); break;
-    case 5: integrator.scene = std::make_shared<Scene>(SampleScene::BunnyScene()); break;
-    case 6: integrator.scene = std::make_shared<Scene>(SampleScene::CornellBox()); break;
+    integrator.scene = SampleScene::Create(scene_id);
+    if (integrator.scene == nullptr) {
+        std::cerr << "[ERROR] Unknown scene id " << scene_id << "." << std::endl;
+        return;
     }
+    if (filter != nullptr) integrator.scene->camera.film->SetFilter(filter);
+    integrator.scene->camera.film->EnableAOVs(aov_flags);
 
 
     // switch (scene_id) {
@@ -76,12 +201,208 @@ void Render() {
     // integrator.scene->objects = shapeList;
 
     // integrator.Render(camera);
+    if (compare_samplers) {
+        int spp = integrator.sampler->samples_per_pixel;
+        auto results = CompareSamplerConvergence(integrator,
+            { "independent", "halton", "sobol", "pmj02" }, { spp, spp * 4 }, spp * 64);
+        PrintConvergenceReport(results);
+        return;
+    }
+    if (first_frame >= 0) {
+        integrator.RenderAnimation(first_frame, std::max(first_frame, last_frame), "./output/frame_%04d.png");
+        return;
+    }
+    if (stream_width > 0) {
+        integrator.RenderToStream("./output/result_stream.exr", stream_width);
+        return;
+    }
+    integrator.RenderWithMultithreading(use_gui);
+    SaveResults(*integrator.scene->camera.film, "./output/result.png", denoise);
+}
+
+// 命令行批处理模式, 不从标准输入读取任何内容; 出错时返回非 0
+int RunCommandLine(int argc, char** argv) {
+    using namespace Aokana;
+
+    argparse::ArgumentParser program("AokanaRenderer");
+    program.add_argument("--scene").help("scene description file (JSON), see core/scene_loader.h");
+    program.add_argument("--scene-id").help("built-in sample scene (0-7), used when --scene is not given").scan<'i', int>().default_value(0);
+    program.add_argument("-o", "--output").help("output image; a .exr with linear radiance is saved next to it");
+    program.add_argument("--spp").help("samples per pixel").scan<'i', int>();
+    program.add_argument("--max-depth").help("maximum path depth").scan<'i', int>();
+    program.add_argument("--sampler").help("independent / halton / sobol / pmj02");
+    program.add_argument("--filter").help("box / tent / gaussian / mitchell");
+    program.add_argument("--filter-radius").help("reconstruction filter radius in pixels").scan<'g', double>();
+    program.add_argument("--aov").help("AOVs to save, e.g. depth,normal,albedo / all / none");
+    program.add_argument("--denoise").help("also save a denoised image").default_value(false).implicit_value(true);
+    program.add_argument("--adaptive").help("adaptive sampling with the given relative error threshold").scan<'g', double>();
+    program.add_argument("--progressive").help("progressive rendering with the given samples per pixel per pass").scan<'i', int>();
+    program.add_argument("--time-budget").help("render for the given number of seconds").scan<'g', double>();
+    program.add_argument("--mesh-compression").help("with --scene: compress OBJ vertex attributes, e.g. normals,uvs,positions / all / none");
+    program.add_argument("--checkpoint").help("checkpoint file");
+    program.add_argument("--checkpoint-interval").help("seconds between checkpoints").scan<'g', double>().default_value(60.0);
+    program.add_argument("--resume").help("resume from the checkpoint file").default_value(false).implicit_value(true);
+    program.add_argument("--pin-threads").help("pin worker threads to logical processors").default_value(false).implicit_value(true);
+    program.add_argument("--numa").help("NUMA-aware worker placement").default_value(false).implicit_value(true);
+    program.add_argument("--frames").help("render an animation frame range \"first:last\" or \"all\"");
+    program.add_argument("--stream-width").help("stream an image of the given width to <output>.exr band by band").scan<'i', int>();
+    program.add_argument("--gui").help("display the GUI while rendering").default_value(false).implicit_value(true);
+    program.add_argument("--publish-preview").help("publish a preview to the shared memory of the given name");
+    program.add_argument("--preview").help("view the preview published under the given name");
+    program.add_argument("--worker").help("render as a distributed worker of the coordinator at <host>:<port>");
+    program.add_argument("--coordinator").help("distribute the rendering to workers connecting to the given port").scan<'i', int>();
+    program.add_argument("--spp-per-task").help("samples per pixel of each distributed task (0 = all)").scan<'i', int>().default_value(0);
+    program.add_argument("--convert-obj").help("convert an OBJ file to a binary mesh (-o, default <file>.amesh) and exit");
+    program.add_argument("--flip-x").help("with --convert-obj: mirror the mesh along x like the \"obj\" shape").default_value(false).implicit_value(true);
+    program.add_argument("--no-bvh").help("with --convert-obj: do not store a BVH in the mesh file").default_value(false).implicit_value(true);
+
+    try {
+        program.parse_args(argc, argv);
+    }
+    catch (const std::exception& error) {
+        std::cerr << "[ERROR] " << error.what() << std::endl;
+        std::cerr << program;
+        return 1;
+    }
+
+    // AokanaRenderer --preview <name>: 查看另一个无显示器渲染进程发布的预览
+    if (auto name = program.present("--preview")) {
+        UI::PreviewRenderResultWithUI(*name);
+        return 0;
+    }
+    // AokanaRenderer --worker <host>:<port>: 作为分布式渲染的工作进程连接到协调进程
+    if (auto address = program.present("--worker")) {
+        size_t colon = address->find_last_of(':');
+        if (colon == std::string::npos) {
+            std::cerr << "[ERROR] Expected <host>:<port>, got \"" << *address << "\"." << std::endl;
+            return 1;
+        }
+        return RunDistributedWorker(address->substr(0, colon), static_cast<uint16_t>(std::stoi(address->substr(colon + 1)))) ? 0 : 1;
+    }
+
+    // AokanaRenderer --convert-obj <file>: 把 OBJ 转换为二进制网格文件
+    if (auto obj_file = program.present("--convert-obj")) {
+        std::string output = program.present("--output").value_or(
+            std::filesystem::path(*obj_file).replace_extension(".amesh").string());
+        Transform render_from_object = program.get<bool>("--flip-x") ? Transform::Scale(-1, 1, 1) : Transform();
+        // 网格文件保存全精度的数据
+        std::shared_ptr<TriangleMesh> mesh = LoadObjMesh(*obj_file, render_from_object, false, MeshCompression{ false, false, false });
+        if (mesh == nullptr) return 1;
+        return WriteMeshFile(output, mesh, !program.get<bool>("--no-bvh")) ? 0 : 1;
+    }
+
+    // 场景文件中的设置先生效, 命令行再覆盖
+    RenderSettings settings;
+    std::shared_ptr<Scene> scene;
+    const std::optional<std::string> scene_file = program.present("--scene");
+    // 网格在加载场景时就要压缩, 因此压缩方式要在加载之前给出
+    if (auto value = program.present("--mesh-compression")) settings.mesh_compression = *value;
+    if (scene_file) {
+        scene = LoadSceneFile(*scene_file, &settings);
+    }
+    else {
+        scene = SampleScene::Create(program.get<int>("--scene-id"));
+        if (scene == nullptr) std::cerr << "[ERROR] Unknown scene id " << program.get<int>("--scene-id") << "." << std::endl;
+    }
+    if (scene == nullptr) return 1;
+
+    if (auto value = program.present("--output")) settings.output = *value;
+    if (auto value = program.present<int>("--spp")) settings.samples_per_pixel = *value;
+    if (auto value = program.present<int>("--max-depth")) settings.max_depth = *value;
+    if (auto value = program.present("--sampler")) settings.sampler = *value;
+    if (auto value = program.present("--filter")) settings.filter = *value;
+    if (auto value = program.present<double>("--filter-radius")) settings.filter_radius = *value;
+    if (auto value = program.present("--aov")) settings.aovs = *value;
+    if (program.get<bool>("--denoise")) settings.denoise = true;
+    if (auto value = program.present<double>("--adaptive")) settings.adaptive_threshold = *value;
+    if (auto value = program.present<int>("--progressive")) settings.progressive_spp_per_pass = *value;
+    if (auto value = program.present<double>("--time-budget")) settings.time_budget_seconds = *value;
+
+    if (auto port = program.present<int>("--coordinator")) {
+        DistributedJob job;
+        job.scene_id = program.get<int>("--scene-id");
+        if (scene_file) std::snprintf(job.scene_file, sizeof(job.scene_file), "%s", std::filesystem::absolute(*scene_file).string().c_str());
+        job.max_depth = settings.max_depth;
+        job.samples_per_pixel = settings.samples_per_pixel;
+        job.samples_per_task = program.get<int>("--spp-per-task");
+        std::snprintf(job.sampler, sizeof(job.sampler), "%s", settings.sampler.c_str());
+        std::snprintf(job.filter, sizeof(job.filter), "%s", settings.filter.c_str());
+        std::snprintf(job.mesh_compression, sizeof(job.mesh_compression), "%s", settings.mesh_compression.c_str());
+        job.filter_radius = settings.filter_radius;
+        return RunDistributedCoordinator(job, static_cast<uint16_t>(*port), settings.output) ? 0 : 1;
+    }
+
+    SamplerIntegrator integrator;
+    integrator.scene = scene;
+    integrator.max_depth = settings.max_depth;
+    integrator.sampler = CreateSampler(settings.sampler, settings.samples_per_pixel);
+    if (integrator.sampler == nullptr) {
+        std::cerr << "[ERROR] Unknown sampler \"" << settings.sampler << "\"." << std::endl;
+        return 1;
+    }
+    std::shared_ptr<Filter> filter = CreateFilter(settings.filter, settings.filter_radius);
+    if (filter == nullptr) {
+        std::cerr << "[ERROR] Unknown filter \"" << settings.filter << "\"." << std::endl;
+        return 1;
+    }
+    Film& film = *scene->camera.film;
+    film.SetFilter(filter);
+    uint32_t aov_flags = ParseAOVFlags(settings.aovs);
+    if (settings.denoise) aov_flags |= AOV_ALBEDO | AOV_NORMAL | AOV_DEPTH;
+    film.EnableAOVs(aov_flags);
+
+    const std::filesystem::path output_path(settings.output);
+    const std::string output_stem = std::filesystem::path(output_path).replace_extension().string();
+    integrator.adaptive_sampling = settings.adaptive_threshold > 0;
+    if (integrator.adaptive_sampling) integrator.adaptive_threshold = settings.adaptive_threshold;
+    integrator.progressive = settings.progressive_spp_per_pass > 0;
+    if (integrator.progressive) {
+        integrator.progressive_spp_per_pass = settings.progressive_spp_per_pass;
+        integrator.progressive_preview_path = output_stem + "_preview" + output_path.extension().string();
+    }
+    integrator.time_budget_seconds = settings.time_budget_seconds;
+    if (integrator.time_budget_seconds > 0 && integrator.progressive_preview_path.empty()) {
+        integrator.progressive_preview_path = settings.output;
+    }
+    if (auto path = program.present("--checkpoint")) {
+        integrator.checkpoint_path = *path;
+        integrator.checkpoint_interval_seconds = program.get<double>("--checkpoint-interval");
+        integrator.resume_from_checkpoint = program.get<bool>("--resume");
+    }
+    integrator.pin_threads = program.get<bool>("--pin-threads") || program.get<bool>("--numa");
+    integrator.numa_aware = program.get<bool>("--numa");
+    const bool use_gui = program.get<bool>("--gui");
+    if (auto name = program.present("--publish-preview")) integrator.shared_preview_name = *name;
+
+    if (auto frames = program.present("--frames")) {
+        if (scene->animation == nullptr) {
+            std::cerr << "[ERROR] The scene has no animation." << std::endl;
+            return 1;
+        }
+        int first_frame = 0, last_frame = scene->animation->frame_count - 1;
+        if (*frames != "all" && std::sscanf(frames->c_str(), "%d:%d", &first_frame, &last_frame) != 2) {
+            std::cerr << "[ERROR] Expected \"first:last\" or \"all\", got \"" << *frames << "\"." << std::endl;
+            return 1;
+        }
+        // 输出路径中没有 %d 或 %0Nd 时在扩展名前插入帧号
+        std::string pattern = settings.output.find('%') != std::string::npos ?
+            settings.output : output_stem + "_%04d" + output_path.extension().string();
+        return integrator.RenderAnimation(first_frame, last_frame, pattern) ? 0 : 1;
+    }
+    if (auto width = program.present<int>("--stream-width")) {
+        integrator.RenderToStream(output_stem + ".exr", *width);
+        return 0;
+    }
+
     integrator.RenderWithMultithreading(use_gui);
-    integrator.scene->camera.SaveImage("./output/result.png");
+    SaveResults(film, settings.output, settings.denoise);
+    return 0;
 }
 
 
-int main() {
+int main(int argc, char** argv) {
+    // 没有参数时以交互方式从标准输入读取设置, 否则为命令行批处理模式, 参数见 AokanaRenderer --help
+    if (argc > 1) return RunCommandLine(argc, argv);
     Render();
 
     return 0;
@@ -60,6 +60,13 @@ namespace Aokana::UI {
     }
 
     Image::~Image() {
+        if (stream_mapped != nullptr) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixel_buffers[pixel_buffer_index]);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        }
+        if (pixel_buffers[0] != 0) glDeleteBuffers(2, pixel_buffers);
+        glDeleteTextures(1, &texture);
         glDeleteVertexArrays(1, &VAO);
         glDeleteBuffers(1, &VBO);
         glDeleteBuffers(1, &EBO);
@@ -98,11 +105,12 @@ namespace Aokana::UI {
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
+        // 纹理只使用线性过滤, 不需要 mipmap; 子图像更新时也就不必重新生成
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
         if (channels == 3)
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
         else
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
     }
 
     void Image::Draw() {
@@ -114,21 +122,91 @@ namespace Aokana::UI {
     }
 
     void Image::ModifySubimage(int x_min, int y_min, int x_max, int y_max, const std::vector<unsigned char>& subimage_data) {
+        // x_max, y_max 都包含在子图像内
         glBindTexture(GL_TEXTURE_2D, texture);
 
-        x_min = std::max(0, std::min(x_min, width));
-        x_max = std::max(0, std::min(x_max, width));
-        y_min = std::max(0, std::min(y_min, height));
-        y_max = std::max(0, std::min(y_max, height));
+        x_min = std::max(0, std::min(x_min, width - 1));
+        x_max = std::max(0, std::min(x_max, width - 1));
+        y_min = std::max(0, std::min(y_min, height - 1));
+        y_max = std::max(0, std::min(y_max, height - 1));
 
-        int subimage_width = x_max - x_min;
-        int subimage_height = y_max - y_min;
+        int subimage_width = x_max - x_min + 1;
+        int subimage_height = y_max - y_min + 1;
+        if (subimage_data.size() < static_cast<size_t>(subimage_width) * subimage_height * 3) return;
 
-        // std::vector<unsigned char> red_PIxels(subimage_width * subimage_height * 4, 0);
+        // tile 的行宽不一定是 4 的倍数
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, x_min, y_min, subimage_width, subimage_height, GL_RGB, GL_UNSIGNED_BYTE, subimage_data.data());
+    }
+
+    bool Image::StreamSubimage(int x_min, int y_min, int x_max, int y_max, const unsigned char* src, size_t src_row_stride) {
+        if (x_min < 0 || y_min < 0 || x_max >= width || y_max >= height || x_max < x_min || y_max < y_min) return true;
+
+        const int subimage_width = x_max - x_min + 1;
+        const int subimage_height = y_max - y_min + 1;
+        const size_t row_bytes = static_cast<size_t>(subimage_width) * 3;
+        const size_t bytes = row_bytes * subimage_height;
+
+        auto upload_synchronously = [&]() {
+            std::vector<unsigned char> subimage_data(bytes);
+            for (int row = 0; row < subimage_height; ++row) {
+                std::copy(src + row * src_row_stride, src + row * src_row_stride + row_bytes, subimage_data.data() + row * row_bytes);
+            }
+            ModifySubimage(x_min, y_min, x_max, y_max, subimage_data);
+            return true;
+        };
+
+        // 比整个 PBO 还大的子图像直接同步上传
+        if (bytes > stream_buffer_size) return upload_synchronously();
+
+        if (pixel_buffers[0] == 0) {
+            glGenBuffers(2, pixel_buffers);
+            for (unsigned int buffer : pixel_buffers) {
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+                glBufferData(GL_PIXEL_UNPACK_BUFFER, stream_buffer_size, nullptr, GL_STREAM_DRAW);
+            }
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        }
+
+        if (stream_mapped == nullptr) {
+            // 映射时使缓冲区内容失效, 驱动可以直接分配新的存储, 不必等待 GPU 读完上一次的数据
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixel_buffers[pixel_buffer_index]);
+            stream_mapped = static_cast<unsigned char*>(glMapBufferRange(
+                GL_PIXEL_UNPACK_BUFFER, 0, stream_buffer_size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            stream_offset = 0;
+            if (stream_mapped == nullptr) return upload_synchronously();
+        }
+
+        if (stream_offset + bytes > stream_buffer_size) return false;
+
+        unsigned char* dst = stream_mapped + stream_offset;
+        for (int row = 0; row < subimage_height; ++row) {
+            std::copy(src + row * src_row_stride, src + row * src_row_stride + row_bytes, dst + row * row_bytes);
+        }
+        stream_uploads.push_back(StreamUpload{ x_min, y_min, subimage_width, subimage_height, stream_offset });
+        stream_offset += bytes;
+        return true;
+    }
 
-        // for (int i = 0; i < subimage_width * subimage_height; i++) {
-        //     red_PIxels[i * 4] = 255;
-        // }
-        glTexSubImage2D(GL_TEXTURE_2D, 0, x_min, y_min, subimage_width + 1, subimage_height + 1, GL_RGB, GL_UNSIGNED_BYTE, subimage_data.data());
+    void Image::FlushStream() {
+        if (stream_mapped == nullptr) return;
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixel_buffers[pixel_buffer_index]);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        stream_mapped = nullptr;
+
+        // 绑定了 PBO 时, glTexSubImage2D 的数据参数是缓冲区内的偏移, 调用立即返回
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (const auto& upload : stream_uploads) {
+            glTexSubImage2D(GL_TEXTURE_2D, 0, upload.x, upload.y, upload.width, upload.height,
+                GL_RGB, GL_UNSIGNED_BYTE, reinterpret_cast<const void*>(upload.offset));
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        stream_uploads.clear();
+        stream_offset = 0;
+        pixel_buffer_index ^= 1;
     }
 }
\ No newline at end of file
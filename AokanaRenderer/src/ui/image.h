@@ -21,6 +21,16 @@ namespace Aokana::UI {
         void CreateTexture(const unsigned char* data, unsigned int width, unsigned int height, unsigned int channels);
         void Draw();
         void ModifySubimage(int x_min, int y_min, int x_max, int y_max, const std::vector<unsigned char>& subimage_data);
+
+        // 通过双缓冲的像素缓冲对象 (PBO) 异步更新纹理:
+        // StreamSubimage 把子图像 (x_max, y_max 包含在内) 复制到当前映射的 PBO 中, 本帧的 PBO 已满时返回 false, 调用者应在之后的帧重试;
+        // FlushStream 每帧调用一次, 从 PBO 发起所有的纹理上传 (由驱动异步完成), 并切换到另一个 PBO, 避免等待上一帧的传输
+        // src 指向子图像左上角的像素, src_row_stride 为源数据一行的字节数
+        bool StreamSubimage(int x_min, int y_min, int x_max, int y_max, const unsigned char* src, size_t src_row_stride);
+        void FlushStream();
+
+        // 每帧最多通过 PBO 上传的字节数
+        size_t stream_buffer_size = 4 << 20;
     public:
         unsigned int texture;
         unsigned int VAO;
@@ -34,6 +44,17 @@ namespace Aokana::UI {
         std::shared_ptr<Shader> shader;
 
     private:
+        struct StreamUpload {
+            int x, y, width, height;
+            size_t offset;
+        };
+
+        unsigned int pixel_buffers[2] = { 0, 0 };
+        int pixel_buffer_index = 0;
+        unsigned char* stream_mapped = nullptr;
+        size_t stream_offset = 0;
+        std::vector<StreamUpload> stream_uploads;
+
         static constexpr float vertices[] = {
             //     ---- 位置 ----       ---- 颜色 ----     - 纹理坐标 -
             1.0f,  1.0f, 0.0f,   1.0f, 0.0f, 0.0f,   1.0f, 1.0f,   // 右上
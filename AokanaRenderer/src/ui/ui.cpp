@@ -1,4 +1,9 @@
 #include "ui.h"
+#include "../core/shared_preview.h"
+
+#include <chrono>
+#include <cstdint>
+#include <thread>
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -14,7 +19,88 @@ namespace Aokana::UI {
             glfwSetWindowShouldClose(window, true);
     }
 
-    void PreviewRenderResultWithUI() {
+    void PreviewRenderResultWithUI(const std::string& shared_preview_name) {
+        Aokana::SharedPreviewReader reader;
+        // 渲染进程可能还没有创建共享内存, 最多等待 30 秒
+        for (int attempt = 0; !reader.Open(shared_preview_name); ++attempt) {
+            if (attempt == 300) {
+                std::cerr << "[ERROR] Shared preview \"" << shared_preview_name << "\" not found." << std::endl;
+                return;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        const Aokana::SharedPreviewHeader& header = *reader.header;
+        const int width = static_cast<int>(header.image_width);
+        const int height = static_cast<int>(header.image_height);
+        const size_t row_stride = static_cast<size_t>(width) * 3;
+        std::cout << "[INFO] Previewing \"" << shared_preview_name << "\", " << width << "x" << height << "." << std::endl;
+
+        GLFWwindow* window = CreateGUIWindow();
+        if (window == nullptr) {
+            // 没有可用的显示器时只输出进度
+            while (header.finished.load(std::memory_order_acquire) == 0) {
+                std::cout << "[INFO] " << header.rendered_spp.load(std::memory_order_relaxed) << " spp, "
+                    << header.event_count.load(std::memory_order_relaxed) << " tile events." << std::endl;
+                std::this_thread::sleep_for(std::chrono::seconds(1));
+            }
+            return;
+        }
+
+        std::shared_ptr<Image> image = std::make_shared<Image>(width, height, reader.image);
+        glViewport(0, 0, width, height);
+        glfwSetWindowSize(window, width, height);
+
+        // 已经处理到的事件数; 落后超过环形缓冲区的容量或者读到被覆盖的事件时, 重新上传整幅图像
+        uint64_t next_event = header.event_count.load(std::memory_order_acquire);
+        uint32_t shown_spp = UINT32_MAX;
+        bool shown_finished = false;
+        while (!glfwWindowShouldClose(window)) {
+            ProcessInput(window);
+            glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT);
+
+            uint64_t event_count = header.event_count.load(std::memory_order_acquire);
+            bool refresh = event_count - next_event > header.ring_capacity;
+            while (!refresh && next_event < event_count) {
+                const Aokana::SharedTileEvent& event = reader.events[next_event % header.ring_capacity];
+                uint64_t sequence = event.sequence.load(std::memory_order_acquire);
+                // 事件已被分配但还没有写完, 留到下一帧
+                if (sequence < next_event + 1) break;
+                if (sequence != next_event + 1) {
+                    refresh = true;
+                    break;
+                }
+                int x_min = event.x_min.load(std::memory_order_relaxed);
+                int y_min = event.y_min.load(std::memory_order_relaxed);
+                int x_max = event.x_max.load(std::memory_order_relaxed);
+                int y_max = event.y_max.load(std::memory_order_relaxed);
+                const unsigned char* src = reader.image + static_cast<size_t>(y_min) * row_stride + static_cast<size_t>(x_min) * 3;
+                if (!image->StreamSubimage(x_min, y_min, x_max, y_max, src, row_stride)) break;
+                ++next_event;
+            }
+            if (refresh) {
+                next_event = event_count;
+                std::vector<unsigned char> snapshot(reader.image, reader.image + row_stride * height);
+                image->ModifySubimage(0, 0, width - 1, height - 1, snapshot);
+            }
+            image->FlushStream();
+
+            uint32_t spp = header.rendered_spp.load(std::memory_order_relaxed);
+            bool finished = header.finished.load(std::memory_order_acquire) != 0;
+            if (spp != shown_spp || finished != shown_finished) {
+                std::string title = "Aokana Renderer - " + shared_preview_name + " - " + std::to_string(spp) + " spp";
+                if (finished) title += " (finished)";
+                glfwSetWindowTitle(window, title.c_str());
+                shown_spp = spp;
+                shown_finished = finished;
+            }
+
+            image->Draw();
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+        }
+        image.reset();
+        glfwTerminate();
     }
 
     GLFWwindow* CreateGUIWindow() {
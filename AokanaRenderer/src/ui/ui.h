@@ -2,11 +2,14 @@
 
 #include "image.h"
 
+#include <string>
+
 namespace Aokana::UI {
 
     void FramebufferSizeCallback(GLFWwindow* window, int width, int height);
     void ProcessInput(GLFWwindow* window);
-    void PreviewRenderResultWithUI();
+    // 查看另一个渲染进程通过共享内存发布的预览, 渲染结束或窗口关闭时返回
+    void PreviewRenderResultWithUI(const std::string& shared_preview_name);
     GLFWwindow* CreateGUIWindow();
     void DrawGUI(GLFWwindow* window, std::shared_ptr<Image> image);
 }
\ No newline at end of file